@@ -16,10 +16,18 @@ LOCAL_SRC_FILES += 	sensors_module.c \
 			sensors_config.c \
 			sensors_fifo.c \
 			sensors_worker.c \
+			sensors_timer.c \
 			sensors_select.c \
+			sensors_epoll.c \
 			sensors_wrapper.c \
+			sensors_fusion.c \
+			sensors_frame.c \
+			sensors_registry.c \
 			sensors_input_cache.c \
 			sensors_sysfs.c \
+			sensors_trace.c \
+			sensors_metrics.c \
+			sensors_tracepoint.c \
 			sensors/sensor_util.c
 
 LOCAL_CFLAGS += -I$(LOCAL_PATH)/sensors
@@ -33,6 +41,12 @@ LOCAL_CFLAGS += -DLOG_NDEBUG
 # Set 1 to enable verbose debug
 LOCAL_CFLAGS += -DDEBUG_VERBOSE=0
 
+# Lowest level of the data path logs, DASH_LOG_INFO drops DASH_LOGV/D
+LOCAL_CFLAGS += -DDASH_LOG_LEVEL=DASH_LOG_INFO
+
+# Uncomment to record event path tracepoints, see sensors_tracepoint.h
+#LOCAL_CFLAGS += -DDASH_TRACEPOINTS
+
 include $(LOCAL_PATH)/sensors/Sensors.mk
 LOCAL_SRC_FILES += $(patsubst %,sensors/%, $(yes-files))
 LOCAL_CFLAGS += $(yes-cflags)
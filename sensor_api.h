@@ -28,12 +28,20 @@ struct sensor_data_t {
 	int delay;
 };
 
+/*
+ * batch and flush are optional and only set by sensors able to buffer
+ * samples. batch takes the HAL batch flags and the maximum report latency
+ * in ns, flush must deliver all buffered samples before it returns.
+ */
 struct sensor_api_t {
 	int (*init)(struct sensor_api_t *s);
 	int (*activate)(struct sensor_api_t *s, int enable);
 	int (*set_delay)(struct sensor_api_t *s, int64_t ns);
 	void (*close)(struct sensor_api_t *s);
 	void (*data)(struct sensor_api_t *s, struct sensor_data_t *sd);
+	int (*batch)(struct sensor_api_t *s, int flags, int64_t ns,
+		     int64_t timeout);
+	int (*flush)(struct sensor_api_t *s);
 };
 
 #endif
@@ -28,7 +28,7 @@
 #endif
 
 #define DUMMY_DATA "1"
-#define PATH_SIZE 44
+#define PATH_SIZE (CONFIG_ROOT_MAX + 44)
 #define DEV_NAME "compass"
 #define PHYS_PATH_BASE "/sys/devices/virtual/input"
 
@@ -68,8 +68,8 @@ static int ak896x_set_delay(struct sensor_api_t *s, int64_t ns)
 
 static int ak896x_singleshot(struct sensor_desc *d)
 {
-	return d->sysfs.write(&d->sysfs, "single", DUMMY_DATA,
-			      strlen(DUMMY_DATA));
+	return d->sysfs.trigger(&d->sysfs, "single", DUMMY_DATA,
+				strlen(DUMMY_DATA));
 }
 
 static int ak896x_set_interval(struct sensor_desc *d, int interval)
@@ -108,7 +108,9 @@ static int ak896x_init(struct sensor_api_t *s_api)
 	}
 
 	sensors_sysfs_init(&d->sysfs, sysfs_path, SYSFS_TYPE_ABS_PATH);
-	sensors_select_init(&d->select_worker, ak896x_read, d, -1);
+	if (sensors_select_init(&d->select_worker, ak896x_read, d, -1) < 0)
+		goto exit;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 
@@ -140,6 +142,7 @@ static int ak896x_activate(struct sensor_api_t *s, int enable)
 			goto exit;
 		}
 
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -167,7 +170,7 @@ static int ak896x_form(void)
 
 static void *ak896x_read(void *arg)
 {
-	struct input_event evbuf[10];
+	struct input_event *evbuf;
 	struct input_event *event;
 	struct sensor_desc *d = arg;
 	int fd = d->select_worker.get_fd(&d->select_worker);
@@ -176,42 +179,40 @@ static void *ak896x_read(void *arg)
 	struct sensor_data_t sd;
 	static int status = SENSOR_STATUS_ACCURACY_HIGH;
 
-	n = read(fd, evbuf, sizeof(evbuf));
-	if (n < 0) {
-		ALOGE("%s: read error from fd %d, errno %d", __func__, fd, errno);
-		goto exit;
-	}
-	n = n / sizeof(evbuf[0]);
-	for (i = 0; i < n; i++) {
-		event = evbuf + i;
-		if (event->type == EV_SYN) {
-			memset(&sd, 0, sizeof(sd));
-			sd.sensor = &d->sensor;
-			sd.timestamp = get_current_nano_time();
-			sd.data = d->data;
-			sd.delay = d->applied_delay_ms;
-			sd.status = status;
-			sensors_wrapper_data(&sd);
-		}
-		if (event->type != EV_MSC)
-			continue;
-		switch (event->code) {
-			case EVENT_CODE_ORIENT_STATUS:
-				status = event->value;
-				break;
-			case EVENT_CODE_MAGV_X:
-				d->data[0] = event->value;
-				break;
-			case EVENT_CODE_MAGV_Y:
-				d->data[1] = event->value;
-				break;
-			case EVENT_CODE_MAGV_Z:
-				d->data[2] = event->value;
-				break;
+	while ((n = input_reader_frame(&d->reader, fd, &evbuf)) > 0) {
+		for (i = 0; i < n; i++) {
+			event = evbuf + i;
+			if (event->type == EV_SYN) {
+				memset(&sd, 0, sizeof(sd));
+				sd.sensor = &d->sensor;
+				sd.timestamp = input_reader_time(&d->reader, event);
+				sd.data = d->data;
+				sd.delay = d->applied_delay_ms;
+				sd.status = status;
+				sensors_wrapper_data(&sd);
+			}
+			if (event->type != EV_MSC)
+				continue;
+			switch (event->code) {
+				case EVENT_CODE_ORIENT_STATUS:
+					status = event->value;
+					break;
+				case EVENT_CODE_MAGV_X:
+					d->data[0] = event->value;
+					break;
+				case EVENT_CODE_MAGV_Y:
+					d->data[1] = event->value;
+					break;
+				case EVENT_CODE_MAGV_Z:
+					d->data[2] = event->value;
+					break;
+			}
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read error from fd %d, errno %d",
+				      __func__, fd, -n);
 
-exit:
 	return NULL;
 }
 
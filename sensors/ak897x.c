@@ -77,6 +77,7 @@ struct sensor_desc {
 	int status;
 	int map[NUM_AXIS];
 	int sign[NUM_AXIS];
+	struct sensor_transform_t transform;
 	char *map_prefix;
 	void *handle;
 	int active;
@@ -90,6 +91,7 @@ struct ak897x_sensor_composition {
 	struct sensor_desc magnetic;
 	char *input_name;
 	struct sensors_select_t select_worker;
+	struct input_reader_t reader;
 	pthread_mutex_t lock;
 	int acc_handle;
 	int (*request_acc_delay)(int *handle, int64_t ns);
@@ -153,6 +155,18 @@ static void ak897x_read_sensor_map(struct sensor_desc *d)
 	     d->sign[AXIS_X], d->sign[AXIS_Y], d->sign[AXIS_Z]);
 }
 
+static void ak897x_read_transform(struct sensor_desc *d)
+{
+	int i;
+
+	ak897x_read_sensor_map(d);
+
+	sensor_transform_init(&d->transform);
+	for (i = 0; i < NUM_AXIS; i++)
+		sensor_transform_set(&d->transform, i, d->map[i],
+				     d->sign[i] * d->scale);
+}
+
 static int ak897x_set_delay(struct sensor_api_t *s, int64_t ns)
 {
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
@@ -204,10 +218,12 @@ static int ak897x_init(struct sensor_api_t *s_api)
 	if (init)
 		return 0;
 
-	ak897x_read_sensor_map(&sc->orientation);
-	ak897x_read_sensor_map(&sc->orientation_raw);
-	ak897x_read_sensor_map(&sc->magnetic);
-	sensors_select_init(&sc->select_worker, ak897x_read, sc, -1);
+	ak897x_read_transform(&sc->orientation);
+	ak897x_read_transform(&sc->orientation_raw);
+	ak897x_read_transform(&sc->magnetic);
+	if (sensors_select_init(&sc->select_worker, ak897x_read, sc, -1) < 0)
+		return -1;
+	sc->select_worker.handle = sc->magnetic.sensor.handle;
 	return 0;
 }
 
@@ -239,6 +255,7 @@ static int ak897x_activate(struct sensor_api_t *s, int enable)
 			ret = -1;
 			goto exit;
 		}
+		input_reader_set_fd(&sc->reader, fd);
 		sc->select_worker.set_fd(&sc->select_worker, fd);
 		sc->select_worker.resume(&sc->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -262,14 +279,12 @@ exit:
 
 static void scale_and_map(sensors_event_t *d, struct sensor_desc *s)
 {
-	int i;
-	for (i = 0; i < 3; i++)
-		d->orientation.v[i] = s->data[s->map[i]] * s->sign[i] * s->scale;
+	sensor_transform_apply(&s->transform, s->data, d->orientation.v, 1);
 }
 
 static void *ak897x_read(void *arg)
 {
-	struct input_event evbuf[10];
+	struct input_event *evbuf;
 	struct input_event *event;
 	struct ak897x_sensor_composition *sc = arg;
 	int fd = sc->select_worker.get_fd(&sc->select_worker);
@@ -280,71 +295,75 @@ static void *ak897x_read(void *arg)
 	memset(&sdata, 0, sizeof(sdata));
 
 	pthread_mutex_lock(&sc->lock);
-	n = read(fd, evbuf, sizeof(evbuf)) / sizeof(evbuf[0]);
-	for (i = 0; i < n; i++) {
-		event = evbuf + i;
-		if (event->type == EV_SYN) {
-			if (sc->magnetic.active) {
-				sdata.version = sc->magnetic.sensor.version;
-				sdata.sensor = sc->magnetic.sensor.handle;
-				sdata.type = sc->magnetic.sensor.type;
-				sdata.timestamp = get_current_nano_time();
-				scale_and_map(&sdata, &sc->magnetic);
-
-				sensors_fifo_put(&sdata);
-			}
-			if (sc->orientation_raw.active) {
-				sdata.version = sc->orientation_raw.sensor.version;
-				sdata.sensor = sc->orientation_raw.sensor.handle;
-				sdata.type = sc->orientation_raw.sensor.type;
-				sdata.timestamp = get_current_nano_time();
-				scale_and_map(&sdata, &sc->orientation_raw);
-
-				sensors_fifo_put(&sdata);
+	while ((n = input_reader_frame(&sc->reader, fd, &evbuf)) > 0) {
+		for (i = 0; i < n; i++) {
+			event = evbuf + i;
+			if (event->type == EV_SYN) {
+				sdata.timestamp = input_reader_time(&sc->reader,
+								    event);
+				if (sc->magnetic.active) {
+					sdata.version = sc->magnetic.sensor.version;
+					sdata.sensor = sc->magnetic.sensor.handle;
+					sdata.type = sc->magnetic.sensor.type;
+					scale_and_map(&sdata, &sc->magnetic);
+
+					sensors_fifo_put(&sdata);
+				}
+				if (sc->orientation_raw.active) {
+					sdata.version = sc->orientation_raw.sensor.version;
+					sdata.sensor = sc->orientation_raw.sensor.handle;
+					sdata.type = sc->orientation_raw.sensor.type;
+					scale_and_map(&sdata, &sc->orientation_raw);
+
+					sensors_fifo_put(&sdata);
+				}
+				if (sc->orientation.active) {
+					sdata.version = sc->orientation.sensor.version;
+					sdata.sensor = sc->orientation.sensor.handle;
+					sdata.type = sc->orientation.sensor.type;
+					sdata.orientation.status = sc->orientation_raw.status;
+
+					memcpy(&sc->orientation.data,
+					       &sc->orientation_raw.data,
+					       sizeof(sc->orientation.data));
+					scale_and_map(&sdata, &sc->orientation);
+
+					sensors_fifo_put(&sdata);
+				}
+				continue;
 			}
-			if (sc->orientation.active) {
-				sdata.version = sc->orientation.sensor.version;
-				sdata.sensor = sc->orientation.sensor.handle;
-				sdata.type = sc->orientation.sensor.type;
-				sdata.timestamp = get_current_nano_time();
-				sdata.orientation.status = sc->orientation_raw.status;
-
-				memcpy(&sc->orientation.data,
-				       &sc->orientation_raw.data,
-				       sizeof(sc->orientation.data));
-				scale_and_map(&sdata, &sc->orientation);
-
-				sensors_fifo_put(&sdata);
+			if (event->type != EV_ABS)
+				continue;
+			switch (event->code) {
+				case EVENT_CODE_YAW:
+					sc->orientation_raw.data[0] = event->value;
+					break;
+				case EVENT_CODE_PITCH:
+					sc->orientation_raw.data[1] = event->value;
+					break;
+				case EVENT_CODE_ROLL:
+					sc->orientation_raw.data[2] = event->value;
+					break;
+				case EVENT_CODE_ORIENT_STATUS:
+					sc->orientation_raw.status =
+							event->value & SENSOR_STATE_MASK;
+					break;
+				case EVENT_CODE_MAGV_X:
+					sc->magnetic.data[0] = event->value;
+					break;
+				case EVENT_CODE_MAGV_Y:
+					sc->magnetic.data[1] = event->value;
+					break;
+				case EVENT_CODE_MAGV_Z:
+					sc->magnetic.data[2] = event->value;
+					break;
 			}
-			continue;
-		}
-		if (event->type != EV_ABS)
-			continue;
-		switch (event->code) {
-			case EVENT_CODE_YAW:
-				sc->orientation_raw.data[0] = event->value;
-				break;
-			case EVENT_CODE_PITCH:
-				sc->orientation_raw.data[1] = event->value;
-				break;
-			case EVENT_CODE_ROLL:
-				sc->orientation_raw.data[2] = event->value;
-				break;
-			case EVENT_CODE_ORIENT_STATUS:
-				sc->orientation_raw.status =
-						event->value & SENSOR_STATE_MASK;
-				break;
-			case EVENT_CODE_MAGV_X:
-				sc->magnetic.data[0] = event->value;
-				break;
-			case EVENT_CODE_MAGV_Y:
-				sc->magnetic.data[1] = event->value;
-				break;
-			case EVENT_CODE_MAGV_Z:
-				sc->magnetic.data[2] = event->value;
-				break;
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read error from fd %d, errno %d",
+				      __func__, fd, -n);
+
 	pthread_mutex_unlock(&sc->lock);
 
 	return NULL;
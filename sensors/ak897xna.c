@@ -69,8 +69,8 @@ static int ak897x_set_delay(struct sensor_api_t *s, int64_t ns)
 
 static int ak897x_singleshot(struct sensor_desc *d)
 {
-	return d->sysfs.write(&d->sysfs, "single", DUMMY_DATA,
-			      strlen(DUMMY_DATA));
+	return d->sysfs.trigger(&d->sysfs, "single", DUMMY_DATA,
+				strlen(DUMMY_DATA));
 }
 
 static int ak897x_set_interval(struct sensor_desc *d, int interval)
@@ -89,6 +89,7 @@ static int ak897x_set_interval(struct sensor_desc *d, int interval)
 static int ak897x_init(struct sensor_api_t *s_api)
 {
 	int fd;
+	char path[SYSFS_PATH_MAX];
 	struct sensor_desc *d = container_of(s_api, struct sensor_desc, api);
 
 	/* check for availablity */
@@ -100,8 +101,11 @@ static int ak897x_init(struct sensor_api_t *s_api)
 	}
 	close(fd);
 
-	sensors_sysfs_init(&d->sysfs, ak897x_sysfs_path, SYSFS_TYPE_ABS_PATH);
-	sensors_select_init(&d->select_worker, ak897x_read, d, -1);
+	dev_root_path(ak897x_sysfs_path, path, sizeof(path));
+	sensors_sysfs_init(&d->sysfs, path, SYSFS_TYPE_ABS_PATH);
+	if (sensors_select_init(&d->select_worker, ak897x_read, d, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	ALOGE("%s: init OK.\n", __func__);
 	return 0;
@@ -131,6 +135,7 @@ static int ak897x_activate(struct sensor_api_t *s, int enable)
 			goto exit;
 		}
 
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -158,7 +163,7 @@ static int ak897x_form(void)
 
 static void *ak897x_read(void *arg)
 {
-	struct input_event evbuf[10];
+	struct input_event *evbuf;
 	struct input_event *event;
 	struct sensor_desc *d = arg;
 	int fd = d->select_worker.get_fd(&d->select_worker);
@@ -167,42 +172,40 @@ static void *ak897x_read(void *arg)
 	struct sensor_data_t sd;
 	int status = SENSOR_STATUS_ACCURACY_HIGH;
 
-	n = read(fd, evbuf, sizeof(evbuf));
-	if (n < 0) {
-		ALOGE("%s: read error from fd %d, errno %d", __func__, fd, errno);
-		goto exit;
-	}
-	n = n / sizeof(evbuf[0]);
-	for (i = 0; i < n; i++) {
-		event = evbuf + i;
-		if (event->type == EV_SYN) {
-			memset(&sd, 0, sizeof(sd));
-			sd.sensor = &d->sensor;
-			sd.timestamp = get_current_nano_time();
-			sd.data = d->data;
-			sd.delay = d->applied_delay_ms;
-			sd.status = status;
-			sensors_wrapper_data(&sd);
-		}
-		if (event->type != EV_ABS)
-			continue;
-		switch (event->code) {
-			case EVENT_CODE_ORIENT_STATUS:
-				status = event->value;
-				break;
-			case EVENT_CODE_MAGV_X:
-				d->data[0] = event->value;
-				break;
-			case EVENT_CODE_MAGV_Y:
-				d->data[1] = event->value;
-				break;
-			case EVENT_CODE_MAGV_Z:
-				d->data[2] = event->value;
-				break;
+	while ((n = input_reader_frame(&d->reader, fd, &evbuf)) > 0) {
+		for (i = 0; i < n; i++) {
+			event = evbuf + i;
+			if (event->type == EV_SYN) {
+				memset(&sd, 0, sizeof(sd));
+				sd.sensor = &d->sensor;
+				sd.timestamp = input_reader_time(&d->reader, event);
+				sd.data = d->data;
+				sd.delay = d->applied_delay_ms;
+				sd.status = status;
+				sensors_wrapper_data(&sd);
+			}
+			if (event->type != EV_ABS)
+				continue;
+			switch (event->code) {
+				case EVENT_CODE_ORIENT_STATUS:
+					status = event->value;
+					break;
+				case EVENT_CODE_MAGV_X:
+					d->data[0] = event->value;
+					break;
+				case EVENT_CODE_MAGV_Y:
+					d->data[1] = event->value;
+					break;
+				case EVENT_CODE_MAGV_Z:
+					d->data[2] = event->value;
+					break;
+			}
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read error from fd %d, errno %d",
+				      __func__, fd, -n);
 
-exit:
 	return NULL;
 }
 
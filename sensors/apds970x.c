@@ -43,6 +43,7 @@ struct sensor_desc {
 	struct sensors_select_t select_worker;
 	struct sensor_t sensor;
 	struct sensor_api_t api;
+	struct input_reader_t reader;
 
 	float distance;
 	int64_t delay;
@@ -151,7 +152,9 @@ static int apds9700_init(struct sensor_api_t *s)
 	}
 	close(fd);
 
-	sensors_select_init(&d->select_worker, apds9700_read, s, -1);
+	if (sensors_select_init(&d->select_worker, apds9700_read, s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 	return 0;
 }
 
@@ -173,6 +176,7 @@ static int apds9700_activate(struct sensor_api_t *s, int enable)
 			ALOGW("%s: unable to enable wake locks\n", __func__);
 #endif
 		apds9700_init_threshold_members(d, fd);
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -213,35 +217,39 @@ static void *apds9700_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event event;
+	struct input_event *events;
+	struct input_event *e;
 	sensors_event_t data;
-	int ret;
+	int i, n;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 
-	while ((ret = read(fd, &event, sizeof(event))) > 0) {
-		switch (event.type) {
-		case EV_MSC:
-			if (event.code == MSC_RAW)
-				apds9700_store_dist(d, event.value);
-			break;
-		case EV_ABS:
-			if (event.code == ABS_DISTANCE)
-				apds9700_store_dist(d, event.value);
-			break;
-		case EV_SYN:
-			memset(&data, 0, sizeof(data));
-
-			data.distance = d->distance;
-
-			data.version = apds970x.sensor.version;
-			data.sensor = apds970x.sensor.handle;
-			data.type = apds970x.sensor.type;
-			data.timestamp = get_current_nano_time();
-
-			sensors_fifo_put(&data);
-			break;
-		default:
-			break;
+	while ((n = input_reader_frame(&d->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			switch (e->type) {
+			case EV_MSC:
+				if (e->code == MSC_RAW)
+					apds9700_store_dist(d, e->value);
+				break;
+			case EV_ABS:
+				if (e->code == ABS_DISTANCE)
+					apds9700_store_dist(d, e->value);
+				break;
+			case EV_SYN:
+				memset(&data, 0, sizeof(data));
+
+				data.distance = d->distance;
+
+				data.version = apds970x.sensor.version;
+				data.sensor = apds970x.sensor.handle;
+				data.type = apds970x.sensor.type;
+				data.timestamp = input_reader_time(&d->reader, e);
+
+				sensors_fifo_put(&data);
+				break;
+			default:
+				break;
+			}
 		}
 	}
 
@@ -51,16 +51,19 @@ static void *light_poll(void *arg)
 static int light_init(struct sensor_api_t *s)
 {
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
+	char path[SYSFS_PATH_MAX];
 
 	sensors_worker_init(&d->worker, light_poll, &d->worker);
-	sensors_sysfs_init(&d->sysfs, ALS_PATH, SYSFS_TYPE_ABS_PATH);
+	d->worker.handle = d->sensor.handle;
+	dev_root_path(ALS_PATH, path, sizeof(path));
+	sensors_sysfs_init(&d->sysfs, path, SYSFS_TYPE_ABS_PATH);
 
 	return 0;
 }
 
 static int light_activate(struct sensor_api_t *s, int enable)
 {
-	char result_path[64];
+	char result_path[SYSFS_PATH_MAX + SYSFS_ATTR_NAME_MAX];
 	int fd;
 	int count;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
@@ -69,7 +72,7 @@ static int light_activate(struct sensor_api_t *s, int enable)
 		d->sysfs.write_int(&d->sysfs, "als_on", 1);
 
 		count = snprintf(result_path, sizeof(result_path), "%s/%s",
-			 ALS_PATH, "adc_als_value");
+			 d->sysfs.data.path, "adc_als_value");
 		if ((count < 0) || (count >= (int)sizeof(result_path))) {
 			ALOGE("%s: snprintf failed! %d\n", __func__, count);
 			return -1;
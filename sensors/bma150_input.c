@@ -52,6 +52,7 @@ struct sensor_desc {
 	struct sensor_api_t api;
 
 	int input_fd;
+	struct input_reader_t reader;
 	float current_data[3];
 
 	char *rate_path;
@@ -210,7 +211,10 @@ static int bma150_input_init(struct sensor_api_t *s)
 	d->rate_path = bma150_get_rate_path(fd);
 	close(fd);
 
-	sensors_select_init(&d->select_worker, bma150_input_read, s, -1);
+	if (sensors_select_init(&d->select_worker, bma150_input_read,
+					s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 	return 0;
 }
 
@@ -228,6 +232,7 @@ static int bma150_input_activate(struct sensor_api_t *s, int enable)
 				BMA150_INPUT_NAME);
 			return -1;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -318,58 +323,61 @@ static void *bma150_input_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event event;
+	struct input_event *events;
+	struct input_event *e;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 	sensors_event_t data;
+	int i, n;
 
 	memset(&data, 0, sizeof(data));
-	while (read(fd, &event, sizeof(event)) > 0) {
-		switch (event.type) {
-		case EV_ABS:
-			switch (event.code) {
-			case ABS_X:
-				d->current_data[0] = ev2grav(event.value);
+	while ((n = input_reader_frame(&d->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			switch (e->type) {
+			case EV_ABS:
+				switch (e->code) {
+				case ABS_X:
+					d->current_data[0] = ev2grav(e->value);
+					break;
+
+				case ABS_Y:
+					d->current_data[1] = ev2grav(e->value);
+					break;
+
+				case ABS_Z:
+					d->current_data[2] = ev2grav(e->value);
+					break;
+
+				case ABS_MISC:
+				default:
+					break;
+				}
 				break;
 
-			case ABS_Y:
-				d->current_data[1] = ev2grav(event.value);
-				break;
+			case EV_SYN:
+
+				data.acceleration.x = (d->neg_x ? -d->current_data[d->axis_x] :
+								   d->current_data[d->axis_x]);
+				data.acceleration.y = (d->neg_y ? -d->current_data[d->axis_y] :
+								   d->current_data[d->axis_y]);
+				data.acceleration.z = (d->neg_z ? -d->current_data[d->axis_z] :
+								   d->current_data[d->axis_z]);
+				data.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
 
-			case ABS_Z:
-				d->current_data[2] = ev2grav(event.value);
+				data.sensor = bma150_input.sensor.handle;
+				data.type = bma150_input.sensor.type;
+				data.version = bma150_input.sensor.version;
+				data.timestamp = input_reader_time(&d->reader, e);
+
+				sensors_fifo_put(&data);
 				break;
 
-			case ABS_MISC:
 			default:
 				break;
 			}
-			break;
-
-		case EV_SYN:
-
-			data.acceleration.x = (d->neg_x ? -d->current_data[d->axis_x] :
-							   d->current_data[d->axis_x]);
-			data.acceleration.y = (d->neg_y ? -d->current_data[d->axis_y] :
-							   d->current_data[d->axis_y]);
-			data.acceleration.z = (d->neg_z ? -d->current_data[d->axis_z] :
-							   d->current_data[d->axis_z]);
-			data.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
-
-			data.sensor = bma150_input.sensor.handle;
-			data.type = bma150_input.sensor.type;
-			data.version = bma150_input.sensor.version;
-			data.timestamp = get_current_nano_time();
-
-			sensors_fifo_put(&data);
-
-			goto exit;
-
-		default:
-			goto exit;
 		}
 	}
 
-exit:
 	return NULL;
 }
 
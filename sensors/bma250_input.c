@@ -53,7 +53,9 @@ struct sensor_desc {
 	struct sensor_api_t api;
 
 	int input_fd;
-	float current_data[3];
+	struct input_reader_t reader;
+	int current_data[3];
+	struct sensor_transform_t transform;
 	int64_t delay;
 
 	/* config options */
@@ -95,13 +97,20 @@ static struct sensor_desc bma250_input = {
 	.neg_z = 0
 };
 
-static inline float ev2grav(int evv)
+static void bma250_input_transform(struct sensor_desc *d)
 {
 	/* bma250 driver sensitivity is 256 lsb/g for all g-ranges. */
 	const float earth_g = 9.81;
 	const float lsb_per_g = 256;
-	float gravity_in_g = (float)evv / lsb_per_g;
-	return gravity_in_g * earth_g;
+	const float scale = earth_g / lsb_per_g;
+
+	sensor_transform_init(&d->transform);
+	sensor_transform_set(&d->transform, 0, d->axis_x,
+			     d->neg_x ? -scale : scale);
+	sensor_transform_set(&d->transform, 1, d->axis_y,
+			     d->neg_y ? -scale : scale);
+	sensor_transform_set(&d->transform, 2, d->axis_z,
+			     d->neg_z ? -scale : scale);
 }
 
 static void bma250_input_read_config(struct sensor_desc *d)
@@ -163,6 +172,7 @@ static int bma250_input_init(struct sensor_api_t *s)
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
 	int fd;
 	bma250_input_read_config(d);
+	bma250_input_transform(d);
 
 	fd = open_input_dev_by_name(BMA250_INPUT_NAME, O_RDONLY | O_NONBLOCK);
 	if (fd < 0) {
@@ -173,7 +183,10 @@ static int bma250_input_init(struct sensor_api_t *s)
 	close(fd);
 
 	sensors_sysfs_init(&d->sysfs, BMA250_INPUT_NAME, SYSFS_TYPE_INPUT_DEV);
-	sensors_select_init(&d->select_worker, bma250_input_read, s, -1);
+	if (sensors_select_init(&d->select_worker, bma250_input_read,
+					s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -192,6 +205,7 @@ static int bma250_input_activate(struct sensor_api_t *s, int enable)
 				__func__, BMA250_INPUT_NAME, strerror(errno));
 			return -1;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -238,62 +252,68 @@ static void *bma250_input_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event event;
+	struct input_event *events;
+	struct input_event *e;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 	sensors_event_t data;
-
-	while (read(fd, &event, sizeof(event)) > 0) {
-		switch (event.type) {
-		case EV_ABS:
-			switch (event.code) {
-			case ABS_X:
-				d->current_data[0] = ev2grav(event.value);
+	int i, n;
+
+	while ((n = input_reader_frame(&d->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			switch (e->type) {
+			case EV_ABS:
+				switch (e->code) {
+				case ABS_X:
+					d->current_data[0] = e->value;
+					break;
+
+				case ABS_Y:
+					d->current_data[1] = e->value;
+					break;
+
+				case ABS_Z:
+					d->current_data[2] = e->value;
+					break;
+
+				case ABS_MISC:
+					/* temperature, 0.5C/lsb */
+					break;
+
+				default:
+					DASH_LOGE_RATELIMITED(
+						"%s: unknown event code 0x%X",
+						__func__, e->code);
+					break;
+				}
 				break;
 
-			case ABS_Y:
-				d->current_data[1] = ev2grav(event.value);
-				break;
+			case EV_SYN:
+				sensor_transform_apply(&d->transform,
+						       d->current_data,
+						       data.acceleration.v, 1);
+				data.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
 
-			case ABS_Z:
-				d->current_data[2] = ev2grav(event.value);
-				break;
+				data.sensor = bma250_input.sensor.handle;
+				data.type = bma250_input.sensor.type;
+				data.version = bma250_input.sensor.version;
+				data.timestamp = input_reader_time(&d->reader, e);
 
-			case ABS_MISC:
-				/* temperature, 0.5C/lsb */
+				sensors_fifo_put(&data);
 				break;
 
 			default:
-				ALOGE("%s: unknown event code 0x%X\n",
-					__func__, event.code);
-				goto exit;
+				DASH_LOGE_RATELIMITED(
+					"%s: unknown event type 0x%X",
+					__func__, e->type);
+				break;
 			}
-			break;
-
-		case EV_SYN:
-			data.acceleration.x = (d->neg_x ? -d->current_data[d->axis_x] :
-						d->current_data[d->axis_x]);
-			data.acceleration.y = (d->neg_y ? -d->current_data[d->axis_y] :
-						d->current_data[d->axis_y]);
-			data.acceleration.z = (d->neg_z ? -d->current_data[d->axis_z] :
-						d->current_data[d->axis_z]);
-			data.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
-
-			data.sensor = bma250_input.sensor.handle;
-			data.type = bma250_input.sensor.type;
-			data.version = bma250_input.sensor.version;
-			data.timestamp = get_current_nano_time();
-
-			sensors_fifo_put(&data);
-			goto exit;
-
-		default:
-			ALOGE("%s: unknown event type 0x%X\n",
-				__func__, event.type);
-			goto exit;
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read error from fd %d: %s",
+				      __func__, fd, strerror(-n));
 
-exit:
 	return NULL;
 }
 
@@ -47,6 +47,7 @@ struct sensor_desc {
 	struct wrapper_entry entry;
 
 	int input_fd;
+	struct input_reader_t reader;
 	int current_data[3];
 	int64_t delay;
 
@@ -159,7 +160,10 @@ static int bma250_input_init(struct sensor_api_t *s)
 	close(fd);
 
 	sensors_sysfs_init(&d->sysfs, BMA250_INPUT_NAME, SYSFS_TYPE_INPUT_DEV);
-	sensors_select_init(&d->select_worker, bma250_input_read, s, -1);
+	if (sensors_select_init(&d->select_worker, bma250_input_read,
+					s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -178,6 +182,7 @@ static int bma250_input_activate(struct sensor_api_t *s, int enable)
 				__func__, BMA250_INPUT_NAME, strerror(errno));
 			return -1;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -213,12 +218,11 @@ static void bma250_input_close(struct sensor_api_t *s)
 	d->select_worker.destroy(&d->select_worker);
 }
 
-#define MAX_EVENTS 5 /* X, Y, Z, MISC, SYN */
 static void *bma250_input_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event events[MAX_EVENTS];
+	struct input_event *events;
 	struct input_event *e;
 	int fd;
 	int n;
@@ -227,59 +231,59 @@ static void *bma250_input_read(void *arg)
 
 	fd = d->select_worker.get_fd(&d->select_worker);
 
-	n = read(fd, events, sizeof(events));
-	if (n < 0) {
-		ALOGE("%s: read error from fd %d, errno %d", __func__, fd, errno);
-		goto exit;
-	}
-	n = n / sizeof(events[0]);
-	for (i = 0; i < n; i++) {
-		e = events + i;
-		switch (e->type) {
-		case EV_ABS:
-			switch (e->code) {
-			case ABS_X:
-				d->current_data[d->axis_x] = d->neg_x ? -e->value : e->value;
+	while ((n = input_reader_frame(&d->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			switch (e->type) {
+			case EV_ABS:
+				switch (e->code) {
+				case ABS_X:
+					d->current_data[d->axis_x] = d->neg_x ? -e->value : e->value;
+					break;
+
+				case ABS_Y:
+					d->current_data[d->axis_y] = d->neg_y ? -e->value : e->value;
+					break;
+
+				case ABS_Z:
+					d->current_data[d->axis_z] = d->neg_z ? -e->value : e->value;
+					break;
+
+				case ABS_MISC:
+					/* temperature, 0.5C/lsb */
+					break;
+
+				default:
+					DASH_LOGE_RATELIMITED(
+						"%s: unknown event code 0x%X",
+						__func__, e->code);
+					break;
+				}
 				break;
 
-			case ABS_Y:
-				d->current_data[d->axis_y] = d->neg_y ? -e->value : e->value;
-				break;
-
-			case ABS_Z:
-				d->current_data[d->axis_z] = d->neg_z ? -e->value : e->value;
-				break;
+			case EV_SYN:
+				memset(&sd, 0, sizeof(sd));
+				sd.sensor = &d->sensor;
+				sd.timestamp = input_reader_time(&d->reader, e);
+				sd.data = d->current_data;
+				sd.scale = d->scale;
+				sd.status = SENSOR_STATUS_ACCURACY_HIGH;
 
-			case ABS_MISC:
-				/* temperature, 0.5C/lsb */
+				sensors_wrapper_data(&sd);
 				break;
 
 			default:
-				ALOGE("%s: unknown event code 0x%X\n",
-					__func__, e->code);
+				DASH_LOGE_RATELIMITED(
+					"%s: unknown event type 0x%X",
+					__func__, e->type);
 				break;
 			}
-			break;
-
-		case EV_SYN:
-			memset(&sd, 0, sizeof(sd));
-			sd.sensor = &d->sensor;
-			sd.timestamp = get_current_nano_time();
-			sd.data = d->current_data;
-			sd.scale = d->scale;
-			sd.status = SENSOR_STATUS_ACCURACY_HIGH;
-
-			sensors_wrapper_data(&sd);
-			break;
-
-		default:
-			ALOGE("%s: unknown event type 0x%X\n",
-				__func__, e->type);
-			break;
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read error from fd %d, errno %d",
+				      __func__, fd, -n);
 
-exit:
 	return NULL;
 }
 
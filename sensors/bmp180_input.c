@@ -42,6 +42,7 @@ struct sensor_desc {
 	struct sensors_sysfs_t sysfs;
 	struct sensor_t sensor;
 	struct sensor_api_t api;
+	struct input_reader_t reader;
 	float current_data[2];
 	int64_t delay;
 };
@@ -79,7 +80,10 @@ static int bmp180_input_init(struct sensor_api_t *s)
 	close(fd);
 
 	sensors_sysfs_init(&d->sysfs, BMP180_INPUT_NAME, SYSFS_TYPE_INPUT_DEV);
-	sensors_select_init(&d->select_worker, bmp180_input_read, s, -1);
+	if (sensors_select_init(&d->select_worker, bmp180_input_read,
+					s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -98,6 +102,7 @@ static int bmp180_input_activate(struct sensor_api_t *s, int enable)
 				__func__, BMP180_INPUT_NAME, strerror(errno));
 			return -1;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -129,57 +134,58 @@ static void *bmp180_input_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event event[3];
-	int bytes, i, fd;
+	struct input_event *event;
+	int n, i, fd;
 	sensors_event_t data;
 
 	fd = d->select_worker.get_fd(&d->select_worker);
 
-	bytes = read(fd, event, sizeof(event));
-
-	if (bytes < 0) {
-		ALOGE("%s: read failed, error: %d\n", __func__, bytes);
-		goto exit;
-	}
-
-	for (i = 0; i < (bytes / (int)sizeof(struct input_event)); i++) {
-		switch (event[i].type) {
-		case EV_ABS:
-			switch (event[i].code) {
-			case ABS_PRESSURE:
-				/* convert to hPa (millibar) */
-				d->current_data[0] = (float)event[i].value/100;
+	while ((n = input_reader_frame(&d->reader, fd, &event)) > 0) {
+		for (i = 0; i < n; i++) {
+			switch (event[i].type) {
+			case EV_ABS:
+				switch (event[i].code) {
+				case ABS_PRESSURE:
+					/* convert to hPa (millibar) */
+					d->current_data[0] = (float)event[i].value/100;
+					break;
+
+				case ABS_MISC:
+					/* convert to degree celsius */
+					d->current_data[1] = (float)event[i].value/10;
+					break;
+
+				default:
+					DASH_LOGE_RATELIMITED(
+						"%s: unknown event code 0x%X",
+						__func__, event[i].code);
+					break;
+				}
 				break;
 
-			case ABS_MISC:
-				/* convert to degree celsius */
-				d->current_data[1] = (float)event[i].value/10;
+			case EV_SYN:
+				/* report pressure */
+				data.pressure = d->current_data[0];
+				data.version = bmp180_pressure_input.sensor.version;
+				data.sensor = bmp180_pressure_input.sensor.handle;
+				data.type = bmp180_pressure_input.sensor.type;
+				data.timestamp = input_reader_time(&d->reader,
+								    &event[i]);
+				sensors_fifo_put(&data);
 				break;
 
 			default:
-				ALOGE("%s: unknown event code 0x%X\n",
-					__func__, event[i].code);
+				DASH_LOGE_RATELIMITED(
+					"%s: unknown event type 0x%X",
+					__func__, event[i].type);
 				break;
 			}
-			break;
-
-		case EV_SYN:
-			/* report pressure */
-			data.pressure = d->current_data[0];
-			data.version = bmp180_pressure_input.sensor.version;
-			data.sensor = bmp180_pressure_input.sensor.handle;
-			data.type = bmp180_pressure_input.sensor.type;
-			data.timestamp = get_current_nano_time();
-			sensors_fifo_put(&data);
-			break;
-
-		default:
-			ALOGE("%s: unknown event type 0x%X\n",
-				__func__, event[i].type);
-			break;
 		}
 	}
-exit:
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read failed, error: %d",
+				      __func__, n);
+
 	return NULL;
 }
 
@@ -71,6 +71,7 @@ static int light_init(struct sensor_api_t *s)
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
 
 	sensors_worker_init(&d->worker, light_poll, d);
+	d->worker.handle = d->sensor.handle;
 	return 0;
 }
 
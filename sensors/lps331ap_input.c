@@ -44,6 +44,7 @@ struct sensor_desc {
 	struct sensors_sysfs_t sysfs;
 	struct sensor_t sensor;
 	struct sensor_api_t api;
+	struct input_reader_t reader;
 	long current_data[2];
 	int64_t delay;
 	long mem[NR_SAMPLES];
@@ -82,7 +83,10 @@ static int lps331ap_input_init(struct sensor_api_t *s)
 	close(fd);
 
 	sensors_sysfs_init(&d->sysfs, LPS331AP_PRS_DEV_NAME, SYSFS_TYPE_INPUT_DEV);
-	sensors_select_init(&d->select_worker, lps331ap_input_read, s, -1);
+	if (sensors_select_init(&d->select_worker, lps331ap_input_read,
+					s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -105,6 +109,7 @@ static int lps331ap_input_activate(struct sensor_api_t *s, int enable)
 		d->current_sample = 0;
 		d->num_samples = 0;
 		d->current_data[0] = 0;
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -135,59 +140,59 @@ static void *lps331ap_input_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event event[3];
-	int bytes, i, fd;
+	struct input_event *event;
+	int n, i, fd;
 	sensors_event_t data;
 	long pressure;
 
 	fd = d->select_worker.get_fd(&d->select_worker);
 
-	bytes = read(fd, event, sizeof(event));
-
-	if (bytes < 0) {
-		ALOGE("%s: read failed, error: %d\n", __func__, bytes);
-		return NULL;
-	}
+	while ((n = input_reader_frame(&d->reader, fd, &event)) > 0) {
+		for (i = 0; i < n; i++) {
+			switch (event[i].type) {
+			case EV_ABS:
+				switch (event[i].code) {
+				case ABS_PRESSURE:
+					/* convert to hPa (millibar) */
+					if (d->num_samples == NR_SAMPLES)
+						d->current_data[0] -=
+							d->mem[d->current_sample];
+					else
+						d->num_samples++;
+
+					d->mem[d->current_sample++] = event[i].value;
+					d->current_data[0] += event[i].value;
+					d->current_sample %= NR_SAMPLES;
+					break;
+				default:
+					break;
+				}
+				break;
 
-	for (i = 0; i < (bytes / (int)sizeof(struct input_event)); i++) {
-		switch (event[i].type) {
-		case EV_ABS:
-			switch (event[i].code) {
-			case ABS_PRESSURE:
-				/* convert to hPa (millibar) */
-				if (d->num_samples == NR_SAMPLES)
-					d->current_data[0] -=
-						d->mem[d->current_sample];
-				else
-					d->num_samples++;
-
-				d->mem[d->current_sample++] = event[i].value;
-				d->current_data[0] += event[i].value;
-				d->current_sample %= NR_SAMPLES;
+			case EV_SYN:
+				/* report pressure */
+				pressure = d->current_data[0] / d->num_samples;
+				data.pressure = pressure / ROW_TO_MBAR_SCALE;
+				ALOGD_IF(DEBUG_VERBOSE, "lps331ap: %f", data.pressure);
+				data.version = lps331ap_pressure_input.sensor.version;
+				data.sensor = lps331ap_pressure_input.sensor.handle;
+				data.type = lps331ap_pressure_input.sensor.type;
+				data.timestamp = input_reader_time(&d->reader,
+								    &event[i]);
+				sensors_fifo_put(&data);
 				break;
+
 			default:
+				DASH_LOGE_RATELIMITED(
+					"%s: unknown event type 0x%X",
+					__func__, event[i].type);
 				break;
 			}
-			break;
-
-		case EV_SYN:
-			/* report pressure */
-			pressure = d->current_data[0] / d->num_samples;
-			data.pressure = pressure / ROW_TO_MBAR_SCALE;
-			ALOGD_IF(DEBUG_VERBOSE, "lps331ap: %f", data.pressure);
-			data.version = lps331ap_pressure_input.sensor.version;
-			data.sensor = lps331ap_pressure_input.sensor.handle;
-			data.type = lps331ap_pressure_input.sensor.type;
-			data.timestamp = get_current_nano_time();
-			sensors_fifo_put(&data);
-			break;
-
-		default:
-			ALOGE("%s: unknown event type 0x%X\n",
-				__func__, event[i].type);
-			break;
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read failed, error: %d",
+				      __func__, n);
 
 	return NULL;
 }
@@ -32,6 +32,7 @@
 #include "sensor_util.h"
 #include "sensors_id.h"
 #include "sensors_config.h"
+#include "sensors_sysfs.h"
 #include "lsm303dlh.h"
 #include "sensors_compass_API.h"
 
@@ -39,9 +40,11 @@
 #define DELAY_LOWEST_MS 1000
 #define DEBUG_VERBOSE 0
 #define PHYS_PATH_BASE "/sys/bus/i2c/devices"
-#define PHYS_PATH_LEN  (sizeof(PHYS_PATH_BASE) + sizeof("/0-0000/"))
+#define PHYS_PATH_LEN  (CONFIG_ROOT_MAX + sizeof(PHYS_PATH_BASE) + \
+			sizeof("/0-0000/"))
 #define ATTR_NAME_LEN  32
-#define DEV_PATH_LEN  sizeof("/dev/input/event/4294967295")
+#define DEV_PATH_LEN  (CONFIG_ROOT_MAX + \
+		       sizeof("/dev/input/event/4294967295"))
 
 
 enum android_rates {
@@ -81,11 +84,13 @@ struct sensor_desc {
 	struct sensor_t sensor;
 	struct sensor_api_t api;
 	struct sensors_select_t select_worker;
+	struct input_reader_t reader;
 	int status;
 	int data[3];
 	char *map_prefix;
 	int map[3];
 	int sign[3];
+	struct sensor_transform_t transform;
 	enum user_type users;
 	int64_t internal_delay;
 	int64_t external_delay;
@@ -96,6 +101,7 @@ struct sensor_desc {
 	char *input_name;
 	char dev_path[DEV_PATH_LEN];
 	char phys_path[PHYS_PATH_LEN + ATTR_NAME_LEN];
+	struct sensors_sysfs_t sysfs;
 	char *dev_name;
 	char *dev_attr_rate_ms;
 	char *dev_attr_range_mg;
@@ -168,34 +174,17 @@ static int store_str_attr(struct sensor_desc *d, const char *attr,
 			const char *val)
 {
 	int rc;
-	int fd;
-	unsigned l = strlen(d->phys_path);
 
 	if (!*d->phys_path)
 		return 0;
 
-	rc = snprintf(d->phys_path + l, sizeof(d->phys_path) - l, "%s", attr);
-	if ((unsigned)rc >= sizeof(d->phys_path) - l) {
-		ALOGE("%s: Attr path truncated to '%s'\n", __func__,
-				d->phys_path);
-		rc = -1;
-		goto exit;
-	}
-	fd = open(d->phys_path, O_WRONLY);
-	ALOGD("%s: '%s' = %s", __func__, d->phys_path, val);
-	if (fd < 0) {
-		ALOGE("%s: unable to open %s, err %d\n", __func__,
-				d->phys_path, errno);
-		rc = -1;
-		goto exit;
-	}
-	rc = write(fd, val, strlen(val));
+	ALOGD("%s: '%s%s' = %s", __func__, d->phys_path, attr, val);
+	/* unchanged values are skipped by sensors_sysfs */
+	rc = d->sysfs.write(&d->sysfs, attr, val, strlen(val));
 	if (rc < 0)
-		ALOGE("%s: unable to write %s (fd %d), err %d\n", __func__,
-				d->phys_path, fd, errno);
-	close(fd);
-exit:
-	d->phys_path[l] = 0;
+		ALOGE("%s: unable to write %s%s, err %d\n", __func__,
+				d->phys_path, attr, -rc);
+
 	return rc > 0 ? 0 : rc;
 }
 
@@ -207,13 +196,10 @@ static int store_int_attr(struct sensor_desc *d, const char *attr, int value)
 	return store_str_attr(d, attr, b);
 }
 
+/* data is already mapped for the compass library, only scale it */
 static void scale_data(struct sensors_event_t *s, struct sensor_desc *d)
 {
-	unsigned i;
-	float scale = d->scale;
-
-	for (i = 0; i < ARRAY_SIZE(s->data); i++)
-		s->data[i] = d->data[i] * scale;
+	sensor_transform_apply(&d->transform, d->data, s->data, 1);
 }
 
 static int compass_status(int accuracy)
@@ -300,7 +286,7 @@ static int open_input_device(struct sensor_desc *d)
 		ALOGD("%s: No input device for %s", __func__, d->sensor.name);
 		return -1;
 	}
-	rc = open(d->dev_path, O_RDONLY | O_NONBLOCK);
+	rc = open_input_dev(d->dev_path, O_RDONLY | O_NONBLOCK);
 	if (rc < 0) {
 		ALOGE("%s: Failed to open '%s' but access (R_OK) got",
 					__func__, d->dev_path);
@@ -313,6 +299,7 @@ static int sensor_init(struct sensor_api_t *s_api)
 {
 	struct sensor_desc *d = container_of(s_api, struct sensor_desc, api);
 	int rc;
+	int i;
 
 	rc = dev_phys_path_by_attr("name", d->dev_name, PHYS_PATH_BASE,
 			d->phys_path, sizeof(d->phys_path));
@@ -320,10 +307,18 @@ static int sensor_init(struct sensor_api_t *s_api)
 		ALOGE("%s: no phys dev path for dev name '%s'", __func__,
 					d->dev_name);
 		*d->phys_path = 0;
+	} else {
+		sensors_sysfs_init(&d->sysfs, d->phys_path,
+				   SYSFS_TYPE_ABS_PATH);
 	}
 
 	config_read_sensor_map(d);
-	sensors_select_init(&d->select_worker, d->read, d, -1);
+	sensor_transform_init(&d->transform);
+	for (i = 0; i < NUM_AXIS; i++)
+		sensor_transform_set(&d->transform, i, i, d->scale);
+	if (sensors_select_init(&d->select_worker, d->read, d, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -365,7 +360,9 @@ static int compass_sensor_init(struct sensor_api_t *s_api)
 	compass_api_init(d, fd);
 	if (fd >= 0)
 		close(fd);
-	sensors_select_init(&d->select_worker, d->read, d, -1);
+	if (sensors_select_init(&d->select_worker, d->read, d, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -482,6 +479,7 @@ static int sensor_activate_local(struct sensor_desc *d, int enable,
 		fd = open_input_device(d);
 		if (fd < 0)
 			return -1;
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && fd > 0 && !d->users) {
@@ -552,6 +550,7 @@ static int compass_sensor_activate(struct sensor_api_t *s, int enable)
 			fd = open_input_device(d);
 		rc = activate_required_sensors(1);
 		if (!rc) {
+			input_reader_set_fd(&d->reader, fd);
 			d->select_worker.set_fd(&d->select_worker, fd);
 			d->select_worker.resume(&d->select_worker);
 			goto exit;
@@ -572,10 +571,9 @@ exit:
 	return rc;
 }
 
-#define MAX_EVENTS 4 /* X, Y, Z, SYN */
 static void *sensor_read(void *arg)
 {
-	struct input_event events[MAX_EVENTS];
+	struct input_event *events;
 	struct input_event *e;
 	int i;
 	int n;
@@ -584,95 +582,93 @@ static void *sensor_read(void *arg)
 	struct sensor_desc *p = arg;
 	int fd = p->select_worker.get_fd(&p->select_worker);
 
-	t = get_current_nano_time();
-
 	if (fd < 0)
 		return 0;
 
-	n = read(fd, events, sizeof(events)) / sizeof(events[0]);
-	if (n < 0) {
-		ALOGE("%s: read error from fd %d, sensor '%s'", __func__,
-			fd, p->sensor.name);
-		return 0;
-	}
-
 	pthread_mutex_lock(&lock);
-	for (i = 0; i < n; i++) {
-		e = events + i;
-		if (e->type == EV_SW && e->code == SW_LID) {
-			compass_formation(e->value);
-			continue;
-		}
-
-		if (e->type == EV_SYN &&
-				p->sensor.type != SENSOR_TYPE_ORIENTATION) {
-
-			ALOGD_IF(DEBUG_VERBOSE, "%s(%s):%9lld %6d %6d %6d",
-					__func__,
-					p->sensor.name,
-					t,
-					p->data[0],
-					p->data[1],
-					p->data[2]);
-
-			if (p->users & USER_EXTERNAL) {
-				memset(&sdata, 0, sizeof(sdata));
-				scale_data(&sdata, p);
-				sdata.sensor = p->sensor.handle;
-				sdata.orientation.status = SENSOR_STATUS_ACCURACY_MEDIUM;
-				sdata.version = p->sensor.version;
-				sdata.timestamp = t;
-				sensors_fifo_put(&sdata);
+	while ((n = input_reader_frame(&p->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			if (e->type == EV_SW && e->code == SW_LID) {
+				compass_formation(e->value);
+				continue;
 			}
 
-			if (sensor_compass &&
-				sensor_compass->users & USER_EXTERNAL &&
-				p->sensor.type == SENSOR_TYPE_MAGNETIC_FIELD) {
-
-				int accuracy;
-
-				memset(&sdata, 0, sizeof(sdata));
-				accuracy = compass_run(&sdata);
-				if (accuracy < 0)
-					continue;
-				sdata.orientation.status = compass_status(accuracy);
-				sdata.timestamp = t;
-				sdata.sensor = sensor_compass->sensor.handle;
-				sdata.version = sensor_compass->sensor.version;
-				sdata.type = sensor_compass->sensor.type;
-				sensors_fifo_put(&sdata);
-				ALOGD_IF(DEBUG_VERBOSE,
-					"%s(%s):%9lld a=%3.0f, p=%4.1f, r=%4.1f, "
-					"status=%d (accuracy=%d)",
-					__func__,
-					sensor_compass->sensor.name,
-					t,
-					sdata.orientation.azimuth,
-					sdata.orientation.pitch,
-					sdata.orientation.roll,
-					sdata.orientation.status,
-					accuracy);
+			if (e->type == EV_SYN &&
+					p->sensor.type != SENSOR_TYPE_ORIENTATION) {
+				t = input_reader_time(&p->reader, e);
+
+				ALOGD_IF(DEBUG_VERBOSE, "%s(%s):%9lld %6d %6d %6d",
+						__func__,
+						p->sensor.name,
+						t,
+						p->data[0],
+						p->data[1],
+						p->data[2]);
+
+				if (p->users & USER_EXTERNAL) {
+					memset(&sdata, 0, sizeof(sdata));
+					scale_data(&sdata, p);
+					sdata.sensor = p->sensor.handle;
+					sdata.orientation.status = SENSOR_STATUS_ACCURACY_MEDIUM;
+					sdata.version = p->sensor.version;
+					sdata.timestamp = t;
+					sensors_fifo_put(&sdata);
+				}
+
+				if (sensor_compass &&
+					sensor_compass->users & USER_EXTERNAL &&
+					p->sensor.type == SENSOR_TYPE_MAGNETIC_FIELD) {
+
+					int accuracy;
+
+					memset(&sdata, 0, sizeof(sdata));
+					accuracy = compass_run(&sdata);
+					if (accuracy < 0)
+						continue;
+					sdata.orientation.status = compass_status(accuracy);
+					sdata.timestamp = t;
+					sdata.sensor = sensor_compass->sensor.handle;
+					sdata.version = sensor_compass->sensor.version;
+					sdata.type = sensor_compass->sensor.type;
+					sensors_fifo_put(&sdata);
+					ALOGD_IF(DEBUG_VERBOSE,
+						"%s(%s):%9lld a=%3.0f, p=%4.1f, r=%4.1f, "
+						"status=%d (accuracy=%d)",
+						__func__,
+						sensor_compass->sensor.name,
+						t,
+						sdata.orientation.azimuth,
+						sdata.orientation.pitch,
+						sdata.orientation.roll,
+						sdata.orientation.status,
+						accuracy);
+				}
+				continue;
 			}
-			continue;
-		}
 
-		if (e->type != EV_ABS)
-			continue;
-
-		switch (e->code) {
-		case ABS_X:
-			p->data[p->map[0]] = e->value * p->sign[0];
-			break;
-		case ABS_Y:
-			p->data[p->map[1]] = e->value * p->sign[1];
-			break;
-		case ABS_Z:
-			p->data[p->map[2]] = e->value * p->sign[2];
-			break;
+			if (e->type != EV_ABS)
+				continue;
+
+			switch (e->code) {
+			case ABS_X:
+				p->data[p->map[0]] = e->value * p->sign[0];
+				break;
+			case ABS_Y:
+				p->data[p->map[1]] = e->value * p->sign[1];
+				break;
+			case ABS_Z:
+				p->data[p->map[2]] = e->value * p->sign[2];
+				break;
+			}
 		}
 	}
 	pthread_mutex_unlock(&lock);
 
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read error from fd %d, sensor '%s'",
+				      __func__, fd, p->sensor.name);
+
 	return NULL;
 }
 
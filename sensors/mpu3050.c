@@ -135,8 +135,11 @@ static int mpu3050_init(struct sensor_api_t *s_api)
 	handle = d->sensor.handle;
 
 	if (!sc->mpu_initialized) {
+		if (sensors_select_init(&sc->select_worker, mpu3050_read, sc,
+					-1) < 0)
+			return -1;
 		sc->mpu_initialized = 1;
-		sensors_select_init(&sc->select_worker, mpu3050_read, sc, -1);
+		sc->select_worker.handle = handle;
 		the_object = new_object();
 		numSensors = get_numSensors(the_object);
 	}
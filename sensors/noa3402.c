@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <linux/input.h>
 #include <errno.h>
+#include <limits.h>
 #include "sensors_list.h"
 #include "sensors_fifo.h"
 #include "sensors_select.h"
@@ -40,6 +41,7 @@ struct sensor_desc {
 	struct sensors_select_t select_worker;
 	struct sensor_t sensor;
 	struct sensor_api_t api;
+	struct input_reader_t reader;
 	float distance;
 };
 
@@ -62,7 +64,7 @@ static struct sensor_desc noa3402 = {
 	}
 };
 
-static void noa3402_report_distance(float distance)
+static void noa3402_report_distance(float distance, int64_t timestamp)
 {
 	sensors_event_t data;
 
@@ -71,17 +73,19 @@ static void noa3402_report_distance(float distance)
 	data.version = noa3402.sensor.version;
 	data.sensor = noa3402.sensor.handle;
 	data.type = noa3402.sensor.type;
-	data.timestamp = get_current_nano_time();
+	data.timestamp = timestamp;
 	sensors_fifo_put(&data);
 }
 
 static int noa3402_get_current_distance(float *current_distance)
 {
 	int ret = 0;
-	int fd;
+	int fd = -1;
 	char result;
+	char path[PATH_MAX];
 
-	fd = open(PROXIMITY_PATH, O_RDONLY);
+	if (!dev_root_path(PROXIMITY_PATH, path, sizeof(path)))
+		fd = open(path, O_RDONLY);
 	if (fd < 0) {
 		ALOGE("%s: Failed to open %s\n", __func__, PROXIMITY_PATH);
 		ret = -ENODEV;
@@ -112,7 +116,9 @@ static int noa3402_init(struct sensor_api_t *s)
 	}
 	close(fd);
 
-	sensors_select_init(&d->select_worker, noa3402_read, s, -1);
+	if (sensors_select_init(&d->select_worker, noa3402_read, s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 	return 0;
 }
 
@@ -130,10 +136,12 @@ static int noa3402_activate(struct sensor_api_t *s, int enable)
 				NOA3402_NAME);
 			return fd;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 		if (!noa3402_get_current_distance(&current_distance))
-			noa3402_report_distance(current_distance);
+			noa3402_report_distance(current_distance,
+						get_current_nano_time());
 	} else if (!enable && (fd > 0)) {
 		d->select_worker.set_fd(&d->select_worker, -1);
 		d->select_worker.suspend(&d->select_worker);
@@ -159,34 +167,38 @@ static void *noa3402_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	int bytes, i;
-	struct input_event event[2];
+	int n, i;
+	struct input_event *event;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 
-	bytes = read(fd, event, sizeof(event));
-	if (bytes < 0) {
-		ALOGE("%s: read failed, error: %d\n", __func__, bytes);
-		return NULL;
-	}
-
-	for (i = 0; i < (bytes / (int)sizeof(struct input_event)); i++) {
-		switch (event[i].type) {
-		case EV_ABS:
-			if (event[i].code == ABS_DISTANCE)
-				d->distance = event[i].value ? 1.0 : 0.0;
-			else
-				ALOGE("%s: unknown event code 0x%X\n",
+	while ((n = input_reader_frame(&d->reader, fd, &event)) > 0) {
+		for (i = 0; i < n; i++) {
+			switch (event[i].type) {
+			case EV_ABS:
+				if (event[i].code == ABS_DISTANCE)
+					d->distance = event[i].value ? 1.0 : 0.0;
+				else
+					DASH_LOGE_RATELIMITED(
+						"%s: unknown event code 0x%X",
 						__func__, event[i].code);
-			break;
-		case EV_SYN:
-			noa3402_report_distance(d->distance);
-			break;
-		default:
-			ALOGE("%s: unknown event type 0x%X\n",
-						__func__, event[i].type);
-			break;
+				break;
+			case EV_SYN:
+				noa3402_report_distance(d->distance,
+					input_reader_time(&d->reader,
+							  &event[i]));
+				break;
+			default:
+				DASH_LOGE_RATELIMITED(
+					"%s: unknown event type 0x%X",
+					__func__, event[i].type);
+				break;
+			}
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read failed, error: %d",
+				      __func__, n);
+
 	return NULL;
 }
 
@@ -23,12 +23,31 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
 #include <linux/input.h>
 #include "sensor_util.h"
 #include <dirent.h>
 #include <ctype.h>
 #include "sensors_log.h"
 #include "sensors_input_cache.h"
+#include "sensors_metrics.h"
+#include "sensors_trace.h"
+#include "sensors_tracepoint.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifndef EVIOCSCLOCKID
+#define EVIOCSCLOCKID _IOW('E', 0xa0, int)
+#endif
+
+/* whether events on an fd opened by open_input_dev() carry boottime */
+#define INPUT_CLOCK_FDS 1024
+static uint8_t input_boottime[INPUT_CLOCK_FDS];
 
 #define NSEC_PER_SEC 1000000000L
 static int64_t timespec_to_ns(const struct timespec *ts)
@@ -61,46 +80,347 @@ void sensors_usleep(int us)
 
 int input_dev_path_by_name(char *name, char *path, int path_max)
 {
-	const struct sensors_input_cache_entry_t *input;
+	struct sensors_input_cache_entry_t input;
+	const char *replay = sensors_trace_get_input(name);
 
-	input = sensors_input_cache_get(name);
-	if (!input)
+	if (replay) {
+		strlcpy(path, replay, path_max);
+		return 0;
+	}
+
+	if (sensors_input_cache_get(name, &input) < 0)
 		return -1;
 
-	strlcpy(path, input->event_path, path_max);
+	strlcpy(path, input.event_path, path_max);
 
 	return 0;
 }
 
+/*
+ * Have the kernel stamp events with the clock the framework runs on. This
+ * is done before the fd is read from, the switch flushes what is queued.
+ * Replayed inputs are already stamped with boottime by the replayer.
+ */
+static void input_dev_set_clock(int fd, const char *path)
+{
+	int clk = CLOCK_BOOTTIME;
+	uint8_t boottime = 1;
+
+	if (fd >= INPUT_CLOCK_FDS)
+		return;
+
+	if (!sensors_trace_is_input(path) &&
+	    ioctl(fd, EVIOCSCLOCKID, &clk) < 0) {
+		ALOGW("%s: %s can't use CLOCK_BOOTTIME, stamping at read: %s",
+		      __func__, path, strerror(errno));
+		boottime = 0;
+	}
+	__atomic_store_n(&input_boottime[fd], boottime, __ATOMIC_RELAXED);
+}
+
+int open_input_dev(const char *path, int flags)
+{
+	int fd = open(path, flags);
+
+	if (fd >= 0)
+		input_dev_set_clock(fd, path);
+
+	return fd;
+}
+
 int open_input_dev_by_name(char *name, int flags)
 {
-	const struct sensors_input_cache_entry_t *input;
+	char path[PATH_MAX];
 
-	input = sensors_input_cache_get(name);
-	if (!input)
+	if (input_dev_path_by_name(name, path, sizeof(path)) < 0)
 		return -1;
 
-	return open(input->event_path, flags);
+	return open_input_dev(path, flags);
+}
+
+void input_reader_init(struct input_reader_t *r)
+{
+	r->fd = -1;
+	r->start = 0;
+	r->scan = 0;
+	r->end = 0;
+	r->drained = 0;
+	r->boottime = 0;
+	r->trace = -1;
+}
+
+/*
+ * Starts reading a newly opened fd. This has to be called each time the
+ * driver installs an fd, even one with a number seen before, so a stale
+ * partial frame isn't stitched onto the new device's events.
+ */
+void input_reader_set_fd(struct input_reader_t *r, int fd)
+{
+	input_reader_init(r);
+	r->fd = fd;
+	r->boottime = fd >= 0 && fd < INPUT_CLOCK_FDS &&
+		__atomic_load_n(&input_boottime[fd], __ATOMIC_RELAXED);
+	r->trace = fd >= 0 ? sensors_trace_device(fd) : -1;
+}
+
+/*
+ * Returns the number of events in the next complete frame and points
+ * frame at it, 0 when everything pending on fd has been consumed, or a
+ * negative errno. The frame stays valid until the next call. A partial
+ * frame is kept until the rest of it has been read.
+ */
+int input_reader_frame(struct input_reader_t *r, int fd,
+		       struct input_event **frame)
+{
+	int i, n;
+
+	while (1) {
+		for (i = r->scan; i < r->end; i++) {
+			if (r->buf[i].type == EV_SYN &&
+			    r->buf[i].code == SYN_REPORT) {
+				*frame = &r->buf[r->start];
+				n = i + 1 - r->start;
+				r->start = r->scan = i + 1;
+				TRACEPOINT(TP_READ, -1,
+					   input_reader_time(r, &r->buf[i]), n);
+				return n;
+			}
+		}
+
+		if (r->start) {
+			memmove(r->buf, r->buf + r->start,
+				(r->end - r->start) * sizeof(r->buf[0]));
+			r->end -= r->start;
+			r->start = 0;
+		}
+		r->scan = r->end;
+
+		/* a frame which doesn't fit is handed out in pieces */
+		if (r->end == INPUT_READER_LEN) {
+			*frame = r->buf;
+			r->start = r->scan = r->end = 0;
+			return INPUT_READER_LEN;
+		}
+
+		/* a short read means the device queue is empty */
+		if (r->drained) {
+			r->drained = 0;
+			return 0;
+		}
+
+		n = read(fd, r->buf + r->end,
+			 (INPUT_READER_LEN - r->end) * sizeof(r->buf[0]));
+		if (n < 0) {
+			if (errno == EAGAIN)
+				return 0;
+			return -errno;
+		} else if (n == 0) {
+			return -ENODEV;
+		}
+
+		if (n < (int)((INPUT_READER_LEN - r->end) * sizeof(r->buf[0])))
+			r->drained = 1;
+		if (r->trace >= 0)
+			sensors_trace_input(r->trace, r->boottime,
+					    r->buf + r->end,
+					    n / sizeof(r->buf[0]));
+		sensors_metrics_pending(METRIC_READS, 1);
+		sensors_metrics_pending(METRIC_EVENTS_READ,
+					n / sizeof(r->buf[0]));
+		r->end += n / sizeof(r->buf[0]);
+	}
+}
+
+/*
+ * Sample time of an event handed out by input_reader_frame(), normally the
+ * SYN_REPORT closing the frame. This is the time the driver reported the
+ * sample, so it doesn't carry the wakeup and scheduling delay of the HAL.
+ */
+int64_t input_reader_time(struct input_reader_t *r,
+			  const struct input_event *e)
+{
+	if (!r->boottime)
+		return get_current_nano_time();
+
+	return (int64_t)e->time.tv_sec * NSEC_PER_SEC +
+		(int64_t)e->time.tv_usec * 1000;
+}
+
+void sensor_transform_init(struct sensor_transform_t *t)
+{
+	memset(t, 0, sizeof(*t));
 }
 
+/* output axis out gets input axis in times value, e.g. sign * scale */
+void sensor_transform_set(struct sensor_transform_t *t, int out, int in,
+			  float value)
+{
+	if (out < 0 || out > 2 || in < 0 || in > 2)
+		return;
+
+	t->col[in][out] = value;
+}
+
+/*
+ * Each sample is the sum of the three columns weighted by its x, y and z,
+ * so a vector unit does a whole sample in three multiplies.
+ */
+#if defined(__SSE2__)
+/* all but the last sample can be loaded with the next one's x in lane 3 */
+static inline __m128 transform_sample(const __m128 *c, const int *in, int n)
+{
+	__m128 s, v;
+
+	if (n > 1)
+		s = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)in));
+	else
+		s = _mm_setr_ps((float)in[0], (float)in[1], (float)in[2], 0);
+
+	v = _mm_mul_ps(c[0], _mm_shuffle_ps(s, s, 0x00));
+	v = _mm_add_ps(v, _mm_mul_ps(c[1], _mm_shuffle_ps(s, s, 0x55)));
+	return _mm_add_ps(v, _mm_mul_ps(c[2], _mm_shuffle_ps(s, s, 0xaa)));
+}
+
+void sensor_transform_apply(const struct sensor_transform_t *t,
+			    const int *in, float *out, int n)
+{
+	__m128 c[3];
+	__m128 v;
+
+	c[0] = _mm_load_ps(t->col[0]);
+	c[1] = _mm_load_ps(t->col[1]);
+	c[2] = _mm_load_ps(t->col[2]);
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		v = transform_sample(c, in, n);
+		_mm_storel_pi((__m64 *)out, v);
+		_mm_store_ss(out + 2, _mm_movehl_ps(v, v));
+	}
+}
+
+void sensor_transform_apply_int(const struct sensor_transform_t *t,
+				const int *in, int *out, int n)
+{
+	const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 c[3];
+	__m128 v;
+	__m128i r;
+
+	c[0] = _mm_load_ps(t->col[0]);
+	c[1] = _mm_load_ps(t->col[1]);
+	c[2] = _mm_load_ps(t->col[2]);
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		v = transform_sample(c, in, n);
+		/* round half away from zero */
+		v = _mm_add_ps(v, _mm_or_ps(_mm_and_ps(v, sign), half));
+		r = _mm_cvttps_epi32(v);
+		_mm_storel_epi64((__m128i *)out, r);
+		out[2] = _mm_cvtsi128_si32(_mm_shuffle_epi32(r, 2));
+	}
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+static inline float32x4_t transform_sample(const float32x4_t *c,
+					   const int *in)
+{
+	float32x4_t v;
+
+	v = vmulq_n_f32(c[0], (float)in[0]);
+	v = vmlaq_n_f32(v, c[1], (float)in[1]);
+	return vmlaq_n_f32(v, c[2], (float)in[2]);
+}
+
+void sensor_transform_apply(const struct sensor_transform_t *t,
+			    const int *in, float *out, int n)
+{
+	float32x4_t c[3];
+	float32x4_t v;
+
+	c[0] = vld1q_f32(t->col[0]);
+	c[1] = vld1q_f32(t->col[1]);
+	c[2] = vld1q_f32(t->col[2]);
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		v = transform_sample(c, in);
+		vst1_f32(out, vget_low_f32(v));
+		vst1q_lane_f32(out + 2, v, 2);
+	}
+}
+
+void sensor_transform_apply_int(const struct sensor_transform_t *t,
+				const int *in, int *out, int n)
+{
+	const uint32x4_t sign = vdupq_n_u32(0x80000000);
+	const uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+	float32x4_t c[3];
+	float32x4_t v;
+	int32x4_t r;
+
+	c[0] = vld1q_f32(t->col[0]);
+	c[1] = vld1q_f32(t->col[1]);
+	c[2] = vld1q_f32(t->col[2]);
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		v = transform_sample(c, in);
+		/* round half away from zero */
+		v = vaddq_f32(v, vreinterpretq_f32_u32(vorrq_u32(
+			vandq_u32(vreinterpretq_u32_f32(v), sign), half)));
+		r = vcvtq_s32_f32(v);
+		vst1_s32(out, vget_low_s32(r));
+		vst1q_lane_s32(out + 2, r, 2);
+	}
+}
+#else
+void sensor_transform_apply(const struct sensor_transform_t *t,
+			    const int *in, float *out, int n)
+{
+	int i;
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		for (i = 0; i < 3; i++)
+			out[i] = t->col[0][i] * in[0] + t->col[1][i] * in[1] +
+				t->col[2][i] * in[2];
+	}
+}
+
+void sensor_transform_apply_int(const struct sensor_transform_t *t,
+				const int *in, int *out, int n)
+{
+	float v;
+	int i;
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		for (i = 0; i < 3; i++) {
+			v = t->col[0][i] * in[0] + t->col[1][i] * in[1] +
+				t->col[2][i] * in[2];
+			out[i] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+		}
+	}
+}
+#endif
+
 #define test_bit(bit, array)    (array[(bit) / 8] & (1 << ((bit) % 8)))
 #define bit_array_size(bit)     (((bit) + 7) / 8)
 int input_dev_path_by_keycode(int type, int code, char *path, int path_max)
 {
 	uint8_t bits[bit_array_size(KEY_MAX + 1)];
+	char dir_path[CONFIG_ROOT_MAX + sizeof(INPUT_EVENT_DIR)];
 	int rc;
 	int fd;
 	DIR * dir;
 	struct dirent * item;
 
-	dir = opendir(INPUT_EVENT_DIR);
+	snprintf(dir_path, sizeof(dir_path), "%s%s", sensors_config_get_root(),
+		 INPUT_EVENT_DIR);
+	dir = opendir(dir_path);
 	while (NULL != dir && NULL != (item = readdir(dir))) {
 		if (0 != strncmp(item->d_name, INPUT_EVENT_BASENAME,
 				sizeof(INPUT_EVENT_BASENAME) - 1)) {
 			continue;
 		}
 
-		snprintf(path, path_max, "%s%s", INPUT_EVENT_DIR, item->d_name);
+		snprintf(path, path_max, "%s%s", dir_path, item->d_name);
 		fd = open(path, O_RDONLY);
 		if (fd < 0) {
 			continue;
@@ -121,10 +441,25 @@ int input_dev_path_by_keycode(int type, int code, char *path, int path_max)
 	return -1;
 }
 
+int dev_root_path(const char *abs_path, char *path, int path_max)
+{
+	int rc;
+
+	rc = snprintf(path, path_max, "%s%s", sensors_config_get_root(),
+		      abs_path);
+	if (rc < 0 || rc >= path_max) {
+		ALOGE("%s: path too long for '%s'", __func__, abs_path);
+		return -1;
+	}
+
+	return 0;
+}
+
 int dev_phys_path_by_attr(const char *attr, const char *attr_val,
 			const char *base, char *path, int path_max)
 {
 	char aval[32];
+	char dir_path[PATH_MAX];
 	int rc;
 	int notfound = 1;
 	int fd;
@@ -132,6 +467,10 @@ int dev_phys_path_by_attr(const char *attr, const char *attr_val,
 	struct dirent * item;
 	int len = strlen(attr_val);
 
+	/* the path returned includes the root */
+	if (dev_root_path(base, dir_path, sizeof(dir_path)) < 0)
+		return -1;
+	base = dir_path;
 	dir = opendir(base);
 	if (!dir) {
 		ALOGE("Unable to open '%s'", base);
@@ -16,26 +16,82 @@
 
 #ifndef SENSOR_UTIL_H_
 #define SENSOR_UTIL_H_
+#include <stddef.h>
 #include <stdint.h>
+#include <linux/input.h>
 
 #define container_of(ptr, type, member) ({ \
 	const typeof( ((type *)0)->member ) *__mptr = (ptr); \
 	(type *)( (char *)__mptr - offsetof(type,member) ); \
 })
 
+/*
+ * Axis remap, sign and LSB to SI scale of a three axis sensor folded into
+ * one 3x3 matrix, built once at init with sensor_transform_set(). It is
+ * kept by column, each padded to four floats for the vector kernels.
+ *
+ * sensor_transform_apply() maps n raw xyz samples to floats,
+ * sensor_transform_apply_int() rounds the result back to integers for
+ * data which is passed on in LSB.
+ */
 struct sensor_transform_t {
-	int x[3];
-	int y[3];
-	int z[3];
+	float col[3][4] __attribute__((aligned(16)));
+};
+
+void sensor_transform_init(struct sensor_transform_t *t);
+void sensor_transform_set(struct sensor_transform_t *t, int out, int in,
+			  float value);
+void sensor_transform_apply(const struct sensor_transform_t *t,
+			    const int *in, float *out, int n);
+void sensor_transform_apply_int(const struct sensor_transform_t *t,
+				const int *in, int *out, int n);
+
+/*
+ * Buffered reader for input devices. Pending events are drained with as
+ * few read() calls as possible and handed out one SYN_REPORT terminated
+ * frame at a time by input_reader_frame(). A driver passes every fd it
+ * installs to input_reader_set_fd() before the fd is armed.
+ *
+ * Devices opened with open_input_dev() are switched to CLOCK_BOOTTIME so the
+ * kernel time of an event can be used as the sample time, see
+ * input_reader_time(). What is read is also recorded when tracing is on,
+ * see sensors_trace.h.
+ */
+#define INPUT_READER_LEN 64
+
+struct input_reader_t {
+	struct input_event buf[INPUT_READER_LEN];
+	int fd;
+	int start;
+	int scan;
+	int end;
+	int drained;
+	int boottime;
+	int trace;
 };
 
+void input_reader_init(struct input_reader_t *r);
+void input_reader_set_fd(struct input_reader_t *r, int fd);
+int input_reader_frame(struct input_reader_t *r, int fd,
+		       struct input_event **frame);
+int64_t input_reader_time(struct input_reader_t *r,
+			  const struct input_event *e);
+
 void sensors_nsleep(int64_t ns);
 void sensors_usleep(int us);
 int64_t get_current_nano_time();
+int open_input_dev(const char *path, int flags);
 int open_input_dev_by_name(char *name, int flags);
 int input_dev_path_by_name(char *name, char *path, int path_max);
 int input_dev_path_by_keycode(int type, int code, char *path, int path_max);
 int dev_phys_path_by_attr(const char *attr, const char *attr_val,
 			const char *base, char *path, int path_max);
 
+/*
+ * Device paths are looked up below sensors_config_get_root(). The input
+ * and phys lookups above already return such paths, a fixed path has to
+ * be passed through dev_root_path() before it is opened.
+ */
+int dev_root_path(const char *abs_path, char *path, int path_max);
+
 #endif
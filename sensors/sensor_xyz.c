@@ -19,7 +19,6 @@
 #include "sensor_xyz.h"
 
 #define NS_TO_MS 1000000
-#define MAX_EVENTS 4 /* X, Y, Z, SYN */
 
 struct config_record {
 	int max;
@@ -76,40 +75,30 @@ static void config_read_sensor_map(struct sensor_desc *d)
 	config_read_axis(d->map_prefix, "axis_sign", &rec);
 }
 
+/* the data goes to the wrappers in LSB, so only map and sign are applied */
+static void sensor_xyz_transform(struct sensor_desc *d)
+{
+	int i;
+
+	sensor_transform_init(&d->transform);
+	for (i = 0; i < NUM_AXIS; i++)
+		sensor_transform_set(&d->transform, d->map[i], i, d->sign[i]);
+}
+
 static int store_str_attr(struct sensor_desc *d, const char *attr,
 			const char *val)
 {
 	int rc;
-	int fd;
-	unsigned l;
 
 	if (!*d->phys_path)
 		return 0;
 
-	l = strlen(d->phys_path);
-
-	rc = snprintf(d->phys_path + l, sizeof(d->phys_path) - l, "%s", attr);
-	if (((unsigned)rc >= sizeof(d->phys_path) - l) || rc < 0) {
-		ALOGE("%s: Attr path truncated to '%s'\n", __func__,
-				d->phys_path);
-		rc = -1;
-		goto exit;
-	}
-	fd = open(d->phys_path, O_WRONLY);
-	if (fd < 0) {
-		ALOGE("%s: unable to open %s, err %d\n", __func__,
-			d->phys_path, errno);
-		rc = -1;
-		goto exit;
-	}
-	rc = write(fd, val, strlen(val));
+	/* unchanged values are skipped by sensors_sysfs */
+	rc = d->sysfs.write(&d->sysfs, attr, val, strlen(val));
 	if (rc < 0)
-		ALOGE("%s: unable to write %s (fd %d), err %d\n", __func__,
-			d->phys_path, fd, errno);
-	close(fd);
+		ALOGE("%s: unable to write %s%s, err %d\n", __func__,
+			d->phys_path, attr, -rc);
 
-exit:
-	d->phys_path[l] = 0;
 	return rc > 0 ? 0 : rc;
 }
 
@@ -147,13 +136,89 @@ static int open_input_device(struct sensor_desc *d)
 		return -1;
 	}
 open_device:
-	rc = open(d->dev_path, O_RDONLY | O_NONBLOCK);
+	rc = open_input_dev(d->dev_path, O_RDONLY | O_NONBLOCK);
 	if (rc < 0)
 		ALOGE("%s: Failed to open '%s' but got access R_OK",
 					__func__, d->dev_path);
 	return rc;
 }
 
+static enum dev_mode rate2mode(int ms)
+{
+	if (ms < RATE_GAME)
+		return MODE_FASTEST;
+	if (ms < RATE_UI)
+		return MODE_GAME;
+	if (ms < RATE_NORMAL)
+		return MODE_UI;
+
+	return MODE_NORMAL;
+}
+
+/* the mode is only written when it changes, unless forced */
+static int sensor_xyz_store_delay(struct sensor_desc *d, int ms, int force)
+{
+	const char *old, *new;
+	int rc;
+
+	rc = store_int_attr(d, d->dev_attr_rate_ms, ms);
+	if (rc)
+		return rc;
+
+	if (d->dev_attr_mode) {
+		old = d->dev_modes[rate2mode(d->applied_delay_ms)];
+		new = d->dev_modes[rate2mode(ms)];
+		if (force || strcmp(old, new)) {
+			rc = store_str_attr(d, d->dev_attr_mode, new);
+			if (rc)
+				return rc;
+		}
+	}
+	d->applied_delay_ms = ms;
+
+	return 0;
+}
+
+/* called from the reactor when the input device comes or goes */
+static void sensor_xyz_hotplug(void *arg,
+			       const struct sensors_input_cache_entry_t *input,
+			       int present)
+{
+	struct sensor_desc *d = arg;
+	int fd;
+
+	pthread_mutex_lock(&d->lock);
+	fd = d->select_worker.get_fd(&d->select_worker);
+	if (!present) {
+		d->dev_path[0] = 0;
+		if (fd >= 0)
+			d->select_worker.set_fd(&d->select_worker, -1);
+		/* a new device has to be configured from scratch */
+		if (*d->phys_path)
+			d->sysfs.close(&d->sysfs);
+		d->applied_delay_ms = 0;
+		goto exit;
+	}
+
+	/* the new device runs at its power-on rate and mode */
+	if (d->delay_ms)
+		sensor_xyz_store_delay(d, d->delay_ms, 1);
+	else if (d->dev_attr_mode)
+		store_str_attr(d, d->dev_attr_mode, d->dev_modes[MODE_NORMAL]);
+
+	if (d->enabled && fd < 0) {
+		strlcpy(d->dev_path, input->event_path, sizeof(d->dev_path));
+		fd = open_input_device(d);
+		if (fd >= 0) {
+			input_reader_set_fd(&d->reader, fd);
+			d->select_worker.set_fd(&d->select_worker, fd);
+			d->select_worker.resume(&d->select_worker);
+		}
+	}
+exit:
+	pthread_mutex_unlock(&d->lock);
+}
+
 int sensor_xyz_init(struct sensor_api_t *s_api)
 {
 	struct sensor_desc *d = container_of(s_api, struct sensor_desc, api);
@@ -165,8 +230,13 @@ int sensor_xyz_init(struct sensor_api_t *s_api)
 		ALOGE("%s: no phys dev path for dev name '%s'", __func__,
 			d->dev_name);
 		*d->phys_path = 0;
+	} else {
+		sensors_sysfs_init(&d->sysfs, d->phys_path,
+				   SYSFS_TYPE_ABS_PATH);
 	}
 	config_read_sensor_map(d);
+	sensor_xyz_transform(d);
+	pthread_mutex_init(&d->lock, NULL);
 
 	if (d->dev_attr_mode) {
 		rc = store_str_attr(d, d->dev_attr_mode,
@@ -178,7 +248,11 @@ int sensor_xyz_init(struct sensor_api_t *s_api)
 		}
 	}
 
-	sensors_select_init(&d->select_worker, d->read, d, -1);
+	if (sensors_select_init(&d->select_worker, d->read, d, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
+	if (d->input_name)
+		sensors_input_cache_watch(d->input_name, sensor_xyz_hotplug, d);
 
 	return 0;
 }
@@ -188,18 +262,8 @@ void sensor_xyz_close(struct sensor_api_t *s)
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
 
 	d->select_worker.destroy(&d->select_worker);
-}
-
-static enum dev_mode rate2mode(int ms)
-{
-	if (ms < RATE_GAME)
-		return MODE_FASTEST;
-	if (ms < RATE_UI)
-		return MODE_GAME;
-	if (ms < RATE_NORMAL)
-		return MODE_UI;
-
-	return MODE_NORMAL;
+	if (*d->phys_path)
+		d->sysfs.close(&d->sysfs);
 }
 
 int sensor_xyz_set_delay(struct sensor_api_t *s, int64_t ns)
@@ -208,34 +272,24 @@ int sensor_xyz_set_delay(struct sensor_api_t *s, int64_t ns)
 	int rc = 0;
 	int ms = ns/NS_TO_MS;
 
-	if (ms != d->applied_delay_ms) {
-		rc = store_int_attr(d, d->dev_attr_rate_ms, ms);
-		if (rc)
-			goto error;
-		if (d->dev_attr_mode) {
-			const char *old, *new;
-			enum dev_mode n = rate2mode(ms);
-			enum dev_mode o = rate2mode(d->applied_delay_ms);
-
-			old = d->dev_modes[o];
-			new = d->dev_modes[n];
-
-			if (strcmp(old, new)) {
-				rc = store_str_attr(d, d->dev_attr_mode, new);
-				if (rc)
-					goto error;
-			}		}
-		d->applied_delay_ms = ms;
-	}
+	pthread_mutex_lock(&d->lock);
+	d->delay_ms = ms;
+	if (ms != d->applied_delay_ms)
+		rc = sensor_xyz_store_delay(d, ms, 0);
+	pthread_mutex_unlock(&d->lock);
 
-error:
 	return rc;
 }
 
 int sensor_xyz_activate(struct sensor_api_t *s, int enable)
 {
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	int fd = d->select_worker.get_fd(&d->select_worker);
+	int fd;
+	int rc = 0;
+
+	pthread_mutex_lock(&d->lock);
+	fd = d->select_worker.get_fd(&d->select_worker);
+	d->enabled = enable;
 
 	/* suspend/resume will be handled in kernel-space */
 	if (enable && fd < 0) {
@@ -243,21 +297,25 @@ int sensor_xyz_activate(struct sensor_api_t *s, int enable)
 		if (fd < 0) {
 			ALOGE("%s: Failed to enable '%s'",
 				__func__, d->sensor.name);
-			return fd;
+			rc = fd;
+			goto exit;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && fd >= 0) {
 		d->select_worker.set_fd(&d->select_worker, -1);
 		d->select_worker.suspend(&d->select_worker);
 	}
+exit:
+	pthread_mutex_unlock(&d->lock);
 
-	return 0;
+	return rc;
 }
 
 void *sensor_xyz_read(void *arg)
 {
-	struct input_event events[MAX_EVENTS];
+	struct input_event *events;
 	struct input_event *e;
 	struct sensor_desc *p = arg;
 	struct sensor_data_t sd;
@@ -267,39 +325,38 @@ void *sensor_xyz_read(void *arg)
 	if (fd < 0)
 		return NULL;
 
-	n = read(fd, events, sizeof(events));
-	if (n < 0) {
-		ALOGE("%s: read error '%s' from fd %d sensor '%s'",
-			__func__, strerror(errno), fd, p->sensor.name);
-		return NULL;
-	} else if (n == 0) {
-		ALOGE("%s: read error end of file from fd %d, sensor '%s'",
-			__func__, fd, p->sensor.name);
-		return NULL;
-	}
-
-	n = n / sizeof(events[0]);
-	for (i = 0; i < n; i++) {
-		e = events + i;
-		if (e->type == p->ev_type_data) {
-			if (e->code == p->ev_code[AXIS_X])
-				p->data[p->map[AXIS_X]] =
-					e->value * p->sign[AXIS_X];
-			else if (e->code == p->ev_code[AXIS_Y])
-				p->data[p->map[AXIS_Y]] =
-					e->value * p->sign[AXIS_Y];
-			else if (e->code == p->ev_code[AXIS_Z])
-				p->data[p->map[AXIS_Z]] =
-					e->value * p->sign[AXIS_Z];
-		} else if (e->type == p->ev_type_sync) {
-			sd.sensor = &p->sensor;
-			sd.data = p->data;
-			sd.size = NUM_AXIS;
-			sd.scale = p->scale;
-			sd.status = SENSOR_STATUS_ACCURACY_HIGH;
-			sensors_wrapper_data(&sd);
+	while ((n = input_reader_frame(&p->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			if (e->type == p->ev_type_data) {
+				if (e->code == p->ev_code[AXIS_X])
+					p->raw[AXIS_X] = e->value;
+				else if (e->code == p->ev_code[AXIS_Y])
+					p->raw[AXIS_Y] = e->value;
+				else if (e->code == p->ev_code[AXIS_Z])
+					p->raw[AXIS_Z] = e->value;
+			} else if (e->type == p->ev_type_sync) {
+				sensor_transform_apply_int(&p->transform,
+							   p->raw, p->data, 1);
+				sd.sensor = &p->sensor;
+				sd.timestamp = input_reader_time(&p->reader, e);
+				sd.data = p->data;
+				sd.size = NUM_AXIS;
+				sd.scale = p->scale;
+				sd.status = SENSOR_STATUS_ACCURACY_HIGH;
+				sensors_wrapper_data(&sd);
+			}
 		}
 	}
 
+	if (n == -ENODEV)
+		DASH_LOGE_RATELIMITED(
+			"%s: read error end of file from fd %d, sensor '%s'",
+			__func__, fd, p->sensor.name);
+	else if (n < 0)
+		DASH_LOGE_RATELIMITED(
+			"%s: read error '%s' from fd %d sensor '%s'",
+			__func__, strerror(-n), fd, p->sensor.name);
+
 	return NULL;
 }
@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <unistd.h>
 #include "sensors_list.h"
 #include "sensors_fifo.h"
 #include "sensors_select.h"
@@ -33,12 +34,15 @@
 #include "sensors_config.h"
 #include "sensors_wrapper.h"
 #include "sensors_sysfs.h"
+#include "sensors_input_cache.h"
 #include "sensor_api.h"
 
 #define PHYS_PATH_BASE "/sys/bus/i2c/devices"
-#define PHYS_PATH_LEN  (sizeof(PHYS_PATH_BASE) + sizeof("/0-0000/"))
+#define PHYS_PATH_LEN  (CONFIG_ROOT_MAX + sizeof(PHYS_PATH_BASE) + \
+			sizeof("/0-0000/"))
 #define ATTR_NAME_LEN  32
-#define DEV_PATH_LEN  sizeof("/dev/input/event/4294967295")
+#define DEV_PATH_LEN  (CONFIG_ROOT_MAX + \
+		       sizeof("/dev/input/event/4294967295"))
 
 enum android_rates {
 	RATE_GAME   =  20,
@@ -67,11 +71,18 @@ struct sensor_desc {
 	struct wrapper_entry entry;
 	struct sensors_select_t select_worker;
 	struct sensors_sysfs_t sysfs;
+	struct input_reader_t reader;
+	int raw[NUM_AXIS];
 	int data[NUM_AXIS];
 	char *map_prefix;
 	int map[NUM_AXIS];
 	int sign[NUM_AXIS];
+	struct sensor_transform_t transform;
+	/* serializes activate, set_delay and hotplug */
+	pthread_mutex_t lock;
+	int delay_ms;
 	int applied_delay_ms;
+	int enabled;
 	float scale;
 	void * (*read)(void *);
 	int (*find_input)(struct sensor_desc *d);
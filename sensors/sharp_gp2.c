@@ -40,6 +40,7 @@ struct sensor_desc {
 	struct sensor_t sensor;
 	struct sensor_api_t api;
 
+	struct input_reader_t reader;
 	float distance;
 	int64_t delay;
 };
@@ -77,7 +78,9 @@ static int sharp_init(struct sensor_api_t *s)
 	}
 	close(fd);
 
-	sensors_select_init(&d->select_worker, sharp_read, s, -1);
+	if (sensors_select_init(&d->select_worker, sharp_read, s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 	return 0;
 }
 
@@ -98,6 +101,7 @@ static int sharp_activate(struct sensor_api_t *s, int enable)
 		if (ioctl(fd, EVIOCSSUSPENDBLOCK, 1))
 			ALOGW("%s: unable to enable wake locks\n", __func__);
 #endif
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -132,35 +136,39 @@ static void *sharp_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	struct input_event event;
+	struct input_event *events;
+	struct input_event *e;
 	sensors_event_t data;
-	int ret;
+	int i, n;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 
-	while ((ret = read(fd, &event, sizeof(event))) > 0) {
-		switch (event.type) {
-		case EV_ABS:
-			if (event.code == ABS_DISTANCE)
-				d->distance = event.value ? 1.0 : 0.0;
-			break;
-		case EV_SW:
-			if (event.code == SW_FRONT_PROXIMITY)
-				d->distance = event.value ? 0.0 : 1.0;
-			break;
-		case EV_SYN:
-			memset(&data, 0, sizeof(data));
-
-			data.distance = d->distance;
-
-			data.version = sharp_gp2.sensor.version;
-			data.sensor = sharp_gp2.sensor.handle;
-			data.type = sharp_gp2.sensor.type;
-			data.timestamp = get_current_nano_time();
-
-			sensors_fifo_put(&data);
-			break;
-		default:
-			break;
+	while ((n = input_reader_frame(&d->reader, fd, &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			e = events + i;
+			switch (e->type) {
+			case EV_ABS:
+				if (e->code == ABS_DISTANCE)
+					d->distance = e->value ? 1.0 : 0.0;
+				break;
+			case EV_SW:
+				if (e->code == SW_FRONT_PROXIMITY)
+					d->distance = e->value ? 0.0 : 1.0;
+				break;
+			case EV_SYN:
+				memset(&data, 0, sizeof(data));
+
+				data.distance = d->distance;
+
+				data.version = sharp_gp2.sensor.version;
+				data.sensor = sharp_gp2.sensor.handle;
+				data.type = sharp_gp2.sensor.type;
+				data.timestamp = input_reader_time(&d->reader, e);
+
+				sensors_fifo_put(&data);
+				break;
+			default:
+				break;
+			}
 		}
 	}
 
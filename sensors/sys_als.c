@@ -23,6 +23,7 @@ struct sensor_desc {
 	struct sensors_select_t select_worker;
 	struct sensor_t sensor;
 	struct sensor_api_t api;
+	struct input_reader_t reader;
 	char *name;
 };
 
@@ -49,7 +50,9 @@ static struct sensor_desc light_sensor = {
 static int als_init(struct sensor_api_t *s)
 {
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	sensors_select_init(&d->select_worker, als_read, s, -1);
+	if (sensors_select_init(&d->select_worker, als_read, s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 	return 0;
 }
 
@@ -66,6 +69,7 @@ static int als_activate(struct sensor_api_t *s, int enable)
 			return -1;
 		}
 		if (!sysals_activate()) {
+			input_reader_set_fd(&d->reader, fd);
 			d->select_worker.set_fd(&d->select_worker, fd);
 			d->select_worker.resume(&d->select_worker);
 		} else {
@@ -95,33 +99,34 @@ static void *als_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	int bytes, i;
-	struct input_event event[2];
+	int n, i;
+	struct input_event *event;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 	sensors_event_t data;
 
-	bytes = read(fd, event, sizeof(event));
-	if (bytes < 0) {
-		ALOGE("%s: read failed, error: %d\n", __func__, bytes);
-		return NULL;
-	}
-	for (i = 0; i < (bytes / (int)sizeof(struct input_event)); i++) {
-		switch (event[i].type) {
-		case EV_MSC:
-			if (event[i].code != MSC_RAW)
+	while ((n = input_reader_frame(&d->reader, fd, &event)) > 0) {
+		for (i = 0; i < n; i++) {
+			switch (event[i].type) {
+			case EV_MSC:
+				if (event[i].code != MSC_RAW)
+					break;
+				memset(&data, 0, sizeof(data));
+				data.light = event[i].value;
+				data.version = light_sensor.sensor.version;
+				data.sensor = light_sensor.sensor.handle;
+				data.type = light_sensor.sensor.type;
+				data.timestamp = input_reader_time(&d->reader,
+								    &event[i]);
+				sensors_fifo_put(&data);
+				break;
+			default:
 				break;
-			memset(&data, 0, sizeof(data));
-			data.light = event[i].value;
-			data.version = light_sensor.sensor.version;
-			data.sensor = light_sensor.sensor.handle;
-			data.type = light_sensor.sensor.type;
-			data.timestamp = get_current_nano_time();
-			sensors_fifo_put(&data);
-			break;
-		default:
-			break;
+			}
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read failed, error: %d",
+				      __func__, n);
 
 	return NULL;
 }
@@ -38,6 +38,7 @@ struct sensor_desc {
 	struct sensors_select_t select_worker;
 	struct sensor_t sensor;
 	struct sensor_api_t api;
+	struct input_reader_t reader;
 	char *name;
 };
 
@@ -74,7 +75,9 @@ static int tsl2772_init(struct sensor_api_t *s)
 		return -1;
 	}
 	close(fd);
-	sensors_select_init(&d->select_worker, tsl2772_read, s, -1);
+	if (sensors_select_init(&d->select_worker, tsl2772_read, s, -1) < 0)
+		return -1;
+	d->select_worker.handle = d->sensor.handle;
 
 	return 0;
 }
@@ -91,6 +94,7 @@ static int tsl2772_activate(struct sensor_api_t *s, int enable)
 				__func__, d->name, strerror(errno));
 			return -1;
 		}
+		input_reader_set_fd(&d->reader, fd);
 		d->select_worker.set_fd(&d->select_worker, fd);
 		d->select_worker.resume(&d->select_worker);
 	} else if (!enable && (fd > 0)) {
@@ -117,37 +121,38 @@ static void *tsl2772_read(void *arg)
 {
 	struct sensor_api_t *s = arg;
 	struct sensor_desc *d = container_of(s, struct sensor_desc, api);
-	int bytes, i;
-	struct input_event event[2];
+	int n, i;
+	struct input_event *event;
 	int fd = d->select_worker.get_fd(&d->select_worker);
 	sensors_event_t data;
 	float distance = 0;
 
-	bytes = read(fd, event, sizeof(event));
-	if (bytes < 0) {
-		ALOGE("%s: read failed, error: %d\n", __func__, bytes);
-		return NULL;
-	}
-
-	for (i = 0; i < (bytes / (int)sizeof(struct input_event)); i++) {
-		switch (event[i].type) {
-		case EV_ABS:
-			if (event[i].code == ABS_DISTANCE)
-				distance = event[i].value ? 1.0 : 0.0;
-			break;
-		case EV_SYN:
-			memset(&data, 0, sizeof(data));
-			data.distance = distance;
-			data.version = tsl2772.sensor.version;
-			data.sensor = tsl2772.sensor.handle;
-			data.type = tsl2772.sensor.type;
-			data.timestamp = get_current_nano_time();
-			sensors_fifo_put(&data);
-			break;
-		default:
-			break;
+	while ((n = input_reader_frame(&d->reader, fd, &event)) > 0) {
+		for (i = 0; i < n; i++) {
+			switch (event[i].type) {
+			case EV_ABS:
+				if (event[i].code == ABS_DISTANCE)
+					distance = event[i].value ? 1.0 : 0.0;
+				break;
+			case EV_SYN:
+				memset(&data, 0, sizeof(data));
+				data.distance = distance;
+				data.version = tsl2772.sensor.version;
+				data.sensor = tsl2772.sensor.handle;
+				data.type = tsl2772.sensor.type;
+				data.timestamp = input_reader_time(&d->reader,
+								    &event[i]);
+				sensors_fifo_put(&data);
+				distance = 0;
+				break;
+			default:
+				break;
+			}
 		}
 	}
+	if (n < 0)
+		DASH_LOGE_RATELIMITED("%s: read failed, error: %d",
+				      __func__, n);
 
 	return NULL;
 }
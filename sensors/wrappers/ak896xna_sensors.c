@@ -18,9 +18,10 @@
 #include "sensors_id.h"
 #include "sensors_config.h"
 #include "sensors_wrapper.h"
+#include "sensors_fusion.h"
 #include "sensor_xyz.h"
 
-#define PATH_SIZE 44
+#define PATH_SIZE (CONFIG_ROOT_MAX + 44)
 #define DEV_NAME "compass"
 #define SETTING_FILE_NAME "/data/misc/akm_set.txt"
 #define PHYS_PATH_BASE "/sys/devices/virtual/input"
@@ -80,6 +81,7 @@ struct akm_t {
 	int enable_mask;
 	int init;/* true, if has initialized*/
 	int init_ret;
+	struct sensors_fusion_t fusion;
 	struct wrapper_desc ak896x;
 	/* android sensors */
 	struct wrapper_desc magnetic;
@@ -91,6 +93,7 @@ static int ak896x_init(struct sensor_api_t *s);
 static int ak896x_activate(struct sensor_api_t *s, int enable);
 static int ak896x_delay(struct sensor_api_t *s, int64_t ns);
 static void ak896x_close(struct sensor_api_t *s);
+static void ak896xna_queue(struct sensor_api_t *s, struct sensor_data_t *sd);
 static void ak896xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *sd);
 
 struct akm_t akm = {
@@ -111,7 +114,7 @@ struct akm_t akm = {
 			.activate = ak896x_activate,
 			.set_delay = ak896x_delay,
 			.close = ak896x_close,
-			.data = ak896xna_compass_data,
+			.data = ak896xna_queue,
 		},
 		.access = {
 			.match = {
@@ -119,6 +122,8 @@ struct akm_t akm = {
 				SENSOR_TYPE_MAGNETIC_FIELD,
 			},
 			.m_nr = 2,
+			/* AKM_SaveAcc gets the mean of a faster accelerometer */
+			.flags = WRAPPER_AVERAGE,
 		},
 	},
 	.magnetic = {
@@ -277,6 +282,8 @@ static int ak896x_init(struct sensor_api_t *s)
 
 	if (!akm.init) {
 		akm.init = 1;
+		sensors_fusion_init(&akm.fusion, AKM_CHIP_NAME,
+				    ak896xna_compass_data, &akm.ak896x.api);
 		akm.init_ret = sensors_wrapper_init(&akm.ak896x.api);
 		if (akm.init_ret < 0) {
 			ALOGE("%s: init failed", __func__);
@@ -318,6 +325,8 @@ static int ak896x_activate(struct sensor_api_t *s, int enable)
 			return 0;
 		}
 		akm.enable_mask |= (1 << sensor);
+		/* samples left from before the last stop are done first */
+		sensors_fusion_sync(&akm.fusion);
 		AKM_Start(SETTING_FILE_NAME);
 	} else {
 		ret = ak896x_delay(s, CLIENT_DELAY_UNUSED);
@@ -328,9 +337,13 @@ static int ak896x_activate(struct sensor_api_t *s, int enable)
 			return 0;
 		}
 		akm.enable_mask &= ~(1 << sensor);
-		ret = AKM_Stop(SETTING_FILE_NAME);
-		if (ret)
+		/* no new samples once the wrapper is off, let the fusion
+		   stage finish the queued ones before the library stops */
+		ret = sensors_wrapper_activate(&akm.ak896x.api, enable);
+		sensors_fusion_sync(&akm.fusion);
+		if (AKM_Stop(SETTING_FILE_NAME))
 			ALOGE("%s: AKM_Stop Error !\n", __func__);
+		return ret;
 	}
 
 	return sensors_wrapper_activate(&akm.ak896x.api, enable);
@@ -369,8 +382,10 @@ static void ak896x_close(struct sensor_api_t *s)
 	if (akm.enable_mask == 0) {
 		ALOGV("%s: '%s' by '%s'", __func__, akm.ak896x.sensor.name,
 			d->sensor.name);
-		AKM_Release();
 		sensors_wrapper_close(&akm.ak896x.api);
+		/* the library must be idle before it is released */
+		sensors_fusion_sync(&akm.fusion);
+		AKM_Release();
 	}
 }
 
@@ -393,7 +408,8 @@ static void ak896xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *
 		err = AKM_SaveAcc(sd->data[AXIS_X], sd->data[AXIS_Y], sd->data[AXIS_Z],
 					ACC_SENSITIVITY);
 		if (err)
-			ALOGE("%s: AKM_SaveAcc Error !\n", __func__);
+			DASH_LOGE_RATELIMITED("%s: AKM_SaveAcc Error !",
+					      __func__);
 	}
 
 	if (sd->sensor->type == SENSOR_TYPE_MAGNETIC_FIELD) {
@@ -414,14 +430,17 @@ static void ak896xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *
 			  sd->status,
 			  sd->delay);
 		if (err)
-			ALOGE("%s: AKM_Save_Mag Error !\n", __func__);
+			DASH_LOGE_RATELIMITED("%s: AKM_Save_Mag Error !",
+					      __func__);
 
 		data.timestamp = sd->timestamp;
 
 		if (akm.enable_mask & (1 << MAGNETIC)) {
 			err = AKM_GetMagneticValues(&data);
 			if (err)
-				ALOGE("%s: AKM_AKM_GetMagneticValues Error !\n", __func__);
+				DASH_LOGE_RATELIMITED(
+					"%s: AKM_GetMagneticValues Error !",
+					__func__);
 
 			data.version = akm.magnetic.sensor.version;
 			data.sensor = akm.magnetic.sensor.handle;
@@ -431,7 +450,9 @@ static void ak896xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *
 		if (akm.enable_mask & (1 << ORIENTATION)) {
 			err = AKM_GetOrientationValues(&data);
 			if (err)
-				ALOGE("%s: AKM_GetOrientationValues Error !\n", __func__);
+				DASH_LOGE_RATELIMITED(
+					"%s: AKM_GetOrientationValues Error !",
+					__func__);
 
 			data.version = akm.compass.sensor.version;
 			data.sensor = akm.compass.sensor.handle;
@@ -441,6 +462,12 @@ static void ak896xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *
 	}
 }
 
+/* the AKM library is run on the fusion thread, see ak896xna_compass_data */
+static void ak896xna_queue(struct sensor_api_t *s, struct sensor_data_t *sd)
+{
+	sensors_fusion_put(&akm.fusion, sd);
+}
+
 list_constructor(ak896xna_register);
 void ak896xna_register()
 {
@@ -18,6 +18,7 @@
 #include "sensors_id.h"
 #include "sensors_config.h"
 #include "sensors_wrapper.h"
+#include "sensors_fusion.h"
 #include "sensor_xyz.h"
 #include "libs/akm8972/SEMC_APIs.h"
 
@@ -79,6 +80,7 @@ struct akm_t {
 	int enable_mask;
 	int init;/* true, if has initialized*/
 	int init_ret;
+	struct sensors_fusion_t fusion;
 	struct wrapper_desc ak897x;
 	/* android sensors */
 	struct wrapper_desc magnetic;
@@ -90,6 +92,7 @@ static int ak897x_init(struct sensor_api_t *s);
 static int ak897x_activate(struct sensor_api_t *s, int enable);
 static int ak897x_delay(struct sensor_api_t *s, int64_t ns);
 static void ak897x_close(struct sensor_api_t *s);
+static void ak897xna_queue(struct sensor_api_t *s, struct sensor_data_t *sd);
 static void ak897xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *sd);
 
 struct akm_t akm = {
@@ -110,7 +113,7 @@ struct akm_t akm = {
 			.activate = ak897x_activate,
 			.set_delay = ak897x_delay,
 			.close = ak897x_close,
-			.data = ak897xna_compass_data,
+			.data = ak897xna_queue,
 		},
 		.access = {
 			.match = {
@@ -118,6 +121,8 @@ struct akm_t akm = {
 				SENSOR_TYPE_MAGNETIC_FIELD,
 			},
 			.m_nr = 2,
+			/* AKM_SaveAcc gets the mean of a faster accelerometer */
+			.flags = WRAPPER_AVERAGE,
 		},
 	},
 	.magnetic = {
@@ -265,6 +270,8 @@ static int ak897x_init(struct sensor_api_t *s)
 
 	if (!akm.init) {
 		akm.init = 1;
+		sensors_fusion_init(&akm.fusion, AKM_CHIP_NAME,
+				    ak897xna_compass_data, &akm.ak897x.api);
 		akm.init_ret = sensors_wrapper_init(&akm.ak897x.api);
 		if (akm.init_ret < 0) {
 			ALOGE("%s: init failed", __func__);
@@ -306,6 +313,8 @@ static int ak897x_activate(struct sensor_api_t *s, int enable)
 			return 0;
 		}
 		akm.enable_mask |= (1 << sensor);
+		/* samples left from before the last stop are done first */
+		sensors_fusion_sync(&akm.fusion);
 		AKM_Start(SETTING_FILE_NAME);
 	} else {
 		ret = ak897x_delay(s, CLIENT_DELAY_UNUSED);
@@ -316,9 +325,13 @@ static int ak897x_activate(struct sensor_api_t *s, int enable)
 			return 0;
 		}
 		akm.enable_mask &= ~(1 << sensor);
-		ret = AKM_Stop(SETTING_FILE_NAME);
-		if (ret)
+		/* no new samples once the wrapper is off, let the fusion
+		   stage finish the queued ones before the library stops */
+		ret = sensors_wrapper_activate(&akm.ak897x.api, enable);
+		sensors_fusion_sync(&akm.fusion);
+		if (AKM_Stop(SETTING_FILE_NAME))
 			ALOGE("%s: AKM_Stop Error !\n", __func__);
+		return ret;
 	}
 	ALOGV("%s: %s '%s' by '%s'", __func__, enable ? "enable" : "disable",
 		akm.ak897x.sensor.name, d->sensor.name);
@@ -357,8 +370,10 @@ static void ak897x_close(struct sensor_api_t *s)
 	if (akm.enable_mask == 0) {
 		ALOGV("%s: '%s' by '%s'", __func__, akm.ak897x.sensor.name,
 			d->sensor.name);
-		AKM_Release();
 		sensors_wrapper_close(&akm.ak897x.api);
+		/* the library must be idle before it is released */
+		sensors_fusion_sync(&akm.fusion);
+		AKM_Release();
 	}
 }
 
@@ -381,7 +396,8 @@ static void ak897xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *
 		err = AKM_SaveAcc(sd->data[AXIS_X], sd->data[AXIS_Y], sd->data[AXIS_Z],
 					ACC_SENSITIVITY);
 		if (err)
-			ALOGE("%s: AKM_SaveAcc Error !\n", __func__);
+			DASH_LOGE_RATELIMITED("%s: AKM_SaveAcc Error !",
+					      __func__);
 	}
 
 	if (sd->sensor->type == SENSOR_TYPE_MAGNETIC_FIELD) {
@@ -402,36 +418,47 @@ static void ak897xna_compass_data(struct sensor_api_t *s, struct sensor_data_t *
 			  sd->status,
 			  sd->delay);
 		if (err)
-			ALOGE("%s: AKM_Save_Mag Error !\n", __func__);
+			DASH_LOGE_RATELIMITED("%s: AKM_Save_Mag Error !",
+					      __func__);
 
 		data.timestamp = sd->timestamp;
 
 		if (akm.enable_mask & (1 << MAGNETIC)) {
 			err = AKM_GetMagneticValues(&data);
 			if (err)
-				ALOGE("%s: AKM_AKM_GetMagneticValues Error !\n", __func__);
+				DASH_LOGE_RATELIMITED(
+					"%s: AKM_GetMagneticValues Error !",
+					__func__);
 
 			data.version = akm.magnetic.sensor.version;
 			data.sensor = akm.magnetic.sensor.handle;
 			data.type = akm.magnetic.sensor.type;
 			sensors_fifo_put(&data);
-			ALOGV("%s:mag x=%f, y=%f, z=%f", __func__,
+			DASH_LOGV("%s:mag x=%f, y=%f, z=%f", __func__,
 			     data.magnetic.x, data.magnetic.y, data.magnetic.z);
 		}
 		if (akm.enable_mask & (1 << ORIENTATION)) {
 			err = AKM_GetOrientationValues(&data);
 			if (err)
-				ALOGE("%s: AKM_GetOrientationValues Error !\n", __func__);
+				DASH_LOGE_RATELIMITED(
+					"%s: AKM_GetOrientationValues Error !",
+					__func__);
 			data.version = akm.compass.sensor.version;
 			data.sensor = akm.compass.sensor.handle;
 			data.type = akm.compass.sensor.type;
 			sensors_fifo_put(&data);
-			ALOGV("%s: x=%f, y=%f, z=%f", __func__, data.orientation.azimuth,
+			DASH_LOGV("%s: x=%f, y=%f, z=%f", __func__, data.orientation.azimuth,
 			     data.orientation.pitch, data.orientation.roll);
 		}
 	}
 }
 
+/* the AKM library is run on the fusion thread, see ak897xna_compass_data */
+static void ak897xna_queue(struct sensor_api_t *s, struct sensor_data_t *sd)
+{
+	sensors_fusion_put(&akm.fusion, sd);
+}
+
 list_constructor(ak897xna_register);
 void ak897xna_register()
 {
@@ -49,6 +49,8 @@ static struct wrapper_desc bma250_input = {
 		.init = sensors_wrapper_init,
 		.activate = sensors_wrapper_activate,
 		.set_delay = sensors_wrapper_set_delay,
+		.batch = sensors_wrapper_batch,
+		.flush = sensors_wrapper_flush,
 		.close = sensors_wrapper_close,
 		.data = bma250_data,
 	},
@@ -8,6 +8,8 @@
 #include "sensors_fifo.h"
 #include "sensors_id.h"
 #include "sensors_wrapper.h"
+#include "sensors_fusion.h"
+#include "sensors_frame.h"
 #include "sensor_util.h"
 #include "iNemoEngineAPI.h"
 #include "sensor_xyz.h"
@@ -21,7 +23,9 @@ static int inemo_init(struct sensor_api_t *s);
 static int inemo_activate(struct sensor_api_t *s, int enable);
 static int inemo_delay(struct sensor_api_t *s, int64_t ns);
 static void inemo_close(struct sensor_api_t *s);
+static void inemo_queue(struct sensor_api_t *s, struct sensor_data_t *sd);
 static void inemo_data(struct sensor_api_t *s, struct sensor_data_t *sd);
+static void inemo_frame(struct sensors_frame_t *fr, struct frame_data *frame);
 
 /* function sends android data after inemo has executed */
 static void android_event(struct wrapper_desc *d, float *p, int64_t t);
@@ -31,7 +35,12 @@ static void android_event(struct wrapper_desc *d, float *p, int64_t t);
 #define LOCALEARTHMAGFIELD 50
 #define MAGFULLSCALE 0xE0
 #define FORMFACTORNUMBER 0
-#define DELTATIME 100
+/* time unit of iNemoEngineAPI_Run, 0.1 ms */
+#define DELTATIME_NS 100000
+/* the lib runs at the fastest rate asked for by an active sensor, but
+   not faster than 100 Hz nor slower than the 20 Hz it is tuned for */
+#define INEMO_RATE_MIN_NS 10000000
+#define INEMO_RATE_MAX_NS 50000000
 #define UTESLA_TO_MGAUSS 10
 
 typedef struct Output
@@ -51,20 +60,33 @@ enum {
 	Numsensors
 };
 
+/* frame inputs, in the order of inemo_inputs */
+enum {
+	INPUT_ACC,
+	INPUT_MAG,
+	INPUT_GYRO,
+	NUMINPUTS
+};
+
+static const int inemo_inputs[NUMINPUTS] = {
+	SENSOR_TYPE_ACCELEROMETER,
+	SENSOR_TYPE_MAGNETIC_FIELD,
+	SENSOR_TYPE_GYROSCOPE,
+};
+
 struct inemoengine_t {
 	/* Inemo specific */
 	RawCounts    data;
 	Output       output;
 	/* local control */
-	int magnetic_status;
 	int enable_mask;
 	int init;/* true, if has initialized*/
 	int init_ret;
-	unsigned char acc_data_exist;
-	unsigned char mag_data_exist;
-	unsigned char gyr_data_exist;
 	/* inemo internal sensor */
 	int64_t rate_ns;
+	int64_t delay_requests[Numsensors];
+	struct sensors_fusion_t fusion;
+	struct sensors_frame_t frame;
 	struct wrapper_desc inemo;
 	/* inemo android sensors */
 	struct wrapper_desc gravity;
@@ -78,7 +100,14 @@ struct inemoengine_t inemoengine = {
 	.enable_mask = 0x00, /* Start with all Android sensors deactivated */
 	.init = 0,
 	.init_ret = SENSOR_OK,
-	.rate_ns = 10000000, /* always run all releated sensors in 100Hz */
+	.rate_ns = INEMO_RATE_MIN_NS,
+	.delay_requests = {
+		NO_RATE,
+		NO_RATE,
+		NO_RATE,
+		NO_RATE,
+		NO_RATE,
+	},
 	.inemo = {
 		.sensor = {
 			.name       = "iNemo",
@@ -91,7 +120,7 @@ struct inemoengine_t inemoengine = {
 			.activate  = inemo_activate,
 			.set_delay = inemo_delay,
 			.close     = inemo_close,
-			.data      = inemo_data,
+			.data      = inemo_queue,
 		},
 		.access = {
 			.match = {
@@ -222,6 +251,12 @@ static int inemo_init(struct sensor_api_t *s)
 			return inemoengine.init_ret;
 		}
 
+		sensors_frame_init(&inemoengine.frame, inemo_inputs, NUMINPUTS,
+				   inemoengine.rate_ns, inemo_frame);
+		/* on failure the engine is run in the data callback */
+		sensors_fusion_init(&inemoengine.fusion, "iNemo", inemo_data,
+				    &inemoengine.inemo.api);
+
 		inemoengine.init_ret = sensors_wrapper_init(
 					&inemoengine.inemo.api);
 		if (inemoengine.init_ret < 0)
@@ -231,7 +266,7 @@ static int inemo_init(struct sensor_api_t *s)
 	return inemoengine.init_ret;
 }
 
-static int inemo_activate(struct sensor_api_t *s, int enable)
+static int inemo_sensor(struct sensor_api_t *s)
 {
 	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
 	int sensor = -1;
@@ -244,16 +279,56 @@ static int inemo_activate(struct sensor_api_t *s, int enable)
 		case SENSOR_TYPE_MAGNETIC_FIELD: sensor = MAGNETIC; break;
 	}
 
+	return sensor;
+}
+
+/* run the lib and the sensors feeding it at the rate of the active
+   sensors, the fusion thread picks up the new rate_ns on its next sample */
+static int inemo_update_rate(void)
+{
+	int64_t ns = INEMO_RATE_MAX_NS;
+	int i;
+
+	for (i = 0; i < Numsensors; i++) {
+		if ((inemoengine.enable_mask & (1 << i)) &&
+		    (inemoengine.delay_requests[i] != NO_RATE) &&
+		    (inemoengine.delay_requests[i] < ns))
+			ns = inemoengine.delay_requests[i];
+	}
+	if (ns < INEMO_RATE_MIN_NS)
+		ns = INEMO_RATE_MIN_NS;
+
+	if (ns != inemoengine.rate_ns)
+		ALOGV("%s: %lld ns", __func__, ns);
+	__atomic_store_n(&inemoengine.rate_ns, ns, __ATOMIC_RELAXED);
+
+	return sensors_wrapper_set_delay(&inemoengine.inemo.api, ns);
+}
+
+static int inemo_activate(struct sensor_api_t *s, int enable)
+{
+	int sensor = inemo_sensor(s);
+	int ret;
+
+	if (sensor < 0)
+		return -1;
+
 	if (enable) {
-		if(inemoengine.enable_mask > 0) {
+		/* the rate may have been requested before the enable */
+		if (inemoengine.enable_mask > 0) {
 			inemoengine.enable_mask |= (1 << sensor);
-			return 0;
+			return inemo_update_rate();
 		}
 		inemoengine.enable_mask |= (1 << sensor);
+		ret = sensors_wrapper_activate(&inemoengine.inemo.api, enable);
+		if (ret < 0)
+			return ret;
+		return inemo_update_rate();
 	} else {
+		inemoengine.delay_requests[sensor] = NO_RATE;
 		if ((inemoengine.enable_mask & ~(1 << sensor)) != 0 ) {
 			inemoengine.enable_mask &= ~(1 << sensor);
-			return 0;
+			return inemo_update_rate();
 		}
 		inemoengine.enable_mask &= ~(1 << sensor);
 	}
@@ -263,90 +338,91 @@ static int inemo_activate(struct sensor_api_t *s, int enable)
 
 static int inemo_delay(struct sensor_api_t *s, int64_t ns)
 {
-	/* always set the default rate required by inemo lib */
-	return sensors_wrapper_set_delay(&inemoengine.inemo.api, inemoengine.rate_ns);
+	int sensor = inemo_sensor(s);
+
+	if (sensor < 0)
+		return -1;
+
+	inemoengine.delay_requests[sensor] = ns;
+
+	return inemo_update_rate();
 }
 
 static void inemo_close(struct sensor_api_t *s)
 {
 	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
 
-	if (inemoengine.enable_mask == 0)
+	if (inemoengine.enable_mask == 0) {
 		sensors_wrapper_close(&inemoengine.inemo.api);
+		sensors_fusion_sync(&inemoengine.fusion);
+		sensors_frame_reset(&inemoengine.frame);
+	}
+}
+
+/* iNemoEngineAPI_Run is run on the fusion thread, see inemo_data */
+static void inemo_queue(struct sensor_api_t *s, struct sensor_data_t *sd)
+{
+	sensors_fusion_put(&inemoengine.fusion, sd);
 }
 
 static void inemo_data(struct sensor_api_t *s, struct sensor_data_t *sd)
 {
-	int64_t t;
-
-	if (sd->sensor->type == SENSOR_TYPE_ACCELEROMETER) {
-		/* store data in G and in NED format (scale = 0.001) */
-		inemoengine.data.acc[AXIS_X] = sd->data[AXIS_X] * sd->scale;
-		inemoengine.data.acc[AXIS_Y] = sd->data[AXIS_Y] * sd->scale;
-		inemoengine.data.acc[AXIS_Z] = sd->data[AXIS_Z] * sd->scale;
-		inemoengine.acc_data_exist = 1;
-	} else if (sd->sensor->type == SENSOR_TYPE_MAGNETIC_FIELD) {
-		inemoengine.data.mag[AXIS_X] = sd->data[AXIS_X] * sd->scale;
-		inemoengine.data.mag[AXIS_Y] = sd->data[AXIS_Y] * sd->scale;
-		inemoengine.data.mag[AXIS_Z] = sd->data[AXIS_Z] * sd->scale;
-		inemoengine.magnetic_status = sd->status;
-		inemoengine.mag_data_exist = 1;
-	} else if (sd->sensor->type == SENSOR_TYPE_GYROSCOPE) {
-		/* store data in DPS and in NED format (scale = 0.070) */
-		inemoengine.data.gyro[AXIS_X] = sd->data[AXIS_X] * sd->scale;
-		inemoengine.data.gyro[AXIS_Y] = sd->data[AXIS_Y] * sd->scale;
-		inemoengine.data.gyro[AXIS_Z] = sd->data[AXIS_Z] * sd->scale;
-		inemoengine.gyr_data_exist = 1;
-	} else {
-		ALOGE("%s: Error, %s is unknown", __func__, sd->sensor->name);
-		return ;
+	int64_t ns = __atomic_load_n(&inemoengine.rate_ns, __ATOMIC_RELAXED);
+
+	if (ns != inemoengine.frame.period)
+		sensors_frame_set_period(&inemoengine.frame, ns);
+	sensors_frame_put(&inemoengine.frame, sd);
+}
+
+/* runs the lib once per frame period on inputs aligned by the frame assembler */
+static void inemo_frame(struct sensors_frame_t *fr, struct frame_data *frame)
+{
+	int64_t t = frame->timestamp;
+	int i;
+
+	/* acc in G, gyro in DPS, all in NED format */
+	for (i = 0; i < NUMAXES; i++) {
+		inemoengine.data.acc[i] = frame->data[INPUT_ACC][i];
+		inemoengine.data.mag[i] = frame->data[INPUT_MAG][i];
+		inemoengine.data.gyro[i] = frame->data[INPUT_GYRO][i];
 	}
 
-	/* run the lib if we have all data we need */
-	if (inemoengine.acc_data_exist && inemoengine.mag_data_exist && inemoengine.gyr_data_exist) {
-		(void)iNemoEngineAPI_Run(DELTATIME, &inemoengine.data);
-		t = get_current_nano_time();
+	(void)iNemoEngineAPI_Run(fr->period / DELTATIME_NS, &inemoengine.data);
 
-		if (inemoengine.enable_mask & (1 << GRAVITY)) {
-			(void) iNemoEngineAPI_Return_Gravity(inemoengine.output.gravity);
-			(void)android_event(&inemoengine.gravity, inemoengine.output.gravity, t);
-		}
-		if (inemoengine.enable_mask & (1 << LINEAR_ACCELERATION)) {
-			(void) iNemoEngineAPI_Return_Linear_acceleration(
-					inemoengine.output.linear_acceleration);
-			(void)android_event(&inemoengine.linear_acceleration,
-					inemoengine.output.linear_acceleration, t);
-		}
-		if(inemoengine.enable_mask & (1 << ROTATION_VECTOR)) {
-			(void) iNemoEngineAPI_Return_Quaternion(inemoengine.output.quaternion);
-			(void)android_event(&inemoengine.rotation_vector,
-					inemoengine.output.quaternion, t);
-		}
-		if (inemoengine.enable_mask & (1 << ORIENTATION)) {
-			(void) iNemoEngineAPI_Return_Rotation(inemoengine.output.rotation);
-			android_event(&inemoengine.orientation,
-					inemoengine.output.rotation, t);
-		}
-		if (inemoengine.enable_mask & (1 << MAGNETIC)) {
-			CalibFactor Calibration;
-			sensors_event_t se;
-
-			iNemoEngineAPI_getCalibrationData(&Calibration);
-			se.sensor = inemoengine.magnetic.sensor.handle;
-			se.version = inemoengine.magnetic.sensor.version;
-			se.type = inemoengine.magnetic.sensor.type;
-			se.timestamp = t;
-			se.magnetic.status = inemoengine.magnetic_status;
-			se.magnetic.x = inemoengine.data.mag[AXIS_X] - Calibration.magOffX/UTESLA_TO_MGAUSS;
-			se.magnetic.y = inemoengine.data.mag[AXIS_Y] - Calibration.magOffY/UTESLA_TO_MGAUSS;
-			se.magnetic.z = inemoengine.data.mag[AXIS_Z] - Calibration.magOffZ/UTESLA_TO_MGAUSS;
-			sensors_fifo_put(&se);
-		}
+	if (inemoengine.enable_mask & (1 << GRAVITY)) {
+		(void) iNemoEngineAPI_Return_Gravity(inemoengine.output.gravity);
+		(void)android_event(&inemoengine.gravity, inemoengine.output.gravity, t);
+	}
+	if (inemoengine.enable_mask & (1 << LINEAR_ACCELERATION)) {
+		(void) iNemoEngineAPI_Return_Linear_acceleration(
+				inemoengine.output.linear_acceleration);
+		(void)android_event(&inemoengine.linear_acceleration,
+				inemoengine.output.linear_acceleration, t);
+	}
+	if(inemoengine.enable_mask & (1 << ROTATION_VECTOR)) {
+		(void) iNemoEngineAPI_Return_Quaternion(inemoengine.output.quaternion);
+		(void)android_event(&inemoengine.rotation_vector,
+				inemoengine.output.quaternion, t);
+	}
+	if (inemoengine.enable_mask & (1 << ORIENTATION)) {
+		(void) iNemoEngineAPI_Return_Rotation(inemoengine.output.rotation);
+		android_event(&inemoengine.orientation,
+				inemoengine.output.rotation, t);
+	}
+	if (inemoengine.enable_mask & (1 << MAGNETIC)) {
+		CalibFactor Calibration;
+		sensors_event_t se;
 
-		/* reset */
-		inemoengine.acc_data_exist = 0;
-		inemoengine.mag_data_exist = 0;
-		inemoengine.gyr_data_exist = 0;
+		iNemoEngineAPI_getCalibrationData(&Calibration);
+		se.sensor = inemoengine.magnetic.sensor.handle;
+		se.version = inemoengine.magnetic.sensor.version;
+		se.type = inemoengine.magnetic.sensor.type;
+		se.timestamp = t;
+		se.magnetic.status = frame->status[INPUT_MAG];
+		se.magnetic.x = inemoengine.data.mag[AXIS_X] - Calibration.magOffX/UTESLA_TO_MGAUSS;
+		se.magnetic.y = inemoengine.data.mag[AXIS_Y] - Calibration.magOffY/UTESLA_TO_MGAUSS;
+		se.magnetic.z = inemoengine.data.mag[AXIS_Z] - Calibration.magOffZ/UTESLA_TO_MGAUSS;
+		sensors_fifo_put(&se);
 	}
 }
 
@@ -33,7 +33,7 @@ static void gyroscope_data(struct sensor_api_t *s, struct sensor_data_t *sd)
 	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
 	sensors_event_t data;
 
-	data.timestamp = get_current_nano_time();
+	data.timestamp = sd->timestamp;
 	data.sensor = d->sensor.handle;
 	data.version = d->sensor.version;
 	data.type = d->sensor.type;
@@ -60,6 +60,8 @@ static struct wrapper_desc gyroscope = {
 		.init      = sensors_wrapper_init,
 		.activate  = sensors_wrapper_activate,
 		.set_delay = sensors_wrapper_set_delay,
+		.batch     = sensors_wrapper_batch,
+		.flush     = sensors_wrapper_flush,
 		.close     = sensors_wrapper_close,
 		.data      = gyroscope_data,
 	},
@@ -7,12 +7,14 @@
 #include "sensors_fifo.h"
 #include "sensors_id.h"
 #include "sensors_wrapper.h"
+#include "sensors_fusion.h"
 #include "sensor_util.h"
 #include "sensors_compass_API.h"
 #include "sensor_xyz.h"
 
 #define SENSOR_TYPE_ORIENTATION_BIT    (0)
 #define SENSOR_TYPE_MAGNETIC_FIELD_BIT (1)
+#define NUM_SENSORS                    (2)
 #define COMPASS_DELAY 25000000
 #define ACCURACY_HIGH_TH 110
 #define ACCURACY_MEDIUM_TH 130
@@ -22,6 +24,7 @@ static int ecompass_init(struct sensor_api_t *s);
 static int ecompass_activate(struct sensor_api_t *s, int enable);
 static int ecompass_delay(struct sensor_api_t *s, int64_t ns);
 static void ecompass_close(struct sensor_api_t *s);
+static void ecompass_queue(struct sensor_api_t *s, struct sensor_data_t *sd);
 static void ecompass_data(struct sensor_api_t *s, struct sensor_data_t *sd);
 
 struct engine_t {
@@ -29,6 +32,8 @@ struct engine_t {
 	int init; /* true, if has initialized*/
 	int init_ret;
 	int num_formations;
+	int64_t delay_requests[NUM_SENSORS];
+	struct sensors_fusion_t fusion;
 	struct wrapper_desc ecompass;
 	struct wrapper_desc compass;
 	struct wrapper_desc magnetometer;
@@ -38,6 +43,10 @@ static struct engine_t engine = {
 	.init = 0,
 	.init_ret = SENSOR_OK,
 	.num_formations = 1,
+	.delay_requests = {
+		NO_RATE,
+		NO_RATE,
+	},
 	.ecompass = {
 		.sensor = {
 			.name       = "ST ecompass internal",
@@ -50,7 +59,7 @@ static struct engine_t engine = {
 			.activate  = ecompass_activate,
 			.set_delay = ecompass_delay,
 			.close     = ecompass_close,
-			.data      = ecompass_data,
+			.data      = ecompass_queue,
 		},
 		.access = {
 			.match = {
@@ -122,6 +131,8 @@ static int ecompass_init(struct sensor_api_t *s)
 			return engine.init_ret;
 		}
 		compass_API_ChangeFormFactor(formation);
+		sensors_fusion_init(&engine.fusion, "ecompass", ecompass_data,
+				    &engine.ecompass.api);
 
 		engine.init_ret = sensors_wrapper_init(&engine.ecompass.api);
 		if (engine.init_ret < 0)
@@ -131,26 +142,54 @@ static int ecompass_init(struct sensor_api_t *s)
 	return engine.init_ret;
 }
 
-static int ecompass_activate(struct sensor_api_t *s, int enable)
+static int ecompass_sensor(struct sensor_api_t *s)
 {
 	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
-	int sensor;
 
 	if (d->sensor.type == SENSOR_TYPE_ORIENTATION)
-		sensor = SENSOR_TYPE_ORIENTATION_BIT;
+		return SENSOR_TYPE_ORIENTATION_BIT;
 	else
-		sensor = SENSOR_TYPE_MAGNETIC_FIELD_BIT;
+		return SENSOR_TYPE_MAGNETIC_FIELD_BIT;
+}
+
+/* run at the fastest rate of the active sensors, but compass should run
+   on at least 25ms according to STM */
+static int ecompass_update_rate(void)
+{
+	int64_t ns = COMPASS_DELAY;
+	int i;
+
+	for (i = 0; i < NUM_SENSORS; i++) {
+		if ((engine.enable_mask & (1 << i)) &&
+		    (engine.delay_requests[i] != NO_RATE) &&
+		    (engine.delay_requests[i] < ns))
+			ns = engine.delay_requests[i];
+	}
+
+	return sensors_wrapper_set_delay(&engine.ecompass.api, ns);
+}
+
+static int ecompass_activate(struct sensor_api_t *s, int enable)
+{
+	int sensor = ecompass_sensor(s);
+	int ret;
 
 	if (enable) {
-		if(engine.enable_mask > 0) {
+		/* the rate may have been requested before the enable */
+		if (engine.enable_mask > 0) {
 			engine.enable_mask |= (1 << sensor);
-			return 0;
+			return ecompass_update_rate();
 		}
 		engine.enable_mask |= (1 << sensor);
+		ret = sensors_wrapper_activate(&engine.ecompass.api, enable);
+		if (ret < 0)
+			return ret;
+		return ecompass_update_rate();
 	} else {
+		engine.delay_requests[sensor] = NO_RATE;
 		if ((engine.enable_mask & ~(1 << sensor)) != 0 ) {
 			engine.enable_mask &= ~(1 << sensor);
-			return 0;
+			return ecompass_update_rate();
 		}
 		engine.enable_mask &= ~(1 << sensor);
 	}
@@ -160,19 +199,25 @@ static int ecompass_activate(struct sensor_api_t *s, int enable)
 
 static int ecompass_delay(struct sensor_api_t *s, int64_t ns)
 {
-	/* compass should run on at least 25ms according to STM */
-	if (ns > COMPASS_DELAY)
-		ns = COMPASS_DELAY;
+	engine.delay_requests[ecompass_sensor(s)] = ns;
 
-	return sensors_wrapper_set_delay(&engine.ecompass.api, ns);
+	return ecompass_update_rate();
 }
 
 static void ecompass_close(struct sensor_api_t *s)
 {
 	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
 
-	if (engine.enable_mask == 0)
+	if (engine.enable_mask == 0) {
 		sensors_wrapper_close(&engine.ecompass.api);
+		sensors_fusion_sync(&engine.fusion);
+	}
+}
+
+/* compass_API_Run is run on the fusion thread, see ecompass_data */
+static void ecompass_queue(struct sensor_api_t *s, struct sensor_data_t *sd)
+{
+	sensors_fusion_put(&engine.fusion, sd);
 }
 
 inline static int compass_status(int accuracy)
@@ -234,7 +279,7 @@ static void ecompass_data(struct sensor_api_t *s, struct sensor_data_t *sd)
 	accuracy = compass_API_GetCalibrationGodness();
 
 	if (engine.enable_mask & (1 << SENSOR_TYPE_ORIENTATION_BIT)) {
-		data.timestamp = get_current_nano_time();
+		data.timestamp = sd->timestamp;
 		data.sensor = engine.compass.sensor.handle;
 		data.version = engine.compass.sensor.version;
 		data.type = engine.compass.sensor.type;
@@ -243,7 +288,7 @@ static void ecompass_data(struct sensor_api_t *s, struct sensor_data_t *sd)
 	}
 	if (engine.enable_mask & (1 << SENSOR_TYPE_MAGNETIC_FIELD_BIT)) {
 		CalibFactor CalibrationData;
-		data.timestamp = get_current_nano_time();
+		data.timestamp = sd->timestamp;
 		data.sensor = engine.magnetometer.sensor.handle;
 		data.version = engine.magnetometer.sensor.version;
 		data.type = engine.magnetometer.sensor.type;
@@ -19,107 +19,307 @@
 #include <stdio.h>
 #include "sensors_log.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include "sensors_config.h"
 
 #define PRIMARY_CONFIG "/etc/dash.conf"
 #define SECONDARY_CONFIG "/etc/sensors.conf"
+#define ROOT_ENV "DASH_ROOT"
+
+/*
+ * Each line "<prefix>_<key> = <value>" becomes one entry holding the value
+ * as string, int, float and int array, so a get never parses. Entries are
+ * found through a hash table on prefix and key, and a handle is simply the
+ * position of the entry in the entries table.
+ */
+#define CONFIG_LINE_LEN		64
+#define CONFIG_BUCKETS_MIN	16
 
-#define MAX_STR_LEN 64
 struct config_entry_t {
-	char prefix[MAX_STR_LEN];
-	char key[MAX_STR_LEN];
-	char value[MAX_STR_LEN];
 	struct config_entry_t *next;
+	uint32_t hash;
+	int handle;
+	char *prefix;
+	char *key;
+	char *value;
+	int int_value;
+	float float_value;
+	int nr;
+	int *array;
 };
 
-static struct config_entry_t *config_list;
+static struct config_t {
+	struct config_entry_t **entries;
+	int nr_entries;
+	int max_entries;
+	struct config_entry_t **buckets;
+	unsigned int nr_buckets;
+	size_t bytes;
+	char root[CONFIG_ROOT_MAX];
+} config;
+
+static const char *config_env_root()
+{
+	const char *root = getenv(ROOT_ENV);
+
+	if (!root || strlen(root) >= CONFIG_ROOT_MAX)
+		return "";
 
-static void insert_entry(struct config_entry_t *entry)
+	return root;
+}
+
+static FILE *config_open_default()
 {
-	struct config_entry_t *p = config_list;
+	char path[CONFIG_ROOT_MAX + sizeof(SECONDARY_CONFIG)];
+	FILE *fp;
 
-	if (!config_list) {
-		config_list = entry;
-		config_list->next = NULL;
-		return;
-	}
+	snprintf(path, sizeof(path), "%s%s", config_env_root(), PRIMARY_CONFIG);
+	fp = fopen(path, "r");
+	if (fp)
+		return fp;
 
-	while (p) {
-		if (!p->next) {
-			p->next = entry;
-			p->next->next = NULL;
-			return;
-		}
-		p = p->next;
+	snprintf(path, sizeof(path), "%s%s", config_env_root(),
+		 SECONDARY_CONFIG);
+	return fopen(path, "r");
+}
+
+static uint32_t config_hash(const char *prefix, const char *key)
+{
+	/* FNV-1a, prefix and key separated by a zero byte */
+	uint32_t hash = 2166136261u;
+
+	for (; *prefix; prefix++)
+		hash = (hash ^ (unsigned char)*prefix) * 16777619u;
+	hash *= 16777619u;
+	for (; *key; key++)
+		hash = (hash ^ (unsigned char)*key) * 16777619u;
+
+	return hash;
+}
+
+static struct config_entry_t *config_lookup(const char *prefix,
+					    const char *key, uint32_t hash)
+{
+	struct config_entry_t *e;
+
+	if (!config.nr_buckets)
+		return NULL;
+
+	for (e = config.buckets[hash & (config.nr_buckets - 1)]; e;
+	     e = e->next) {
+		if (e->hash == hash && !strcmp(e->prefix, prefix) &&
+		    !strcmp(e->key, key))
+			return e;
 	}
+
+	return NULL;
 }
 
-static int parse_value(char *value, enum config_type_t type, void *out_value,
-		       unsigned int out_size)
+static int config_grow_buckets()
 {
-	switch (type) {
-	default:
+	struct config_entry_t **buckets;
+	unsigned int nr = config.nr_buckets ? config.nr_buckets * 2 :
+			  CONFIG_BUCKETS_MIN;
+	int i;
+
+	buckets = calloc(nr, sizeof(*buckets));
+	if (!buckets)
 		return -1;
 
-	case TYPE_STRING:
-	{
-		unsigned int bytes;
-		bytes = strlen(value) + 1;
-		if (out_size < bytes)
-			return -1;
+	for (i = 0; i < config.nr_entries; i++) {
+		struct config_entry_t *e = config.entries[i];
 
-		memcpy(out_value, value, bytes);
-		break;
+		e->next = buckets[e->hash & (nr - 1)];
+		buckets[e->hash & (nr - 1)] = e;
 	}
 
-	case TYPE_ARRAY_INT:
-	{
-		char *token;
-		char *saveptr;
-		unsigned int i = 0;
-		char restore[MAX_STR_LEN];
-		unsigned int bytes;
-		bytes = strlen(value) + 1;
-		if (MAX_STR_LEN < bytes)
-			return -1;
+	free(config.buckets);
+	config.bytes += (nr - config.nr_buckets) * sizeof(*buckets);
+	config.buckets = buckets;
+	config.nr_buckets = nr;
+
+	return 0;
+}
+
+static int config_grow_entries()
+{
+	struct config_entry_t **entries;
+	int max = config.max_entries ? config.max_entries * 2 :
+		  CONFIG_BUCKETS_MIN;
+
+	entries = realloc(config.entries, max * sizeof(*entries));
+	if (!entries)
+		return -1;
+
+	config.bytes += (max - config.max_entries) * sizeof(*entries);
+	config.entries = entries;
+	config.max_entries = max;
+
+	return 0;
+}
 
-		memcpy(restore, value, bytes);
-		token = strtok_r(value, ",", &saveptr);
-		while (token) {
-			((int*)out_value)[i] = atoi(token);
-			if (++i > out_size) {
-				memcpy(value, restore, bytes);
-				return -1;
-			}
-			token = strtok_r(NULL, ",", &saveptr);
+/* same splitting as strtok_r on ",", empty fields are skipped */
+static int parse_array(const char *value, int *array)
+{
+	int nr = 0;
+
+	while (*value) {
+		if (*value == ',') {
+			value++;
+			continue;
 		}
-		memcpy(value, restore, bytes);
-		break;
+		if (array)
+			array[nr] = atoi(value);
+		nr++;
+		value += strcspn(value, ",");
 	}
 
-	case TYPE_INT:
-		if (out_size < sizeof(int))
-			return -1;
+	return nr;
+}
 
-		*((int*)out_value) = atoi(value);
-		break;
+static int insert_entry(const char *prefix, int prefix_len, const char *key,
+			int key_len, const char *value, int value_len)
+{
+	struct config_entry_t *e;
+	int nr;
+	size_t size;
+	char *p;
+
+	/* one allocation: entry, int array, then the three strings */
+	nr = parse_array(value, NULL);
+	size = sizeof(*e) + nr * sizeof(int) + prefix_len + key_len +
+	       value_len + 3;
+	e = malloc(size);
+	if (!e)
+		return -1;
+
+	e->nr = nr;
+	e->array = (int *)(e + 1);
+	p = (char *)(e->array + nr);
+
+	e->prefix = p;
+	memcpy(p, prefix, prefix_len);
+	p[prefix_len] = '\0';
+	p += prefix_len + 1;
+
+	e->key = p;
+	memcpy(p, key, key_len);
+	p[key_len] = '\0';
+	p += key_len + 1;
+
+	e->value = p;
+	memcpy(p, value, value_len);
+	p[value_len] = '\0';
+
+	parse_array(e->value, e->array);
+	e->int_value = atoi(e->value);
+	e->float_value = strtof(e->value, NULL);
+	e->hash = config_hash(e->prefix, e->key);
+
+	/* like before, the first definition of a key wins */
+	if (config_lookup(e->prefix, e->key, e->hash)) {
+		ALOGW("%s: duplicate %s_%s ignored", __func__, e->prefix,
+		      e->key);
+		free(e);
+		return 0;
+	}
+
+	if ((config.nr_entries == config.max_entries &&
+	     config_grow_entries() < 0) ||
+	    ((unsigned int)config.nr_entries >= config.nr_buckets &&
+	     config_grow_buckets() < 0)) {
+		free(e);
+		return -1;
 	}
+
+	e->handle = config.nr_entries;
+	config.entries[config.nr_entries++] = e;
+	e->next = config.buckets[e->hash & (config.nr_buckets - 1)];
+	config.buckets[e->hash & (config.nr_buckets - 1)] = e;
+	config.bytes += size;
+
 	return 0;
 }
 
+/* returns 1 for an entry, 0 for a line to skip and -1 on a parse error */
+static int parse_line(char *buf)
+{
+	char *prefix, *key, *value;
+	int prefix_len, key_len, value_len;
+
+	if (buf[0] == '#' || buf[0] == ' ' || buf[0] == '\n' ||
+	    buf[0] == '\0')
+		return 0;
+
+	prefix = buf;
+	prefix_len = strcspn(prefix, "_");
+	if (!prefix_len || prefix[prefix_len] != '_')
+		return -1;
+
+	key = prefix + prefix_len + 1;
+	key_len = strcspn(key, " =");
+	if (!key_len || !key[key_len])
+		return -1;
+
+	value = key + key_len + strspn(key + key_len, " =");
+	value_len = strcspn(value, "\n");
+	if (!value_len)
+		return -1;
+
+	if (insert_entry(prefix, prefix_len, key, key_len, value,
+			 value_len) < 0)
+		return -2;
+
+	return 1;
+}
+
+/* reads one line of any length, the buffer is grown as needed */
+static char *read_line(FILE *fp, char **buf, size_t *size)
+{
+	size_t len = 0;
+	char *p;
+
+	if (!*buf) {
+		*size = CONFIG_LINE_LEN;
+		*buf = malloc(*size);
+		if (!*buf)
+			return NULL;
+	}
+
+	while (fgets(*buf + len, *size - len, fp)) {
+		len += strlen(*buf + len);
+		if (len && (*buf)[len - 1] == '\n')
+			return *buf;
+
+		if (len + 1 == *size) {
+			p = realloc(*buf, *size * 2);
+			if (!p)
+				return NULL;
+			*buf = p;
+			*size *= 2;
+		}
+	}
+
+	return len ? *buf : NULL;
+}
+
 int sensors_config_read(char* filename)
 {
 	FILE *fp;
-	char buf[64];
+	char *buf = NULL;
+	size_t size = 0;
+	struct timespec start, end;
 	int retval = 0;
+	int rc;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	if (filename) {
 		fp = fopen(filename, "r");
 	} else {
-		fp = fopen(PRIMARY_CONFIG, "r");
-		if (!fp)
-			fp = fopen(SECONDARY_CONFIG, "r");
+		fp = config_open_default();
 	}
 
 	if (!fp) {
@@ -127,36 +327,32 @@ int sensors_config_read(char* filename)
 		return -1;
 	}
 
-	while (fgets(buf, sizeof(buf), fp)) {
-		struct config_entry_t *new_entry;
-
-		if (buf[0] == '#')
-			continue;
-
-		new_entry = malloc(sizeof(*new_entry));
-
-		if (!new_entry) {
-			retval = -1;
-			goto exit;
-		}
-
-		/* Arguments have length MAX_STR_LEN=64 */
-		if (sscanf(buf, "%64[^_]_%64[^ =]%*[ =]"
-			"%64[^\n]", new_entry->prefix,
-			new_entry->key, new_entry->value) == 3) {
-			insert_entry(new_entry);
-		} else if (sscanf(buf, "%64[^ \n]", new_entry->prefix) == 1) {
+	while (read_line(fp, &buf, &size)) {
+		rc = parse_line(buf);
+		if (rc == -1) {
 			ALOGE("Parse error: %s", buf);
-			free(new_entry);
 			sensors_config_destroy();
 			retval = -1;
-		} else {
-			free(new_entry);
+			goto exit;
+		} else if (rc < 0) {
+			retval = -1;
+			goto exit;
 		}
-
 	}
 
+	if (sensors_config_get_key("dash", "root", TYPE_STRING, config.root,
+				   sizeof(config.root)) < 0)
+		config.root[0] = '\0';
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ALOGI("%s: %d entries parsed in %ld us, %zu bytes", __func__,
+	      config.nr_entries,
+	      (long)((end.tv_sec - start.tv_sec) * 1000000 +
+		     (end.tv_nsec - start.tv_nsec) / 1000),
+	      config.bytes);
+
 exit:
+	free(buf);
 	fclose(fp);
 
 	return retval;
@@ -164,33 +360,87 @@ exit:
 
 int sensors_have_config_file()
 {
-	return (config_list != NULL);
+	return (config.nr_entries != 0);
 }
 
-int sensors_config_get_key(char* prefix, char* key, enum config_type_t type,
-			   void *out_value, int out_size)
+int sensors_config_get_handle(char* prefix, char* key)
 {
-	struct config_entry_t *p = config_list;
+	struct config_entry_t *e;
 
-	while (p) {
-		if ((strncmp(p->prefix, prefix, strlen(p->prefix)) == 0) &&
-		    (strncmp(p->key, key, strlen(p->key)) == 0)) {
-		    return parse_value(p->value, type, out_value, out_size);
-		}
-		p = p->next;
+	e = config_lookup(prefix, key, config_hash(prefix, key));
+
+	return e ? e->handle : -1;
+}
+
+int sensors_config_get_value(int handle, enum config_type_t type,
+			     void *out_value, int out_size)
+{
+	struct config_entry_t *e;
+
+	if (handle < 0 || handle >= config.nr_entries)
+		return -1;
+	e = config.entries[handle];
+
+	switch (type) {
+	default:
+		return -1;
+
+	case TYPE_STRING:
+	{
+		unsigned int bytes;
+		bytes = strlen(e->value) + 1;
+		if ((unsigned int)out_size < bytes)
+			return -1;
+
+		memcpy(out_value, e->value, bytes);
+		break;
 	}
-	return -1;
+
+	case TYPE_ARRAY_INT:
+		if (e->nr > out_size)
+			return -1;
+
+		memcpy(out_value, e->array, e->nr * sizeof(int));
+		break;
+
+	case TYPE_INT:
+		if ((unsigned int)out_size < sizeof(int))
+			return -1;
+
+		*((int*)out_value) = e->int_value;
+		break;
+
+	case TYPE_FLOAT:
+		if ((unsigned int)out_size < sizeof(float))
+			return -1;
+
+		*((float*)out_value) = e->float_value;
+		break;
+	}
+	return 0;
+}
+
+int sensors_config_get_key(char* prefix, char* key, enum config_type_t type,
+			   void *out_value, int out_size)
+{
+	return sensors_config_get_value(sensors_config_get_handle(prefix, key),
+					type, out_value, out_size);
 }
 
 void sensors_config_destroy()
 {
-	struct config_entry_t *p = config_list;
-	struct config_entry_t *p_next;
+	int i;
 
-	while (p) {
-		p_next = p->next;
-		free(p);
-		p = p_next;
-	}
+	for (i = 0; i < config.nr_entries; i++)
+		free(config.entries[i]);
+	free(config.entries);
+	free(config.buckets);
+	memset(&config, 0, sizeof(config));
 }
 
+const char *sensors_config_get_root()
+{
+	const char *root = config_env_root();
+
+	return *root ? root : config.root;
+}
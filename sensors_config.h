@@ -20,13 +20,32 @@
 enum config_type_t {
 	TYPE_STRING,
 	TYPE_ARRAY_INT,
-	TYPE_INT
+	TYPE_INT,
+	TYPE_FLOAT
 };
 
+/*
+ * Values are parsed once when the file is read. Drivers reading the same
+ * key repeatedly can resolve it to a handle with sensors_config_get_handle
+ * and fetch it with sensors_config_get_value. For TYPE_ARRAY_INT out_size
+ * is the number of elements, for the other types it is in bytes.
+ */
 int sensors_have_config_file();
 int sensors_config_read(char* filename);
+int sensors_config_get_handle(char* prefix, char* key);
+int sensors_config_get_value(int handle, enum config_type_t type,
+			     void *out_value, int out_size);
 int sensors_config_get_key(char* prefix, char* key, enum config_type_t type,
 			   void *out_value, int out_size);
 void sensors_config_destroy();
 
+/*
+ * Directory all device, sysfs and config paths are looked up below, "" for
+ * the real root. It is taken from the DASH_ROOT environment variable, which
+ * also moves the config file, or else from dash_root in the config file.
+ */
+#define CONFIG_ROOT_MAX		128
+
+const char *sensors_config_get_root();
+
 #endif
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DASH - epoll"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include "sensors_log.h"
+#include "sensors_config.h"
+#include "sensors_epoll.h"
+
+/*
+ * One reactor shared by all interrupt driven sensors. A small pool of
+ * threads waits on a single epoll set holding every attached input fd.
+ * Changes to the set take effect in epoll_wait right away, so unlike the
+ * old select threads no control pipe is needed to kick the waiters.
+ *
+ * The pool is started on first attach and then lives as long as the HAL.
+ * Its size is read from the config file (epoll_threads).
+ *
+ * Sources are kept in chunks allocated as sensors attach. A chunk never
+ * moves, so the reactor threads look sources up without the mutex.
+ */
+#define EPOLL_CHUNK_SOURCES	32
+#define EPOLL_MAX_CHUNKS	32
+#define EPOLL_MAX_EVENTS	8
+#define EPOLL_THREADS_DEFAULT	1
+#define EPOLL_THREADS_MAX	4
+
+struct epoll_source {
+	sensors_epoll_handler_t handler;
+	void *arg;
+};
+
+static struct sensors_epoll_t {
+	pthread_mutex_t mutex;
+	int epfd;
+	int nr_threads;
+	uint32_t flags;
+	pthread_t threads[EPOLL_THREADS_MAX];
+	int nr_chunks;
+	struct epoll_source *chunks[EPOLL_MAX_CHUNKS];
+} reactor = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.epfd = -1,
+};
+
+static inline uint64_t epoll_key(int id, uint32_t token)
+{
+	return ((uint64_t)token << 32) | (uint32_t)id;
+}
+
+/* only valid for an id handed out by sensors_epoll_attach() */
+static inline struct epoll_source *epoll_source(int id)
+{
+	struct epoll_source *chunk;
+
+	chunk = __atomic_load_n(&reactor.chunks[id / EPOLL_CHUNK_SOURCES],
+				__ATOMIC_ACQUIRE);
+
+	return &chunk[id % EPOLL_CHUNK_SOURCES];
+}
+
+static void *sensors_epoll_loop(void *arg)
+{
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+	int i, n;
+
+	while (1) {
+		n = epoll_wait(reactor.epfd, events, EPOLL_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ALOGE("%s: epoll_wait failed: %s", __func__,
+			      strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			int id = (int)(events[i].data.u64 & 0xffffffff);
+			uint32_t token = events[i].data.u64 >> 32;
+			struct epoll_source *src = epoll_source(id);
+			sensors_epoll_handler_t handler;
+
+			handler = __atomic_load_n(&src->handler,
+						  __ATOMIC_ACQUIRE);
+			if (handler)
+				handler(src->arg, token);
+		}
+	}
+
+	return NULL;
+}
+
+static int sensors_epoll_start()
+{
+	int threads;
+	int i;
+
+	if (sensors_config_get_key("epoll", "threads", TYPE_INT, &threads,
+				   sizeof(threads)) < 0)
+		threads = EPOLL_THREADS_DEFAULT;
+	if (threads < 1 || threads > EPOLL_THREADS_MAX) {
+		ALOGE("%s: epoll_threads out of bounds: %d", __func__, threads);
+		threads = EPOLL_THREADS_DEFAULT;
+	}
+
+	reactor.epfd = epoll_create(EPOLL_CHUNK_SOURCES);
+	if (reactor.epfd < 0) {
+		ALOGE("%s: epoll_create failed: %s", __func__, strerror(errno));
+		return -1;
+	}
+
+	/* one event must only be handled by one thread at a time */
+	reactor.flags = EPOLLIN | (threads > 1 ? EPOLLONESHOT : 0);
+
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&reactor.threads[i], NULL,
+				   sensors_epoll_loop, NULL))
+			break;
+	}
+	reactor.nr_threads = i;
+	if (!reactor.nr_threads) {
+		ALOGE("%s: unable to start reactor threads", __func__);
+		close(reactor.epfd);
+		reactor.epfd = -1;
+		return -1;
+	}
+
+	ALOGI("%s: started %d reactor thread(s)", __func__, reactor.nr_threads);
+	return 0;
+}
+
+/* returns a free source id, adding a chunk when all are taken */
+static int epoll_source_alloc()
+{
+	struct epoll_source *chunk;
+	int i, n = reactor.nr_chunks * EPOLL_CHUNK_SOURCES;
+
+	for (i = 0; i < n; i++) {
+		if (!epoll_source(i)->handler)
+			return i;
+	}
+
+	if (reactor.nr_chunks == EPOLL_MAX_CHUNKS) {
+		ALOGE("%s: out of epoll sources, max %d", __func__, n);
+		return -1;
+	}
+
+	chunk = calloc(EPOLL_CHUNK_SOURCES, sizeof(*chunk));
+	if (!chunk) {
+		ALOGE("%s: out of memory", __func__);
+		return -1;
+	}
+	__atomic_store_n(&reactor.chunks[reactor.nr_chunks++], chunk,
+			 __ATOMIC_RELEASE);
+
+	return n;
+}
+
+int sensors_epoll_attach(sensors_epoll_handler_t handler, void *arg)
+{
+	struct epoll_source *src;
+	int id = -1;
+
+	pthread_mutex_lock(&reactor.mutex);
+	if (!reactor.nr_threads && sensors_epoll_start() < 0)
+		goto exit;
+
+	id = epoll_source_alloc();
+	if (id < 0)
+		goto exit;
+
+	src = epoll_source(id);
+	src->arg = arg;
+	__atomic_store_n(&src->handler, handler, __ATOMIC_RELEASE);
+exit:
+	pthread_mutex_unlock(&reactor.mutex);
+
+	return id;
+}
+
+void sensors_epoll_detach(int id)
+{
+	pthread_mutex_lock(&reactor.mutex);
+	if (id >= 0 && id < reactor.nr_chunks * EPOLL_CHUNK_SOURCES)
+		__atomic_store_n(&epoll_source(id)->handler, NULL,
+				 __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&reactor.mutex);
+}
+
+static int sensors_epoll_ctl(int op, int id, int fd, uint32_t token)
+{
+	struct epoll_event ev;
+	int err;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = reactor.flags;
+	ev.data.u64 = epoll_key(id, token);
+	if (epoll_ctl(reactor.epfd, op, fd, &ev) < 0) {
+		err = errno;
+		ALOGE("%s: epoll_ctl(%d) failed for fd %d: %s", __func__, op,
+		      fd, strerror(err));
+		return -err;
+	}
+
+	return 0;
+}
+
+int sensors_epoll_add(int id, int fd, uint32_t token)
+{
+	return sensors_epoll_ctl(EPOLL_CTL_ADD, id, fd, token);
+}
+
+int sensors_epoll_rearm(int id, int fd, uint32_t token)
+{
+	if (!(reactor.flags & EPOLLONESHOT))
+		return 0;
+
+	return sensors_epoll_ctl(EPOLL_CTL_MOD, id, fd, token);
+}
+
+void sensors_epoll_remove(int fd)
+{
+	struct epoll_event ev;
+
+	/* event argument is ignored, but must be non-NULL on old kernels */
+	if (epoll_ctl(reactor.epfd, EPOLL_CTL_DEL, fd, &ev) < 0)
+		ALOGE("%s: epoll_ctl failed for fd %d: %s", __func__, fd,
+		      strerror(errno));
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_EPOLL_H_
+#define SENSORS_EPOLL_H_
+#include <stdint.h>
+
+/*
+ * Called from a reactor thread when an fd added with the given token is
+ * readable. With more than one reactor thread the fd is disarmed until
+ * the handler calls sensors_epoll_rearm().
+ */
+typedef void (*sensors_epoll_handler_t)(void *arg, uint32_t token);
+
+int sensors_epoll_attach(sensors_epoll_handler_t handler, void *arg);
+void sensors_epoll_detach(int id);
+int sensors_epoll_add(int id, int fd, uint32_t token);
+int sensors_epoll_rearm(int id, int fd, uint32_t token);
+void sensors_epoll_remove(int fd);
+
+#endif
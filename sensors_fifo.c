@@ -16,54 +16,352 @@
 #define LOG_TAG "DASH - fifo"
 
 #include "sensors_log.h"
+#include <stdlib.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "sensor_util.h"
+#include "sensors_config.h"
 #include "sensors_fifo.h"
+#include "sensors_metrics.h"
+#include "sensors_tracepoint.h"
 
-#define FIFO_LEN 8
+/*
+ * Events are queued in a number of lanes, each one a bounded ring buffer.
+ * Every producing thread (select or poll worker) is bound to one lane the
+ * first time it puts an event, so in the common case a lane has a single
+ * writer and the only reader is the poll thread. Slots carry a sequence
+ * number so a lane stays correct even when more threads than lanes exist
+ * and two producers have to share one.
+ *
+ * The poll thread only sleeps after it has found every lane empty, and
+ * producers only touch the mutex when somebody is sleeping, so the data
+ * path stays lock-free while no wakeup can get lost.
+ *
+ * Both the lane length and the number of lanes can be set in the config
+ * file using fifo_size and fifo_lanes.
+ */
+#define FIFO_LANE_LEN_DEFAULT	128
+#define FIFO_LANE_LEN_MAX	4096
+#define FIFO_LANES_DEFAULT	8
+#define FIFO_LANES_MAX		32
+
+struct fifo_slot {
+	uint32_t seq;
+	sensors_event_t event;
+};
+
+struct fifo_lane {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t overruns;
+	struct fifo_slot *slots;
+} __attribute__((aligned(64)));
 
 static struct sensors_fifo_t {
 	pthread_mutex_t mutex;
 	pthread_cond_t data_cond;
+	pthread_key_t lane_key;
+
+	uint32_t mask;
+	unsigned int nr_lanes;
+	unsigned int next_lane;
+	unsigned int first_lane;
+	uint32_t reported_overruns;
+	struct fifo_lane *lanes;
 
-	int fifo_i;
-	sensors_event_t fifo[FIFO_LEN];
+	unsigned int waiters;
+	int64_t wake_ns;
+	struct sensors_fifo_wakeup_stats wakeup;
 } sensors_fifo;
 
+static unsigned int sensors_fifo_config(char *key, unsigned int def,
+					unsigned int max)
+{
+	int value;
+
+	if (sensors_config_get_key("fifo", key, TYPE_INT, &value,
+				   sizeof(value)) < 0)
+		return def;
+
+	if (value < 1 || (unsigned int)value > max) {
+		ALOGE("%s: fifo_%s out of bounds: %d\n", __func__, key, value);
+		return def;
+	}
+
+	return value;
+}
+
 void sensors_fifo_init()
 {
+	unsigned int len;
+	unsigned int size = 1;
+	unsigned int i, j;
+
 	pthread_mutex_init(&sensors_fifo.mutex, NULL);
 	pthread_cond_init(&sensors_fifo.data_cond, NULL);
+	pthread_key_create(&sensors_fifo.lane_key, NULL);
+
+	/* lane length has to be a power of two for the index mask */
+	len = sensors_fifo_config("size", FIFO_LANE_LEN_DEFAULT,
+				  FIFO_LANE_LEN_MAX);
+	while (size < len)
+		size <<= 1;
+
+	sensors_fifo.nr_lanes = sensors_fifo_config("lanes", FIFO_LANES_DEFAULT,
+						    FIFO_LANES_MAX);
+	sensors_fifo.mask = size - 1;
+	sensors_fifo.lanes = calloc(sensors_fifo.nr_lanes,
+				    sizeof(*sensors_fifo.lanes));
+	if (!sensors_fifo.lanes) {
+		ALOGE("%s: unable to allocate fifo lanes", __func__);
+		return;
+	}
+
+	for (i = 0; i < sensors_fifo.nr_lanes; i++) {
+		struct fifo_lane *lane = &sensors_fifo.lanes[i];
+
+		lane->slots = malloc(size * sizeof(*lane->slots));
+		if (!lane->slots) {
+			ALOGE("%s: unable to allocate fifo lane %u", __func__,
+			      i);
+			sensors_fifo.nr_lanes = i;
+			break;
+		}
+		for (j = 0; j < size; j++)
+			lane->slots[j].seq = j;
+	}
+
+	ALOGI("%s: %u lanes of %u events", __func__, sensors_fifo.nr_lanes,
+	      size);
 }
 
 void sensors_fifo_deinit()
 {
+	unsigned int i;
+	struct fifo_lane *lanes = sensors_fifo.lanes;
+
+	sensors_fifo.lanes = NULL;
+	if (lanes) {
+		for (i = 0; i < sensors_fifo.nr_lanes; i++)
+			free(lanes[i].slots);
+		free(lanes);
+	}
+	sensors_fifo.nr_lanes = 0;
+
+	pthread_key_delete(sensors_fifo.lane_key);
 	pthread_mutex_destroy(&sensors_fifo.mutex);
 }
 
+static struct fifo_lane *sensors_fifo_lane()
+{
+	struct fifo_lane *lane = pthread_getspecific(sensors_fifo.lane_key);
+	unsigned int i;
+
+	if (lane)
+		return lane;
+
+	i = __atomic_fetch_add(&sensors_fifo.next_lane, 1, __ATOMIC_RELAXED);
+	lane = &sensors_fifo.lanes[i % sensors_fifo.nr_lanes];
+	pthread_setspecific(sensors_fifo.lane_key, lane);
+
+	return lane;
+}
+
+static int lane_put(struct fifo_lane *lane, sensors_event_t *data)
+{
+	struct fifo_slot *slot;
+	uint32_t pos = __atomic_load_n(&lane->head, __ATOMIC_RELAXED);
+	uint32_t seq;
+	int32_t diff;
+
+	for (;;) {
+		slot = &lane->slots[pos & sensors_fifo.mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t)(seq - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&lane->head, &pos,
+					pos + 1, 1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return -1;
+		} else {
+			pos = __atomic_load_n(&lane->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->event = *data;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int lane_get(struct fifo_lane *lane, sensors_event_t *data)
+{
+	uint32_t pos = lane->tail;
+	struct fifo_slot *slot = &lane->slots[pos & sensors_fifo.mask];
+	uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+	if ((int32_t)(seq - (pos + 1)) < 0)
+		return -1;
+
+	*data = slot->event;
+	__atomic_store_n(&slot->seq, pos + sensors_fifo.mask + 1,
+			 __ATOMIC_RELEASE);
+	lane->tail = pos + 1;
+
+	return 0;
+}
+
 void sensors_fifo_put(sensors_event_t *data)
 {
-	pthread_mutex_lock(&sensors_fifo.mutex);
+	struct fifo_lane *lane;
+
+	if (!sensors_fifo.nr_lanes)
+		return;
 
-	if (sensors_fifo.fifo_i < FIFO_LEN)
-		sensors_fifo.fifo[sensors_fifo.fifo_i++] = *data;
+	lane = sensors_fifo_lane();
+	if (lane_put(lane, data) < 0) {
+		__atomic_fetch_add(&lane->overruns, 1, __ATOMIC_RELAXED);
+		sensors_metrics_add(data->sensor, METRIC_DROPS, 1);
+		return;
+	}
+	if (data->type != SENSOR_TYPE_META_DATA) {
+		sensors_metrics_add(data->sensor, METRIC_FRAMES, 1);
+		TRACEPOINT(TP_PUT, data->sensor, data->timestamp, 0);
+	}
 
+	/* pairs with the fence in sensors_fifo_wait_get */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&sensors_fifo.waiters, __ATOMIC_RELAXED))
+		return;
+
+	pthread_mutex_lock(&sensors_fifo.mutex);
+	if (!sensors_fifo.wake_ns)
+		sensors_fifo.wake_ns = get_current_nano_time();
 	pthread_cond_broadcast(&sensors_fifo.data_cond);
 	pthread_mutex_unlock(&sensors_fifo.mutex);
 }
 
-int sensors_fifo_get_all(sensors_event_t *data, int len)
+unsigned int sensors_fifo_get_overruns()
+{
+	unsigned int i;
+	uint32_t overruns = 0;
+
+	for (i = 0; i < sensors_fifo.nr_lanes; i++)
+		overruns += __atomic_load_n(&sensors_fifo.lanes[i].overruns,
+					    __ATOMIC_RELAXED);
+
+	return overruns;
+}
+
+static int sensors_fifo_drain(sensors_event_t *data, int len)
+{
+	unsigned int first = sensors_fifo.first_lane;
+	unsigned int i;
+	uint32_t overruns;
+	int n = 0;
+
+	/* rotate the starting lane so a short read can't starve a lane */
+	for (i = 0; i < sensors_fifo.nr_lanes && n < len; i++) {
+		struct fifo_lane *lane;
+
+		lane = &sensors_fifo.lanes[(first + i) % sensors_fifo.nr_lanes];
+		while (n < len && !lane_get(lane, &data[n]))
+			n++;
+	}
+	if (sensors_fifo.nr_lanes)
+		sensors_fifo.first_lane = (first + 1) % sensors_fifo.nr_lanes;
+
+	overruns = sensors_fifo_get_overruns();
+	if (overruns != sensors_fifo.reported_overruns) {
+		ALOGW("%s: %u events dropped on full fifo", __func__,
+		      overruns - sensors_fifo.reported_overruns);
+		sensors_fifo.reported_overruns = overruns;
+	}
+
+	return n;
+}
+
+static void sensors_fifo_account_wakeup()
 {
-	int i;
+	struct sensors_fifo_wakeup_stats *w = &sensors_fifo.wakeup;
+	int64_t latency;
+
+	if (!sensors_fifo.wake_ns)
+		return;
+
+	latency = get_current_nano_time() - sensors_fifo.wake_ns;
+	sensors_fifo.wake_ns = 0;
+
+	w->count++;
+	w->last_ns = latency;
+	w->total_ns += latency;
+	if (latency > w->max_ns)
+		w->max_ns = latency;
+	DASH_LOGV("%s: woke up %lld ns after put", __func__, latency);
+}
+
+static int sensors_fifo_sleep(int64_t timeout_ns, struct timespec *deadline)
+{
+	if (timeout_ns < 0)
+		return pthread_cond_wait(&sensors_fifo.data_cond,
+					 &sensors_fifo.mutex);
+
+	return pthread_cond_timedwait(&sensors_fifo.data_cond,
+				      &sensors_fifo.mutex, deadline);
+}
+
+int sensors_fifo_wait_get(sensors_event_t *data, int len, int64_t timeout_ns)
+{
+	struct timespec deadline;
+	int n;
+
+	n = sensors_fifo_drain(data, len);
+	if (n || !timeout_ns)
+		return n;
+
+	if (timeout_ns > 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ns / 1000000000LL;
+		deadline.tv_nsec += timeout_ns % 1000000000LL;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
 
-	/* This function deliberately drops all packets above len. */
 	pthread_mutex_lock(&sensors_fifo.mutex);
-	pthread_cond_wait(&sensors_fifo.data_cond, &sensors_fifo.mutex);
+	__atomic_fetch_add(&sensors_fifo.waiters, 1, __ATOMIC_RELAXED);
+	/* pairs with the fence in sensors_fifo_put */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-	for (i = 0; (i < sensors_fifo.fifo_i) && (i < len); i++)
-		data[i] = sensors_fifo.fifo[i];
-	sensors_fifo.fifo_i = 0;
+	while (!(n = sensors_fifo_drain(data, len))) {
+		if (sensors_fifo_sleep(timeout_ns, &deadline) == ETIMEDOUT) {
+			n = sensors_fifo_drain(data, len);
+			break;
+		}
+	}
+	if (n)
+		sensors_fifo_account_wakeup();
+
+	__atomic_fetch_sub(&sensors_fifo.waiters, 1, __ATOMIC_RELAXED);
 	pthread_mutex_unlock(&sensors_fifo.mutex);
 
-	return i;
+	return n;
+}
+
+int sensors_fifo_get_all(sensors_event_t *data, int len)
+{
+	return sensors_fifo_wait_get(data, len, -1);
 }
 
+void sensors_fifo_get_wakeup_stats(struct sensors_fifo_wakeup_stats *stats)
+{
+	pthread_mutex_lock(&sensors_fifo.mutex);
+	*stats = sensors_fifo.wakeup;
+	pthread_mutex_unlock(&sensors_fifo.mutex);
+}
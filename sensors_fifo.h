@@ -18,9 +18,20 @@
 #define SENSORS_FIFO_H_
 #include <hardware/sensors.h>
 
+/* Delay from a put that woke the poll thread until it ran again. */
+struct sensors_fifo_wakeup_stats {
+	unsigned int count;
+	int64_t last_ns;
+	int64_t max_ns;
+	int64_t total_ns;
+};
+
 void sensors_fifo_init();
 void sensors_fifo_deinit();
 void sensors_fifo_put(sensors_event_t *data);
 int sensors_fifo_get_all(sensors_event_t *data, int len);
+int sensors_fifo_wait_get(sensors_event_t *data, int len, int64_t timeout_ns);
+void sensors_fifo_get_wakeup_stats(struct sensors_fifo_wakeup_stats *stats);
+unsigned int sensors_fifo_get_overruns();
 
 #endif
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "DASH - frame"
+
+#include "sensors_log.h"
+#include <string.h>
+#include <hardware/sensors.h>
+#include "sensors_frame.h"
+
+/*
+ * A frame at time T is emitted once every input has a sample at or after
+ * T, so each one can be interpolated. An input still behind T is only
+ * waited for until another input is a full period past T, then it holds
+ * its latest sample. The engine on the other side thus runs exactly once
+ * per period, on inputs of one point in time.
+ */
+#define FRAME_MASK	(FRAME_HISTORY - 1)
+/* periods of frames skipped rather than emitted after a gap */
+#define FRAME_MAX_LAG	4
+
+void sensors_frame_init(struct sensors_frame_t *fr, const int *types, int nr,
+			int64_t period, sensors_frame_func_t func)
+{
+	int i;
+
+	if (nr > FRAME_MAX_INPUTS) {
+		ALOGE("%s: %d inputs, max %d", __func__, nr, FRAME_MAX_INPUTS);
+		nr = FRAME_MAX_INPUTS;
+	}
+
+	memset(fr, 0, sizeof(*fr));
+	for (i = 0; i < nr; i++)
+		fr->input[i].type = types[i];
+	fr->nr_inputs = nr;
+	fr->period = period;
+	fr->func = func;
+}
+
+void sensors_frame_reset(struct sensors_frame_t *fr)
+{
+	int i;
+
+	for (i = 0; i < fr->nr_inputs; i++)
+		fr->input[i].nr = 0;
+	fr->next = 0;
+	fr->newest = 0;
+}
+
+/* the history is kept, frames restart from the newest common sample */
+void sensors_frame_set_period(struct sensors_frame_t *fr, int64_t period)
+{
+	fr->period = period;
+	fr->next = 0;
+}
+
+static inline int64_t frame_latest(struct frame_input *in)
+{
+	return in->t[(in->nr - 1) & FRAME_MASK];
+}
+
+static void frame_sample(struct frame_input *in, int64_t t, float *v,
+			 int *status)
+{
+	unsigned int n = in->nr < FRAME_HISTORY ? in->nr : FRAME_HISTORY;
+	unsigned int i, j, k;
+	float w;
+	int a;
+
+	/* newest sample at or before t */
+	for (i = 1; i <= n; i++) {
+		j = (in->nr - i) & FRAME_MASK;
+		if (in->t[j] <= t)
+			break;
+	}
+
+	if (i > n || i == 1) {
+		/* t outside of the history, hold the closest sample */
+		j = (in->nr - (i > n ? n : 1)) & FRAME_MASK;
+		memcpy(v, in->v[j], sizeof(in->v[j]));
+		*status = in->status[j];
+		return;
+	}
+
+	k = (j + 1) & FRAME_MASK;
+	w = (float)(t - in->t[j]) / (float)(in->t[k] - in->t[j]);
+	for (a = 0; a < FRAME_AXIS; a++)
+		v[a] = in->v[j][a] + (in->v[k][a] - in->v[j][a]) * w;
+	*status = in->status[k];
+}
+
+static int frame_start(struct sensors_frame_t *fr)
+{
+	int64_t t = 0;
+	int i;
+
+	for (i = 0; i < fr->nr_inputs; i++) {
+		if (!fr->input[i].nr)
+			return 0;
+		if (frame_latest(&fr->input[i]) > t)
+			t = frame_latest(&fr->input[i]);
+	}
+	fr->next = t;
+
+	return 1;
+}
+
+static int frame_ready(struct sensors_frame_t *fr)
+{
+	int i;
+
+	for (i = 0; i < fr->nr_inputs; i++) {
+		if (frame_latest(&fr->input[i]) < fr->next)
+			return fr->newest >= fr->next + fr->period;
+	}
+
+	return 1;
+}
+
+void sensors_frame_put(struct sensors_frame_t *fr, struct sensor_data_t *sd)
+{
+	struct frame_input *in = NULL;
+	struct frame_data frame;
+	unsigned int j;
+	int i, a;
+
+	for (i = 0; i < fr->nr_inputs; i++) {
+		if (fr->input[i].type == sd->sensor->type) {
+			in = &fr->input[i];
+			break;
+		}
+	}
+	if (!in) {
+		ALOGE("%s: %s is not an input", __func__, sd->sensor->name);
+		return;
+	}
+
+	if (in->nr && sd->timestamp <= frame_latest(in)) {
+		if (sd->timestamp == frame_latest(in))
+			return;
+		ALOGW("%s: %s went back in time, restarting", __func__,
+		      sd->sensor->name);
+		sensors_frame_reset(fr);
+	}
+
+	j = in->nr++ & FRAME_MASK;
+	in->t[j] = sd->timestamp;
+	in->status[j] = sd->status;
+	for (a = 0; a < FRAME_AXIS; a++)
+		in->v[j][a] = sd->data[a] * sd->scale;
+	if (sd->timestamp > fr->newest)
+		fr->newest = sd->timestamp;
+
+	if (!fr->next && !frame_start(fr))
+		return;
+
+	if (fr->newest - fr->next > FRAME_MAX_LAG * fr->period) {
+		DASH_LOGV("%s: skipping %lld ns of frames", __func__,
+		      fr->newest - fr->next);
+		fr->next += (fr->newest - fr->next) / fr->period * fr->period;
+	}
+
+	while (frame_ready(fr)) {
+		frame.timestamp = fr->next;
+		for (i = 0; i < fr->nr_inputs; i++)
+			frame_sample(&fr->input[i], fr->next, frame.data[i],
+				     &frame.status[i]);
+		fr->next += fr->period;
+		fr->func(fr, &frame);
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_FRAME_H_
+#define SENSORS_FRAME_H_
+#include <stdint.h>
+#include "sensor_api.h"
+
+#define FRAME_MAX_INPUTS	3
+#define FRAME_AXIS		3
+/* samples kept per input, has to be a power of two */
+#define FRAME_HISTORY		8
+
+/* one aligned set of inputs, data in the order of the input types */
+struct frame_data {
+	int64_t timestamp;
+	float data[FRAME_MAX_INPUTS][FRAME_AXIS];
+	int status[FRAME_MAX_INPUTS];
+};
+
+struct frame_input {
+	int type;
+	unsigned int nr;
+	int64_t t[FRAME_HISTORY];
+	float v[FRAME_HISTORY][FRAME_AXIS];
+	int status[FRAME_HISTORY];
+};
+
+struct sensors_frame_t;
+typedef void (*sensors_frame_func_t)(struct sensors_frame_t *fr,
+				     struct frame_data *frame);
+
+/*
+ * Collects the samples of a number of sensors and calls func once per
+ * period with all of them at the same timestamp. An input is interpolated
+ * between the samples around the frame time, or holds its latest sample
+ * when it runs slower than the frames.
+ */
+struct sensors_frame_t {
+	int nr_inputs;
+	struct frame_input input[FRAME_MAX_INPUTS];
+	int64_t period;
+	int64_t next;
+	int64_t newest;
+	sensors_frame_func_t func;
+};
+
+void sensors_frame_init(struct sensors_frame_t *fr, const int *types, int nr,
+			int64_t period, sensors_frame_func_t func);
+void sensors_frame_reset(struct sensors_frame_t *fr);
+void sensors_frame_set_period(struct sensors_frame_t *fr, int64_t period);
+void sensors_frame_put(struct sensors_frame_t *fr, struct sensor_data_t *sd);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "DASH - fusion"
+
+#include "sensors_log.h"
+#include <string.h>
+#include <pthread.h>
+#include "sensor_util.h"
+#include "sensors_fusion.h"
+#include "sensors_tracepoint.h"
+
+/*
+ * Raw samples are copied into a ring by the data callback of the wrapped
+ * engine and the engine is run on the stage thread, so a slow fusion step
+ * no longer holds up the sensors feeding it. A full ring drops the new
+ * sample rather than blocking the producer.
+ *
+ * As in sensors_fifo, the stage thread only sleeps after it found the
+ * ring empty with waiters set, and the producer only takes the mutex when
+ * it is set.
+ */
+#define FUSION_MASK	(FUSION_QUEUE_LEN - 1)
+
+static inline int fusion_empty(struct sensors_fusion_t *f)
+{
+	return f->tail == __atomic_load_n(&f->head, __ATOMIC_ACQUIRE);
+}
+
+static int fusion_get(struct sensors_fusion_t *f, struct fusion_sample *s)
+{
+	uint32_t tail = f->tail;
+
+	if (tail == __atomic_load_n(&f->head, __ATOMIC_ACQUIRE))
+		return -1;
+
+	*s = f->ring[tail & FUSION_MASK];
+	__atomic_store_n(&f->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static void fusion_run(struct sensors_fusion_t *f, struct fusion_sample *s)
+{
+	struct sensors_fusion_stats *st = &f->stats;
+	struct sensor_data_t sd;
+	int64_t delay = get_current_nano_time() - s->queued;
+	unsigned int drops;
+
+	TRACEPOINT(TP_FUSION, s->sensor->handle, s->timestamp, 0);
+	pthread_mutex_lock(&f->mutex);
+	st->samples++;
+	st->total_ns += delay;
+	if (delay > st->max_ns)
+		st->max_ns = delay;
+	pthread_mutex_unlock(&f->mutex);
+
+	drops = __atomic_load_n(&f->drops, __ATOMIC_RELAXED);
+	if (drops != f->reported_drops) {
+		ALOGW("%s: %s: %u samples dropped on full queue", __func__,
+		      f->name, drops - f->reported_drops);
+		f->reported_drops = drops;
+	}
+
+	sd.sensor = s->sensor;
+	sd.data = s->data;
+	sd.size = FUSION_AXIS;
+	sd.scale = s->scale;
+	sd.status = s->status;
+	sd.delay = s->delay;
+	sd.timestamp = s->timestamp;
+	f->run(f->api, &sd);
+}
+
+static void *sensors_fusion_loop(void *arg)
+{
+	struct sensors_fusion_t *f = arg;
+	struct fusion_sample s;
+
+	while (1) {
+		while (!fusion_get(f, &s))
+			fusion_run(f, &s);
+
+		pthread_mutex_lock(&f->mutex);
+		__atomic_store_n(&f->waiters, 1, __ATOMIC_RELAXED);
+		/* pairs with the fence in sensors_fusion_put */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		while (fusion_empty(f)) {
+			pthread_cond_broadcast(&f->idle_cond);
+			pthread_cond_wait(&f->data_cond, &f->mutex);
+		}
+		__atomic_store_n(&f->waiters, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&f->mutex);
+	}
+
+	return NULL;
+}
+
+int sensors_fusion_init(struct sensors_fusion_t *f, const char *name,
+			sensors_fusion_run_t run, struct sensor_api_t *api)
+{
+	if (f->started)
+		return 0;
+
+	f->name = name;
+	f->run = run;
+	f->api = api;
+	f->head = f->tail = 0;
+	pthread_mutex_init(&f->mutex, NULL);
+	pthread_cond_init(&f->data_cond, NULL);
+	pthread_cond_init(&f->idle_cond, NULL);
+
+	if (pthread_create(&f->thread, NULL, sensors_fusion_loop, f)) {
+		ALOGE("%s: %s: unable to start thread, running inline",
+		      __func__, name);
+		return -1;
+	}
+	f->started = 1;
+
+	return 0;
+}
+
+void sensors_fusion_put(struct sensors_fusion_t *f, struct sensor_data_t *sd)
+{
+	struct fusion_sample *s;
+	uint32_t head = f->head;
+
+	if (!f->started) {
+		f->run(f->api, sd);
+		return;
+	}
+
+	if (head - __atomic_load_n(&f->tail, __ATOMIC_ACQUIRE) >=
+	    FUSION_QUEUE_LEN) {
+		__atomic_fetch_add(&f->drops, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	s = &f->ring[head & FUSION_MASK];
+	s->sensor = sd->sensor;
+	memcpy(s->data, sd->data, sizeof(s->data));
+	s->scale = sd->scale;
+	s->status = sd->status;
+	s->delay = sd->delay;
+	s->timestamp = sd->timestamp;
+	s->queued = get_current_nano_time();
+	__atomic_store_n(&f->head, head + 1, __ATOMIC_RELEASE);
+
+	/* pairs with the fence in sensors_fusion_loop */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&f->waiters, __ATOMIC_RELAXED))
+		return;
+
+	pthread_mutex_lock(&f->mutex);
+	pthread_cond_signal(&f->data_cond);
+	pthread_mutex_unlock(&f->mutex);
+}
+
+/* Waits until the queued samples have been run and logs the queue delay.
+   No new samples may be put meanwhile, e.g. after sensors_wrapper_close. */
+void sensors_fusion_sync(struct sensors_fusion_t *f)
+{
+	if (!f->started)
+		return;
+
+	pthread_mutex_lock(&f->mutex);
+	while (!__atomic_load_n(&f->waiters, __ATOMIC_RELAXED) ||
+	       !fusion_empty(f))
+		pthread_cond_wait(&f->idle_cond, &f->mutex);
+
+	ALOGI("%s: %s: %u samples, %u dropped, delay avg %lld max %lld ns",
+	      __func__, f->name, f->stats.samples,
+	      __atomic_load_n(&f->drops, __ATOMIC_RELAXED),
+	      f->stats.samples ? f->stats.total_ns / f->stats.samples : 0LL,
+	      f->stats.max_ns);
+	pthread_mutex_unlock(&f->mutex);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_FUSION_H_
+#define SENSORS_FUSION_H_
+#include <stdint.h>
+#include <pthread.h>
+#include <hardware/sensors.h>
+#include "sensor_api.h"
+
+/* queue length, has to be a power of two */
+#define FUSION_QUEUE_LEN	64
+#define FUSION_AXIS		3
+
+typedef void (*sensors_fusion_run_t)(struct sensor_api_t *s,
+				     struct sensor_data_t *sd);
+
+struct fusion_sample {
+	struct sensor_t *sensor;
+	int data[FUSION_AXIS];
+	float scale;
+	int status;
+	int delay;
+	int64_t timestamp;
+	int64_t queued;
+};
+
+/* Delay from a put until the engine started on the sample. */
+struct sensors_fusion_stats {
+	unsigned int samples;
+	int64_t max_ns;
+	int64_t total_ns;
+};
+
+/*
+ * A fusion stage runs a fusion or compass engine on its own thread.
+ * The wrapper serializes the data callbacks of one client, so the data
+ * callback feeding the queue is its single producer and the stage thread
+ * its single consumer.
+ */
+struct sensors_fusion_t {
+	const char *name;
+	sensors_fusion_run_t run;
+	struct sensor_api_t *api;
+
+	uint32_t head;
+	uint32_t tail;
+	unsigned int drops;
+	unsigned int reported_drops;
+	struct fusion_sample ring[FUSION_QUEUE_LEN];
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t data_cond;
+	pthread_cond_t idle_cond;
+	unsigned int waiters;
+	int started;
+	struct sensors_fusion_stats stats;
+};
+
+int sensors_fusion_init(struct sensors_fusion_t *f, const char *name,
+			sensors_fusion_run_t run, struct sensor_api_t *api);
+void sensors_fusion_put(struct sensors_fusion_t *f, struct sensor_data_t *sd);
+void sensors_fusion_sync(struct sensors_fusion_t *f);
+
+#endif
@@ -1,19 +1,41 @@
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/inotify.h>
 #include <dirent.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <linux/input.h>
 #include "sensors_log.h"
 #include "sensor_util.h"
 #include "sensor_util_list.h"
+#include "sensors_config.h"
+#include "sensors_epoll.h"
 #include "sensors_input_cache.h"
 
 #define MAX_EVENT_DRIVERS 100
 
+/*
+ * The name to event node map is stored in a file between boots. A stored
+ * entry is trusted if the name sysfs reports for its node still matches,
+ * which needs no device to be opened. On any mismatch the file is ignored
+ * and the devices are scanned. The location can be changed with the
+ * input_cache config parameter.
+ *
+ * All paths are below the root from sensors_config_get_root(). A node in a
+ * synthetic tree, a fifo or a plain file, has no evdev name, so its name
+ * is read from the sysfs name attribute instead.
+ */
+#define INPUT_CACHE_FILE	"/data/misc/sensors/dash_input_cache"
+#define INPUT_CACHE_MAGIC	"dash-input-cache 1"
+#define INPUT_SYSFS_DIR		"/sys/class/input/"
+#define INPUT_SYSFS_NAME	INPUT_SYSFS_DIR "event%d/device/name"
+
 static pthread_mutex_t util_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct input_dev_list {
@@ -24,6 +46,22 @@ struct input_dev_list {
 static struct list_node head;
 static int list_initialized;
 
+/* the cache file is written by a thread of its own, see cache_file_store */
+static int store_pending;
+static int store_running;
+
+struct input_listener {
+	char name[sizeof(((struct sensors_input_cache_entry_t *)0)->dev_name)];
+	sensors_input_notify_t notify;
+	void *arg;
+	struct input_listener *next;
+};
+
+static pthread_mutex_t listener_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct input_listener *listeners;
+static int watch_fd = -1;
+static int watch_id = -1;
+
 static void *close_input_dev_fd(void *arg)
 {
 	close((int) arg); /* pass by copy */
@@ -31,6 +69,235 @@ static void *close_input_dev_fd(void *arg)
 	return NULL;
 }
 
+static void cache_file_path(char *path, int len)
+{
+	if (sensors_config_get_key("input", "cache", TYPE_STRING, path,
+				   len) < 0)
+		snprintf(path, len, "%s%s", sensors_config_get_root(),
+			 INPUT_CACHE_FILE);
+}
+
+static int sysfs_read_name(int nr, char *name, int len)
+{
+	char path[CONFIG_ROOT_MAX + 64];
+	FILE *fp;
+	int rc = -1;
+
+	snprintf(path, sizeof(path), "%s" INPUT_SYSFS_NAME,
+		 sensors_config_get_root(), nr);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	if (fgets(name, len, fp)) {
+		name[strcspn(name, "\n")] = '\0';
+		rc = 0;
+	}
+	fclose(fp);
+
+	return rc;
+}
+
+static int sysfs_name_matches(const struct sensors_input_cache_entry_t *e)
+{
+	char name[sizeof(e->dev_name)];
+
+	if (sysfs_read_name(e->nr, name, sizeof(name)) < 0)
+		return 0;
+
+	return !strncmp(name, e->dev_name, sizeof(e->dev_name) - 1);
+}
+
+static void cache_file_drop()
+{
+	struct input_dev_list *temp;
+
+	while (head.n != &head) {
+		temp = container_of(head.n, struct input_dev_list, node);
+		node_del(&temp->node);
+		free(temp);
+	}
+}
+
+static int sysfs_count_events()
+{
+	char path[CONFIG_ROOT_MAX + sizeof(INPUT_SYSFS_DIR)];
+	DIR *dir;
+	struct dirent *item;
+	int n = 0;
+
+	snprintf(path, sizeof(path), "%s%s", sensors_config_get_root(),
+		 INPUT_SYSFS_DIR);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+
+	while ((item = readdir(dir)) != NULL)
+		if (!strncmp(item->d_name, INPUT_EVENT_BASENAME,
+			     sizeof(INPUT_EVENT_BASENAME) - 1))
+			n++;
+	closedir(dir);
+
+	return n;
+}
+
+/* returns the number of entries taken from the file, -1 if unusable */
+static int cache_file_load()
+{
+	char path[PATH_MAX];
+	char line[sizeof(INPUT_CACHE_MAGIC) + 1];
+	struct input_dev_list *temp;
+	FILE *fp;
+	int n = 0;
+
+	cache_file_path(path, sizeof(path));
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	if (!fgets(line, sizeof(line), fp) ||
+	    strncmp(line, INPUT_CACHE_MAGIC, sizeof(INPUT_CACHE_MAGIC) - 1))
+		goto stale;
+
+	while (1) {
+		temp = malloc(sizeof(*temp));
+		if (!temp)
+			goto stale;
+
+		memset(&temp->entry, 0, sizeof(temp->entry));
+		if (fscanf(fp, "%d %31[^\n]\n", &temp->entry.nr,
+			   temp->entry.dev_name) != 2) {
+			free(temp);
+			break;
+		}
+
+		if (!sysfs_name_matches(&temp->entry)) {
+			ALOGI("%s: event%d is no longer '%s'", __func__,
+			      temp->entry.nr, temp->entry.dev_name);
+			free(temp);
+			goto stale;
+		}
+
+		snprintf(temp->entry.event_path, sizeof(temp->entry.event_path),
+			 "%s%s%d", sensors_config_get_root(), INPUT_EVENT_PATH,
+			 temp->entry.nr);
+		node_add(&head, &temp->node);
+		n++;
+	}
+
+	/* a device missing from the file would never be looked up */
+	if (n != sysfs_count_events()) {
+		ALOGI("%s: device count changed", __func__);
+		goto stale;
+	}
+	fclose(fp);
+
+	return n;
+
+stale:
+	fclose(fp);
+	cache_file_drop();
+	return -1;
+}
+
+/* copy of the list taken under util_mutex, written without it */
+static struct sensors_input_cache_entry_t *cache_file_copy(int *n)
+{
+	struct sensors_input_cache_entry_t *entries;
+	struct list_node *member;
+	int i = 0;
+
+	for (member = head.n; member != &head; member = member->n)
+		i++;
+
+	entries = malloc((i + 1) * sizeof(*entries));
+	if (!entries)
+		return NULL;
+
+	*n = 0;
+	for (member = head.n; member != &head; member = member->n)
+		entries[(*n)++] = container_of(member, struct input_dev_list,
+					       node)->entry;
+
+	return entries;
+}
+
+static void cache_file_write(const struct sensors_input_cache_entry_t *e,
+			     int n)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 4];
+	FILE *fp;
+	int i;
+
+	cache_file_path(path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		ALOGD("%s: unable to write '%s'", __func__, tmp);
+		return;
+	}
+
+	fprintf(fp, "%s\n", INPUT_CACHE_MAGIC);
+	for (i = 0; i < n; i++)
+		fprintf(fp, "%d %.*s\n", e[i].nr,
+			(int)sizeof(e[i].dev_name) - 1, e[i].dev_name);
+
+	if (fclose(fp) || rename(tmp, path)) {
+		ALOGE("%s: unable to store '%s'", __func__, path);
+		unlink(tmp);
+	}
+}
+
+static void *cache_file_writer(void *arg)
+{
+	struct sensors_input_cache_entry_t *entries;
+	int n;
+
+	pthread_mutex_lock(&util_mutex);
+	while (store_pending) {
+		store_pending = 0;
+		entries = cache_file_copy(&n);
+		pthread_mutex_unlock(&util_mutex);
+
+		if (entries) {
+			cache_file_write(entries, n);
+			free(entries);
+		}
+
+		pthread_mutex_lock(&util_mutex);
+	}
+	store_running = 0;
+	pthread_mutex_unlock(&util_mutex);
+
+	return NULL;
+}
+
+/*
+ * Called with util_mutex held, often from the epoll reactor. The file is
+ * written by a short lived thread so neither the reactor nor the lookups
+ * wait for the file system. Changes made while it writes are picked up
+ * by the same thread.
+ */
+static void cache_file_store()
+{
+	pthread_attr_t attr;
+	pthread_t id;
+
+	store_pending = 1;
+	if (store_running)
+		return;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (!pthread_create(&id, &attr, cache_file_writer, NULL))
+		store_running = 1;
+	else
+		ALOGE("%s: unable to start the writer", __func__);
+	pthread_attr_destroy(&attr);
+}
+
 static struct input_dev_list *lookup(const char *name, const char *path)
 {
 	struct list_node *member;
@@ -49,94 +316,361 @@ static struct input_dev_list *lookup(const char *name, const char *path)
 	return NULL;
 }
 
-const struct sensors_input_cache_entry_t *sensors_input_cache_get(
-							const char *name)
+/* returns an open fd on success, the caller closes it */
+static int probe_input_dev(const char *d_name,
+			   struct sensors_input_cache_entry_t *entry)
+{
+	int fd;
+
+	snprintf(entry->event_path, sizeof(entry->event_path), "%s%s%s",
+		 sensors_config_get_root(), INPUT_EVENT_DIR, d_name);
+
+	/* make sure we have access, a fifo must not block the scan */
+	fd = open(entry->event_path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		ALOGE("%s: cant open %s", __func__, d_name);
+		return -1;
+	}
+
+	entry->nr = atoi(d_name + sizeof(INPUT_EVENT_BASENAME) - 1);
+
+	if (ioctl(fd, EVIOCGNAME(sizeof(entry->dev_name)),
+		  entry->dev_name) < 0 &&
+	    (errno != ENOTTY || sysfs_read_name(entry->nr, entry->dev_name,
+						sizeof(entry->dev_name)) < 0)) {
+		ALOGE("%s: cant get name from  %s", __func__, d_name);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* returns the entry of name if it was among the new devices */
+static const struct sensors_input_cache_entry_t *input_scan(const char *name)
 {
-	int rc;
 	int fd;
 	DIR *dir;
 	struct dirent * item;
-	struct list_node *member;
-	struct input_dev_list *temp;
+	struct input_dev_list *temp = NULL;
 	pthread_t id[MAX_EVENT_DRIVERS];
 	unsigned int i = 0;
 	unsigned int threads = 0;
+	unsigned int added = 0;
+	int64_t t;
 	const struct sensors_input_cache_entry_t *found = NULL;
+	char dir_path[CONFIG_ROOT_MAX + sizeof(INPUT_EVENT_DIR)];
 
-	pthread_mutex_lock(&util_mutex);
-	if (!list_initialized) {
-		node_init(&head);
-		list_initialized = 1;
-	}
-
-	temp = lookup(name, NULL);
-	if (temp) {
-		found = &temp->entry;
-		goto exit;
-	}
-
-	dir = opendir(INPUT_EVENT_DIR);
+	t = get_current_nano_time();
+	snprintf(dir_path, sizeof(dir_path), "%s%s", sensors_config_get_root(),
+		 INPUT_EVENT_DIR);
+	dir = opendir(dir_path);
 	if (!dir) {
-		ALOGE("%s: error opening '%s'\n", __func__,
-				INPUT_EVENT_DIR);
-		goto exit;
+		ALOGE("%s: error opening '%s'\n", __func__, dir_path);
+		return NULL;
 	}
 
 	while ((item = readdir(dir)) != NULL) {
+		char path[sizeof(dir_path) + NAME_MAX];
+
 		if (strncmp(item->d_name, INPUT_EVENT_BASENAME,
 		    sizeof(INPUT_EVENT_BASENAME) - 1) != 0) {
 			continue;
 		}
 
+		/* skip already cached entries */
+		snprintf(path, sizeof(path), "%s%s", dir_path, item->d_name);
+		if (lookup(NULL, path))
+			continue;
+
 		temp = (temp ? temp : malloc(sizeof(*temp)));
 		if (temp == NULL) {
 			ALOGE("%s: malloc error!\n", __func__);
 			break;
 		}
 
-		/* skip already cached entries */
-		snprintf(temp->entry.event_path, sizeof(temp->entry.event_path),
-			 "%s%s", INPUT_EVENT_DIR, item->d_name);
-		if (lookup(NULL, temp->entry.event_path))
-			continue;
-
-		/* make sure we have access */
-		fd = open(temp->entry.event_path, O_RDONLY);
-		if (fd < 0) {
-			ALOGE("%s: cant open %s", __func__,
-			     item->d_name);
+		fd = probe_input_dev(item->d_name, &temp->entry);
+		if (fd < 0)
 			continue;
-		}
-
-		rc = ioctl(fd, EVIOCGNAME(sizeof(temp->entry.dev_name)),
-				temp->entry.dev_name);
 
 		/* close in parallell to optimize boot time */
-		pthread_create(&id[threads++], NULL,
-				close_input_dev_fd, (void*) fd);
-
-		if (rc < 0) {
-			ALOGE("%s: cant get name from  %s", __func__,
-					item->d_name);
-			continue;
-		}
-
-		temp->entry.nr = atoi(item->d_name +
-				      sizeof(INPUT_EVENT_BASENAME) - 1);
+		if (threads < MAX_EVENT_DRIVERS)
+			pthread_create(&id[threads++], NULL,
+					close_input_dev_fd, (void*) fd);
+		else
+			close(fd);
 
 		node_add(&head, &temp->node);
-		if (!found && !strncmp(temp->entry.dev_name, name,
+		added++;
+		if (!found && name && !strncmp(temp->entry.dev_name, name,
 				       sizeof(temp->entry.dev_name) - 1))
 			found = &temp->entry;
 		temp = NULL;
 	}
 
 	closedir(dir);
+	free(temp);
 
 	for(i = 0; i < threads; ++i)
 		pthread_join(id[i], NULL);
 
-exit:
+	t = (get_current_nano_time() - t) / 1000;
+	ALOGI("%s: scanned %u new devices in %lld us", __func__, added, t);
+	if (added)
+		cache_file_store();
+
+	return found;
+}
+
+static void input_notify(const struct sensors_input_cache_entry_t *entry,
+			 int present)
+{
+	struct input_listener *l;
+
+	for (l = __atomic_load_n(&listeners, __ATOMIC_ACQUIRE); l; l = l->next)
+		if (!strncmp(l->name, entry->dev_name,
+			     sizeof(entry->dev_name) - 1))
+			l->notify(l->arg, entry, present);
+}
+
+static void input_dev_added(const char *d_name)
+{
+	struct sensors_input_cache_entry_t entry;
+	struct input_dev_list *temp;
+	char path[sizeof(entry.event_path)];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s%s%s", sensors_config_get_root(),
+		 INPUT_EVENT_DIR, d_name);
+
+	pthread_mutex_lock(&util_mutex);
+	if (lookup(NULL, path) || !(temp = malloc(sizeof(*temp)))) {
+		pthread_mutex_unlock(&util_mutex);
+		return;
+	}
+
+	/* ueventd may not have set the permissions yet, IN_ATTRIB follows */
+	fd = probe_input_dev(d_name, &temp->entry);
+	if (fd < 0) {
+		free(temp);
+		pthread_mutex_unlock(&util_mutex);
+		return;
+	}
+	close(fd);
+
+	node_add(&head, &temp->node);
+	entry = temp->entry;
+	cache_file_store();
 	pthread_mutex_unlock(&util_mutex);
+
+	ALOGI("%s: '%s' appeared at %s", __func__, entry.dev_name,
+	      entry.event_path);
+	input_notify(&entry, 1);
+}
+
+static void input_dev_removed(const char *d_name)
+{
+	struct sensors_input_cache_entry_t entry;
+	struct input_dev_list *temp;
+	char path[sizeof(entry.event_path)];
+
+	snprintf(path, sizeof(path), "%s%s%s", sensors_config_get_root(),
+		 INPUT_EVENT_DIR, d_name);
+
+	pthread_mutex_lock(&util_mutex);
+	temp = lookup(NULL, path);
+	if (!temp) {
+		pthread_mutex_unlock(&util_mutex);
+		return;
+	}
+	node_del(&temp->node);
+	entry = temp->entry;
+	free(temp);
+	cache_file_store();
+	pthread_mutex_unlock(&util_mutex);
+
+	ALOGI("%s: '%s' removed from %s", __func__, entry.dev_name,
+	      entry.event_path);
+	input_notify(&entry, 0);
+}
+
+/* takes a cached device whose node is gone out of the cache */
+static int input_take_missing(struct sensors_input_cache_entry_t *entry)
+{
+	struct list_node *member;
+	struct input_dev_list *temp;
+	int found = 0;
+
+	pthread_mutex_lock(&util_mutex);
+	for (member = head.n; member != &head; member = member->n) {
+		temp = container_of(member, struct input_dev_list, node);
+		if (access(temp->entry.event_path, F_OK)) {
+			node_del(&temp->node);
+			*entry = temp->entry;
+			free(temp);
+			cache_file_store();
+			found = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&util_mutex);
+
 	return found;
 }
+
+/* events were lost, so bring the cache back in line with the directory */
+static void input_rescan()
+{
+	struct sensors_input_cache_entry_t entry;
+	char path[CONFIG_ROOT_MAX + sizeof(INPUT_EVENT_DIR)];
+	struct dirent *item;
+	DIR *dir;
+
+	ALOGW("%s: inotify queue overflowed, rescanning", __func__);
+	while (input_take_missing(&entry)) {
+		ALOGI("%s: '%s' removed from %s", __func__, entry.dev_name,
+		      entry.event_path);
+		input_notify(&entry, 0);
+	}
+
+	snprintf(path, sizeof(path), "%s%s", sensors_config_get_root(),
+		 INPUT_EVENT_DIR);
+	dir = opendir(path);
+	if (!dir) {
+		ALOGE("%s: error opening '%s'", __func__, path);
+		return;
+	}
+	while ((item = readdir(dir)) != NULL) {
+		if (!strncmp(item->d_name, INPUT_EVENT_BASENAME,
+			     sizeof(INPUT_EVENT_BASENAME) - 1))
+			input_dev_added(item->d_name);
+	}
+	closedir(dir);
+}
+
+static void input_watch_handler(void *arg, uint32_t token)
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	ssize_t n;
+	char *p;
+
+	while ((n = read(watch_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + n; p += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)p;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				input_rescan();
+				continue;
+			}
+			if (!ev->len || strncmp(ev->name, INPUT_EVENT_BASENAME,
+					sizeof(INPUT_EVENT_BASENAME) - 1))
+				continue;
+
+			if (ev->mask & (IN_CREATE | IN_ATTRIB))
+				input_dev_added(ev->name);
+			else if (ev->mask & IN_DELETE)
+				input_dev_removed(ev->name);
+		}
+	}
+
+	sensors_epoll_rearm(watch_id, watch_fd, 0);
+}
+
+static void input_watch_start()
+{
+	char path[CONFIG_ROOT_MAX + sizeof(INPUT_EVENT_DIR)];
+
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch_fd < 0) {
+		ALOGE("%s: inotify_init failed: %s", __func__,
+		      strerror(errno));
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s%s", sensors_config_get_root(),
+		 INPUT_EVENT_DIR);
+	if (inotify_add_watch(watch_fd, path,
+			      IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+		ALOGE("%s: unable to watch '%s': %s", __func__, path,
+		      strerror(errno));
+		goto error;
+	}
+
+	watch_id = sensors_epoll_attach(input_watch_handler, NULL);
+	if (watch_id < 0)
+		goto error;
+
+	if (sensors_epoll_add(watch_id, watch_fd, 0) < 0) {
+		sensors_epoll_detach(watch_id);
+		goto error;
+	}
+
+	return;
+
+error:
+	close(watch_fd);
+	watch_fd = -1;
+}
+
+int sensors_input_cache_get(const char *name,
+			    struct sensors_input_cache_entry_t *entry)
+{
+	int rc;
+	struct input_dev_list *temp;
+	int64_t t;
+	const struct sensors_input_cache_entry_t *found = NULL;
+
+	pthread_mutex_lock(&util_mutex);
+	if (!list_initialized) {
+		node_init(&head);
+		list_initialized = 1;
+
+		/* watch first so nothing appearing during the scan is lost */
+		input_watch_start();
+
+		t = get_current_nano_time();
+		rc = cache_file_load();
+		t = (get_current_nano_time() - t) / 1000;
+		if (rc >= 0)
+			ALOGI("%s: %d devices from cache file in %lld us",
+			      __func__, rc, t);
+		else
+			input_scan(NULL);
+	}
+
+	temp = lookup(name, NULL);
+	if (temp)
+		found = &temp->entry;
+	else if (watch_fd < 0)
+		/* without the watcher a late device is only found this way */
+		found = input_scan(name);
+
+	if (found)
+		*entry = *found;
+	pthread_mutex_unlock(&util_mutex);
+
+	return found ? 0 : -1;
+}
+
+int sensors_input_cache_watch(const char *name, sensors_input_notify_t notify,
+			      void *arg)
+{
+	struct input_listener *l;
+
+	l = malloc(sizeof(*l));
+	if (!l)
+		return -1;
+
+	strlcpy(l->name, name, sizeof(l->name));
+	l->notify = notify;
+	l->arg = arg;
+
+	/* listeners are never removed, so readers need no lock */
+	pthread_mutex_lock(&listener_mutex);
+	l->next = listeners;
+	__atomic_store_n(&listeners, l, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&listener_mutex);
+
+	return 0;
+}
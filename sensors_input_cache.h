@@ -1,5 +1,6 @@
 #ifndef SENSORS_INPUT_CACHE_H_
 #define SENSORS_INPUT_CACHE_H_
+#include "sensors_config.h"
 
 #define INPUT_EVENT_DIR      "/dev/input/"
 #define INPUT_EVENT_BASENAME "event"
@@ -9,10 +10,26 @@
 struct sensors_input_cache_entry_t {
 	int nr;
 	char dev_name[32];
-	char event_path[sizeof(INPUT_EVENT_PATH) + MAX_INT_STRING_SIZE];
+	char event_path[CONFIG_ROOT_MAX + sizeof(INPUT_EVENT_PATH) +
+			MAX_INT_STRING_SIZE];
 };
 
-const struct sensors_input_cache_entry_t *sensors_input_cache_get(
-							const char *name);
+/*
+ * Copies the entry of the named device, 0 on success. Devices come and go
+ * at any time, so the entry is only ever handed out as a copy.
+ */
+int sensors_input_cache_get(const char *name,
+			    struct sensors_input_cache_entry_t *entry);
+
+/*
+ * /dev/input is watched for devices coming and going. notify is called
+ * from the epoll reactor with present set when a device with the given
+ * name appears and cleared when it is removed.
+ */
+typedef void (*sensors_input_notify_t)(void *arg,
+		const struct sensors_input_cache_entry_t *entry, int present);
+
+int sensors_input_cache_watch(const char *name, sensors_input_notify_t notify,
+			      void *arg);
 
 #endif
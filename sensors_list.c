@@ -17,14 +17,23 @@
 #define LOG_TAG "DASH - list"
 
 #include "sensors_log.h"
+#include <stdlib.h>
 #include <string.h>
 #include "sensors_list.h"
+#include "sensors_metrics.h"
+#include "sensors_registry.h"
 
-#define DASH_MAX_SENSORS 16
-
-static struct sensor_t sensors[DASH_MAX_SENSORS];
-static struct sensor_api_t* sensor_apis[DASH_MAX_SENSORS];
+/*
+ * sensors is handed to Android as is, so it is kept as one array that grows
+ * as sensors register. handles maps a handle to the api of the first
+ * registered sensor using it; more than one driver may claim a handle until
+ * init has weeded out the ones whose hardware is missing.
+ */
+static struct sensor_t *sensors;
+static struct sensor_api_t **sensor_apis;
 static int number_of_sensors = 0;
+static int max_sensors = 0;
+static struct sensors_registry_t handles;
 
 int sensors_list_get(struct sensors_module_t* module, struct sensor_t const** plist)
 {
@@ -32,14 +41,41 @@ int sensors_list_get(struct sensors_module_t* module, struct sensor_t const** pl
 	return number_of_sensors;
 }
 
+static int sensors_list_grow()
+{
+	struct sensor_t *s;
+	struct sensor_api_t **a;
+	int max = max_sensors ? max_sensors * 2 : 16;
+
+	s = realloc(sensors, max * sizeof(*s));
+	if (!s)
+		return -1;
+	sensors = s;
+
+	a = realloc(sensor_apis, max * sizeof(*a));
+	if (!a)
+		return -1;
+	sensor_apis = a;
+
+	max_sensors = max;
+	return 0;
+}
+
 int sensors_list_register(struct sensor_t* sensor, struct sensor_api_t* api)
 {
 	if (!sensor || !api)
 		return -1;
 
-	if (number_of_sensors > DASH_MAX_SENSORS-1)
+	if (number_of_sensors == max_sensors && sensors_list_grow() < 0) {
+		ALOGE("%s: unable to register '%s'", __func__, sensor->name);
+		return -1;
+	}
+
+	if (!sensors_registry_get(&handles, sensor->handle) &&
+	    sensors_registry_set(&handles, sensor->handle, api) < 0)
 		return -1;
 
+	sensors_metrics_register(sensor->handle, sensor->name);
 	sensor_apis[number_of_sensors] = api;
 	/* We have to copy due to sensor API */
 	memcpy(&sensors[number_of_sensors++], sensor, sizeof(*sensor));
@@ -49,6 +85,7 @@ int sensors_list_register(struct sensor_t* sensor, struct sensor_api_t* api)
 
 void sensors_list_deregister(struct sensor_api_t* api)
 {
+	int handle;
 	int i;
 
 	for (i = 0; i < number_of_sensors; i++)
@@ -58,12 +95,26 @@ void sensors_list_deregister(struct sensor_api_t* api)
 	if (i == number_of_sensors)
 		return;
 
+	handle = sensors[i].handle;
+
 	for ( ; i < number_of_sensors-1; i++) {
 		sensor_apis[i] = sensor_apis[i+1];
 		sensors[i] = sensors[i+1];
 	}
 
 	--number_of_sensors;
+
+	/* hand the handle over to the next sensor claiming it, if any */
+	if (sensors_registry_get(&handles, handle) != api)
+		return;
+
+	sensors_registry_set(&handles, handle, NULL);
+	for (i = 0; i < number_of_sensors; i++) {
+		if (sensors[i].handle == handle) {
+			sensors_registry_set(&handles, handle, sensor_apis[i]);
+			break;
+		}
+	}
 }
 
 void sensors_list_destroy()
@@ -75,11 +126,7 @@ void sensors_list_destroy()
 
 struct sensor_api_t* sensors_list_get_api_from_handle(int handle)
 {
-	int i;
-	for (i = 0; i < number_of_sensors; i++)
-		if (sensors[i].handle == handle)
-			return sensor_apis[i];
-	return NULL;
+	return sensors_registry_get(&handles, handle);
 }
 
 void sensors_list_foreach_api(int (*f)(struct sensor_api_t* api, void* arg),
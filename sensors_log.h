@@ -36,4 +36,87 @@
 #define ALOGE_IF LOGE_IF
 #endif
 
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Log levels of the data path. DASH_LOGV() and DASH_LOGD() compile to
+ * nothing, arguments included, when below the threshold of the file.
+ * The threshold is DASH_LOG_LEVEL, set for the whole build in Android.mk.
+ * A file can have a threshold of its own by defining DASH_LOG_TAG_LEVEL
+ * before including this header.
+ */
+#define DASH_LOG_VERBOSE	0
+#define DASH_LOG_DEBUG		1
+#define DASH_LOG_INFO		2
+
+#ifndef DASH_LOG_LEVEL
+#define DASH_LOG_LEVEL		DASH_LOG_INFO
+#endif
+
+#ifdef DASH_LOG_TAG_LEVEL
+#define DASH_LOG_THRESHOLD	DASH_LOG_TAG_LEVEL
+#else
+#define DASH_LOG_THRESHOLD	DASH_LOG_LEVEL
+#endif
+
+#if DASH_LOG_THRESHOLD <= DASH_LOG_VERBOSE
+#define DASH_LOGV(...)	ALOGV(__VA_ARGS__)
+#else
+#define DASH_LOGV(...)	do { if (0) ALOGV(__VA_ARGS__); } while (0)
+#endif
+
+#if DASH_LOG_THRESHOLD <= DASH_LOG_DEBUG
+#define DASH_LOGD(...)	ALOGD(__VA_ARGS__)
+#else
+#define DASH_LOGD(...)	do { if (0) ALOGD(__VA_ARGS__); } while (0)
+#endif
+
+/*
+ * Errors which can repeat for every sample. Each call site logs at most
+ * once per DASH_LOG_RATELIMIT_NS, the messages in between are counted and
+ * the count is logged ahead of the next message that gets through.
+ */
+#define DASH_LOG_RATELIMIT_NS	1000000000LL
+
+struct dash_log_ratelimit {
+	int64_t next;
+	unsigned int suppressed;
+};
+
+static inline int dash_log_ratelimit(struct dash_log_ratelimit *rl,
+				     unsigned int *suppressed)
+{
+	struct timespec ts;
+	int64_t now, next;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	next = __atomic_load_n(&rl->next, __ATOMIC_RELAXED);
+	if (now < next ||
+	    !__atomic_compare_exchange_n(&rl->next, &next,
+					 now + DASH_LOG_RATELIMIT_NS, 0,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		__atomic_fetch_add(&rl->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	*suppressed = __atomic_exchange_n(&rl->suppressed, 0, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+#define DASH_LOG_RATELIMITED(alog, ...) do { \
+	static struct dash_log_ratelimit rl_; \
+	unsigned int suppressed_; \
+	if (dash_log_ratelimit(&rl_, &suppressed_)) { \
+		if (suppressed_) \
+			alog("%s: %u similar messages suppressed", __func__, \
+			    suppressed_); \
+		alog(__VA_ARGS__); \
+	} \
+} while (0)
+
+#define DASH_LOGW_RATELIMITED(...) DASH_LOG_RATELIMITED(ALOGW, __VA_ARGS__)
+#define DASH_LOGE_RATELIMITED(...) DASH_LOG_RATELIMITED(ALOGE, __VA_ARGS__)
+
 #endif
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DASH - metrics"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sensors_log.h"
+#include "sensor_util.h"
+#include "sensors_registry.h"
+#include "sensors_metrics.h"
+
+/*
+ * Every sensor handle has its counters spread over a number of slots.
+ * Like the fifo lanes, a thread is bound to one slot the first time it
+ * counts something, so the adds are lock-free and in the common case not
+ * shared with any other thread. Readers sum all slots up as they go, a
+ * dump never stops the pipeline.
+ *
+ * Sensors are registered while the drivers register at startup, there is
+ * no locking around the handle table.
+ */
+#define METRICS_SLOTS		8
+
+struct metrics_slot {
+	uint64_t counter[METRIC_COUNT];
+	uint32_t latency[METRICS_HIST_BUCKETS];
+	uint32_t interval[METRICS_HIST_BUCKETS];
+} __attribute__((aligned(64)));
+
+struct metrics_sensor {
+	const char *name;
+	int64_t active_since;
+	int64_t active_ns;
+	int64_t rate_ns;
+	int64_t last_timestamp;
+	int64_t latency_max;
+	int64_t interval_max;
+	struct metrics_slot slot[METRICS_SLOTS];
+};
+
+/* what a thread counted but hasn't charged to a sensor yet */
+struct metrics_thread {
+	unsigned int slot;
+	unsigned int nr_pending;
+	unsigned int pending[METRIC_COUNT];
+};
+
+static struct sensors_metrics_ctx {
+	pthread_once_t once;
+	pthread_key_t thread_key;
+	unsigned int next_slot;
+	struct sensors_registry_t handles;
+} metrics = {
+	.once = PTHREAD_ONCE_INIT,
+};
+
+static const char *metric_name[METRIC_COUNT] = {
+	[METRIC_EVENTS_READ] = "events read",
+	[METRIC_READS] = "reads",
+	[METRIC_WAKEUPS] = "wakeups",
+	[METRIC_SYSFS_WRITES] = "sysfs writes",
+	[METRIC_FRAMES] = "frames",
+	[METRIC_DROPS] = "drops",
+	[METRIC_RATE_CHANGES] = "rate changes",
+};
+
+static void metrics_key_create()
+{
+	pthread_key_create(&metrics.thread_key, free);
+}
+
+static struct metrics_thread *metrics_thread()
+{
+	struct metrics_thread *t;
+
+	pthread_once(&metrics.once, metrics_key_create);
+	t = pthread_getspecific(metrics.thread_key);
+	if (t)
+		return t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->slot = __atomic_fetch_add(&metrics.next_slot, 1, __ATOMIC_RELAXED) %
+		METRICS_SLOTS;
+	pthread_setspecific(metrics.thread_key, t);
+
+	return t;
+}
+
+static inline struct metrics_sensor *metrics_sensor(int handle)
+{
+	return sensors_registry_get(&metrics.handles, handle);
+}
+
+static int metrics_bucket(int64_t ns)
+{
+	int shift;
+
+	if (ns < (1LL << METRICS_HIST_MIN_SHIFT))
+		return 0;
+
+	shift = 63 - __builtin_clzll(ns);
+	if (shift > METRICS_HIST_MAX_SHIFT)
+		return METRICS_HIST_BUCKETS - 1;
+
+	return 1 + (shift - METRICS_HIST_MIN_SHIFT) * METRICS_HIST_SUB +
+		((ns >> (shift - METRICS_HIST_SUB_BITS)) &
+		 (METRICS_HIST_SUB - 1));
+}
+
+/* lower bound of a bucket */
+int64_t sensors_metrics_bucket_ns(int bucket)
+{
+	int shift;
+
+	if (bucket <= 0)
+		return 0;
+
+	bucket--;
+	shift = METRICS_HIST_MIN_SHIFT + bucket / METRICS_HIST_SUB;
+
+	return (1LL << shift) + (bucket % METRICS_HIST_SUB) *
+		(1LL << (shift - METRICS_HIST_SUB_BITS));
+}
+
+void sensors_metrics_register(int handle, const char *name)
+{
+	struct metrics_sensor *s;
+
+	if (metrics_sensor(handle))
+		return;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		ALOGE("%s: unable to allocate metrics for %s", __func__, name);
+		return;
+	}
+	s->name = name;
+
+	if (sensors_registry_set(&metrics.handles, handle, s) < 0)
+		free(s);
+}
+
+void sensors_metrics_pending(enum sensors_metric m, unsigned int n)
+{
+	struct metrics_thread *t = metrics_thread();
+
+	if (!t)
+		return;
+
+	t->pending[m] += n;
+	t->nr_pending++;
+}
+
+static void metrics_charge(struct metrics_thread *t, struct metrics_slot *slot)
+{
+	int i;
+
+	for (i = 0; i < METRIC_COUNT; i++) {
+		if (!t->pending[i])
+			continue;
+		__atomic_fetch_add(&slot->counter[i], t->pending[i],
+				   __ATOMIC_RELAXED);
+		t->pending[i] = 0;
+	}
+	t->nr_pending = 0;
+}
+
+/* counts nobody owns are dropped rather than charged to another sensor */
+void sensors_metrics_flush(int handle)
+{
+	struct metrics_sensor *s = metrics_sensor(handle);
+	struct metrics_thread *t = metrics_thread();
+
+	if (!t || !t->nr_pending)
+		return;
+
+	if (s) {
+		metrics_charge(t, &s->slot[t->slot]);
+	} else {
+		memset(t->pending, 0, sizeof(t->pending));
+		t->nr_pending = 0;
+	}
+}
+
+void sensors_metrics_add(int handle, enum sensors_metric m, unsigned int n)
+{
+	struct metrics_sensor *s = metrics_sensor(handle);
+	struct metrics_thread *t;
+
+	if (!s || !(t = metrics_thread()))
+		return;
+
+	__atomic_fetch_add(&s->slot[t->slot].counter[m], n, __ATOMIC_RELAXED);
+}
+
+void sensors_metrics_activate(int handle, int enable)
+{
+	struct metrics_sensor *s = metrics_sensor(handle);
+	int64_t now = get_current_nano_time();
+	int64_t since;
+
+	if (!s)
+		return;
+
+	if (enable) {
+		since = 0;
+		__atomic_compare_exchange_n(&s->active_since, &since, now, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		return;
+	}
+
+	since = __atomic_exchange_n(&s->active_since, 0, __ATOMIC_RELAXED);
+	if (since)
+		__atomic_fetch_add(&s->active_ns, now - since,
+				   __ATOMIC_RELAXED);
+}
+
+void sensors_metrics_rate(int handle, int64_t ns)
+{
+	struct metrics_sensor *s = metrics_sensor(handle);
+
+	if (!s)
+		return;
+
+	if (__atomic_exchange_n(&s->rate_ns, ns, __ATOMIC_RELAXED) != ns)
+		sensors_metrics_add(handle, METRIC_RATE_CHANGES, 1);
+}
+
+/* only called from the poll thread, so last_timestamp and the maxima have
+   one writer */
+void sensors_metrics_poll(const sensors_event_t *data, int n)
+{
+	struct metrics_thread *t = metrics_thread();
+	struct metrics_sensor *s;
+	struct metrics_slot *slot;
+	int64_t now, last, ns;
+	int i;
+
+	if (!t)
+		return;
+
+	now = get_current_nano_time();
+	for (i = 0; i < n; i++) {
+		if (data[i].type == SENSOR_TYPE_META_DATA)
+			continue;
+		s = metrics_sensor(data[i].sensor);
+		if (!s)
+			continue;
+
+		slot = &s->slot[t->slot];
+		if (now >= data[i].timestamp) {
+			ns = now - data[i].timestamp;
+			__atomic_fetch_add(&slot->latency[metrics_bucket(ns)],
+					   1, __ATOMIC_RELAXED);
+			if (ns > s->latency_max)
+				__atomic_store_n(&s->latency_max, ns,
+						 __ATOMIC_RELAXED);
+		}
+
+		last = __atomic_load_n(&s->last_timestamp, __ATOMIC_RELAXED);
+		if (last && data[i].timestamp > last) {
+			ns = data[i].timestamp - last;
+			__atomic_fetch_add(&slot->interval[metrics_bucket(ns)],
+					   1, __ATOMIC_RELAXED);
+			if (ns > s->interval_max)
+				__atomic_store_n(&s->interval_max, ns,
+						 __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&s->last_timestamp, data[i].timestamp,
+				 __ATOMIC_RELAXED);
+	}
+}
+
+int sensors_metrics_get(int handle, struct sensors_metrics_t *m)
+{
+	struct metrics_sensor *s = metrics_sensor(handle);
+	struct metrics_slot *slot;
+	int64_t since;
+	int i, j;
+
+	if (!s)
+		return -1;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < METRICS_SLOTS; i++) {
+		slot = &s->slot[i];
+		for (j = 0; j < METRIC_COUNT; j++)
+			m->counter[j] += __atomic_load_n(&slot->counter[j],
+							 __ATOMIC_RELAXED);
+		for (j = 0; j < METRICS_HIST_BUCKETS; j++) {
+			m->latency[j] += __atomic_load_n(&slot->latency[j],
+							 __ATOMIC_RELAXED);
+			m->interval[j] += __atomic_load_n(&slot->interval[j],
+							  __ATOMIC_RELAXED);
+		}
+	}
+
+	m->active_ns = __atomic_load_n(&s->active_ns, __ATOMIC_RELAXED);
+	since = __atomic_load_n(&s->active_since, __ATOMIC_RELAXED);
+	if (since)
+		m->active_ns += get_current_nano_time() - since;
+	m->rate_ns = __atomic_load_n(&s->rate_ns, __ATOMIC_RELAXED);
+	m->latency_max_ns = __atomic_load_n(&s->latency_max, __ATOMIC_RELAXED);
+	m->interval_max_ns = __atomic_load_n(&s->interval_max,
+					     __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/* lower bound of the bucket holding the p:th percentile */
+static int64_t metrics_percentile(const uint32_t *hist, int p)
+{
+	uint64_t total = 0, count = 0, rank;
+	int i;
+
+	for (i = 0; i < METRICS_HIST_BUCKETS; i++)
+		total += hist[i];
+	if (!total)
+		return 0;
+
+	rank = (total * p + 99) / 100;
+	for (i = 0; i < METRICS_HIST_BUCKETS; i++) {
+		count += hist[i];
+		if (count >= rank)
+			break;
+	}
+
+	return sensors_metrics_bucket_ns(i);
+}
+
+static int metrics_hist_print(char *buf, int len, const char *name,
+			      const uint32_t *hist, int64_t max)
+{
+	return snprintf(buf, len, "  %-8s p50 %lld us, p90 %lld us, "
+			"p99 %lld us, max %lld us\n", name,
+			(long long)metrics_percentile(hist, 50) / 1000,
+			(long long)metrics_percentile(hist, 90) / 1000,
+			(long long)metrics_percentile(hist, 99) / 1000,
+			(long long)max / 1000);
+}
+
+/* returns the length of the dump, which is cut off at len */
+int sensors_metrics_dump(char *buf, int len)
+{
+	struct sensors_metrics_t m;
+	struct metrics_sensor *s;
+	int handle, i;
+	int n = 0;
+
+#define DUMP(f) do { \
+	int rc = f; \
+	if (rc > 0) \
+		n += rc < len - n ? rc : len - n - 1; \
+} while (0)
+
+	if (len <= 0)
+		return 0;
+	buf[0] = '\0';
+
+	for (handle = 0; handle < metrics.handles.size; handle++) {
+		s = metrics_sensor(handle);
+		if (!s || sensors_metrics_get(handle, &m) < 0)
+			continue;
+
+		DUMP(snprintf(buf + n, len - n, "%s (%d): active %lld ms, "
+			      "rate %lld us\n ", s->name, handle,
+			      (long long)m.active_ns / 1000000,
+			      (long long)m.rate_ns / 1000));
+		for (i = 0; i < METRIC_COUNT; i++)
+			DUMP(snprintf(buf + n, len - n, " %s %llu%s",
+				      metric_name[i],
+				      (unsigned long long)m.counter[i],
+				      i < METRIC_COUNT - 1 ? "," : "\n"));
+		DUMP(metrics_hist_print(buf + n, len - n, "latency",
+					m.latency, m.latency_max_ns));
+		DUMP(metrics_hist_print(buf + n, len - n, "interval",
+					m.interval, m.interval_max_ns));
+	}
+
+#undef DUMP
+
+	return n;
+}
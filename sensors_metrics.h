@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_METRICS_H_
+#define SENSORS_METRICS_H_
+#include <stdint.h>
+#include <hardware/sensors.h>
+
+enum sensors_metric {
+	METRIC_EVENTS_READ,
+	METRIC_READS,
+	METRIC_WAKEUPS,
+	METRIC_SYSFS_WRITES,
+	METRIC_FRAMES,
+	METRIC_DROPS,
+	METRIC_RATE_CHANGES,
+	METRIC_COUNT
+};
+
+/*
+ * Log-linear histogram of nanoseconds: everything below 1 us in bucket 0,
+ * then four linear buckets per power of two up to about 68 s.
+ */
+#define METRICS_HIST_MIN_SHIFT	10
+#define METRICS_HIST_MAX_SHIFT	36
+#define METRICS_HIST_SUB_BITS	2
+#define METRICS_HIST_SUB	(1 << METRICS_HIST_SUB_BITS)
+#define METRICS_HIST_BUCKETS	(1 + METRICS_HIST_SUB * \
+		(METRICS_HIST_MAX_SHIFT - METRICS_HIST_MIN_SHIFT + 1))
+
+struct sensors_metrics_t {
+	uint64_t counter[METRIC_COUNT];
+	int64_t active_ns;
+	int64_t rate_ns;
+	int64_t latency_max_ns;
+	int64_t interval_max_ns;
+	uint32_t latency[METRICS_HIST_BUCKETS];
+	uint32_t interval[METRICS_HIST_BUCKETS];
+};
+
+void sensors_metrics_register(int handle, const char *name);
+
+/*
+ * Reads and sysfs writes happen where the sensor they serve isn't known.
+ * They are kept on the calling thread by sensors_metrics_pending() and
+ * charged by sensors_metrics_flush() to the handle of the select or timer
+ * worker whose callback did them, or of the control call. A sensor which
+ * only reads or fails is charged itself, never its neighbour on the
+ * thread.
+ */
+void sensors_metrics_pending(enum sensors_metric m, unsigned int n);
+void sensors_metrics_flush(int handle);
+void sensors_metrics_add(int handle, enum sensors_metric m, unsigned int n);
+
+void sensors_metrics_activate(int handle, int enable);
+void sensors_metrics_rate(int handle, int64_t ns);
+void sensors_metrics_poll(const sensors_event_t *data, int n);
+
+/*
+ * Both only read the counters, so they can be called any time without
+ * stopping the pipeline. The dump is text, one block per sensor.
+ */
+int sensors_metrics_get(int handle, struct sensors_metrics_t *m);
+int64_t sensors_metrics_bucket_ns(int bucket);
+int sensors_metrics_dump(char *buf, int len);
+
+#endif
@@ -20,9 +20,13 @@
 #include "sensors_log.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include "sensors_list.h"
 #include "sensors_config.h"
 #include "sensors_fifo.h"
+#include "sensors_metrics.h"
+#include "sensors_trace.h"
+#include "sensors_tracepoint.h"
 
 static int sensors_module_set_delay(struct sensors_poll_device_t *dev,
 				    int handle, int64_t ns)
@@ -35,7 +39,11 @@ static int sensors_module_set_delay(struct sensors_poll_device_t *dev,
                 return -1;
         }
 
+	sensors_trace_control(TRACE_SET_DELAY, handle, ns);
 	ret = api->set_delay(api, ns);
+	if (ret >= 0)
+		sensors_metrics_rate(handle, ns);
+	sensors_metrics_flush(handle);
 
 	return ret;
 }
@@ -50,8 +58,13 @@ static int sensors_module_activate(struct sensors_poll_device_t *dev,
                 return -1;
         }
 
-	if (api->activate(api, enabled) < 0)
+	sensors_trace_control(TRACE_ACTIVATE, handle, enabled);
+	if (api->activate(api, enabled) < 0) {
+		sensors_metrics_flush(handle);
 		return -1;
+	}
+	sensors_metrics_activate(handle, enabled);
+	sensors_metrics_flush(handle);
 
 	return 0;
 }
@@ -59,16 +72,92 @@ static int sensors_module_activate(struct sensors_poll_device_t *dev,
 static int sensors_module_poll(struct sensors_poll_device_t *dev,
 			       sensors_event_t* data, int count)
 {
+	int n;
+#ifdef DASH_TRACEPOINTS
+	int i;
+#endif
+
+	if (count <= 0)
+		return -EINVAL;
+
+	/* blocks until at least one event is queued */
+	n = sensors_fifo_get_all(data, count);
+	sensors_metrics_poll(data, n);
+#ifdef DASH_TRACEPOINTS
+	for (i = 0; i < n; i++)
+		if (data[i].type != SENSOR_TYPE_META_DATA)
+			TRACEPOINT(TP_POLL, data[i].sensor, data[i].timestamp,
+				   0);
+#endif
+
+	return n;
+}
+
+static int sensors_module_batch(struct sensors_poll_device_1 *dev,
+				int handle, int flags, int64_t ns,
+				int64_t timeout)
+{
+	struct sensor_api_t* api = sensors_list_get_api_from_handle(handle);
 	int ret;
 
-	while ((ret = sensors_fifo_get_all(data, count)) == 0)
-		;
+	if (!api) {
+		ALOGE("%s: unable to find handle!", __func__);
+		return -EINVAL;
+	}
+
+	if (!(flags & SENSORS_BATCH_DRY_RUN))
+		sensors_trace_batch(handle, flags, ns, timeout);
+
+	/* without a hardware fifo the sensor simply reports continuously */
+	if (!api->batch) {
+		if (flags & SENSORS_BATCH_DRY_RUN)
+			return 0;
+		ret = api->set_delay(api, ns);
+	} else {
+		ret = api->batch(api, flags, ns, timeout);
+	}
+
+	if (!(flags & SENSORS_BATCH_DRY_RUN) && ret >= 0)
+		sensors_metrics_rate(handle, ns);
+	sensors_metrics_flush(handle);
 
 	return ret;
 }
 
+static int sensors_module_flush(struct sensors_poll_device_1 *dev, int handle)
+{
+	struct sensor_api_t* api = sensors_list_get_api_from_handle(handle);
+	sensors_event_t data;
+	int ret;
+
+	if (!api) {
+		ALOGE("%s: unable to find handle!", __func__);
+		return -EINVAL;
+	}
+
+	sensors_trace_control(TRACE_FLUSH, handle, 0);
+	if (api->flush) {
+		ret = api->flush(api);
+		sensors_metrics_flush(handle);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* everything buffered is queued now, tell the framework */
+	memset(&data, 0, sizeof(data));
+	data.version = META_DATA_VERSION;
+	data.type = SENSOR_TYPE_META_DATA;
+	data.meta_data.what = META_DATA_FLUSH_COMPLETE;
+	data.meta_data.sensor = handle;
+	sensors_fifo_put(&data);
+
+	return 0;
+}
+
 static int sensors_module_close(struct hw_device_t* device)
 {
+	sensors_trace_close();
+	TRACEPOINT_CLOSE();
 	sensors_fifo_deinit();
 	sensors_config_destroy();
 	free(device);
@@ -82,7 +171,7 @@ static int sensors_init_iterator(struct sensor_api_t* api, void *arg)
 
 static int sensors_module_open(const struct hw_module_t* module, const char* id, struct hw_device_t** device)
 {
-	struct sensors_poll_device_t *dev;
+	struct sensors_poll_device_1 *dev;
 
 	if (strcmp(id, SENSORS_HARDWARE_POLL))
 		return 0;
@@ -93,17 +182,21 @@ static int sensors_module_open(const struct hw_module_t* module, const char* id,
 
 	memset(dev, 0, sizeof(*dev));
 	dev->common.tag = HARDWARE_DEVICE_TAG;
-	dev->common.version = 0;
+	dev->common.version = SENSORS_DEVICE_API_VERSION_1_1;
 	dev->common.module = (struct hw_module_t*)module;
 	dev->common.close = sensors_module_close;
 	dev->activate = sensors_module_activate;
 	dev->setDelay = sensors_module_set_delay;
 	dev->poll = sensors_module_poll;
+	dev->batch = sensors_module_batch;
+	dev->flush = sensors_module_flush;
 
 	*device = (struct hw_device_t*) dev;
 
 	sensors_config_read(NULL);
 	sensors_fifo_init();
+	sensors_trace_init();
+	TRACEPOINT_INIT();
 	sensors_list_foreach_api(sensors_init_iterator, NULL);
 
 	return 0;
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "DASH - registry"
+
+#include <stdlib.h>
+#include <string.h>
+#include "sensors_log.h"
+#include "sensors_registry.h"
+
+int sensors_registry_set(struct sensors_registry_t *r, int handle, void *p)
+{
+	void **table;
+	int size;
+
+	if (handle < 0 || handle >= SENSORS_REGISTRY_MAX_HANDLE) {
+		ALOGE("%s: handle %d out of range", __func__, handle);
+		return -1;
+	}
+
+	if (handle >= r->size) {
+		size = r->size ? r->size : 16;
+		while (size <= handle)
+			size <<= 1;
+
+		table = realloc(r->table, size * sizeof(*table));
+		if (!table) {
+			ALOGE("%s: unable to grow registry to %d", __func__,
+			      size);
+			return -1;
+		}
+		memset(table + r->size, 0, (size - r->size) * sizeof(*table));
+		r->table = table;
+		r->size = size;
+	}
+
+	r->table[handle] = p;
+
+	return 0;
+}
+
+void sensors_registry_destroy(struct sensors_registry_t *r)
+{
+	free(r->table);
+	r->table = NULL;
+	r->size = 0;
+}
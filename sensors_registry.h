@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_REGISTRY_H_
+#define SENSORS_REGISTRY_H_
+
+/*
+ * Table indexed directly by sensor handle. Entries are added while sensors
+ * register at startup, the table grows to fit the largest handle seen.
+ * Lookups are a bounds check and an array load.
+ */
+#define SENSORS_REGISTRY_MAX_HANDLE 1024
+
+struct sensors_registry_t {
+	void **table;
+	int size;
+};
+
+int sensors_registry_set(struct sensors_registry_t *r, int handle, void *p);
+void sensors_registry_destroy(struct sensors_registry_t *r);
+
+static inline void *sensors_registry_get(struct sensors_registry_t *r,
+					 int handle)
+{
+	if (handle < 0 || handle >= r->size)
+		return NULL;
+	return r->table[handle];
+}
+
+#endif
@@ -19,66 +19,55 @@
 #include <unistd.h>
 #include <string.h>
 #include "sensors_log.h"
-#include <sys/select.h>
-#include <sys/time.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <errno.h>
+#include "sensors_epoll.h"
+#include "sensors_metrics.h"
 #include "sensors_select.h"
-
-extern pthread_mutex_t wrapper_mutex;
+#include "sensors_tracepoint.h"
 
 #define LOCK(p) do { \
-	ALOGV("%s(%d): %s: lock\n", __FILE__, __LINE__, __func__); \
+	DASH_LOGV("%s(%d): %s: lock\n", __FILE__, __LINE__, __func__); \
 	pthread_mutex_lock(p); \
 } while (0)
 
 #define UNLOCK(p) do { \
-	ALOGV("%s(%d): %s: unlock\n", __FILE__, __LINE__, __func__); \
+	DASH_LOGV("%s(%d): %s: unlock\n", __FILE__, __LINE__, __func__); \
 	pthread_mutex_unlock(p); \
 } while (0)
 
-static void *sensors_select_callback(void *arg)
+static void sensors_select_callback(void *arg, uint32_t token)
 {
-	fd_set readfds;
-	int ret;
 	struct sensors_select_t *s = arg;
-	int maxfd;
-	int fd;
 
+	/* the wrapper fan-out doesn't need wrapper_mutex, see sensors_wrapper.c */
 	LOCK(&s->fd_mutex);
-	maxfd = s->ctl_fds[0] > s->fd ? s->ctl_fds[0] : s->fd;
-	FD_ZERO(&readfds);
-	FD_SET(s->ctl_fds[0], &readfds);
-	if (s->fd >= 0)
-		FD_SET(s->fd, &readfds);
-	fd = s->fd;
-	UNLOCK(&s->fd_mutex);
-	ret = select(maxfd + 1, &readfds, NULL, NULL, NULL);
-
-	if (ret < 0) {
-		ALOGE("%s: select failed!\n", __func__);
-	} else if (ret) {
-		if (FD_ISSET(s->ctl_fds[0], &readfds)) {
-			read(s->ctl_fds[0], &ret, sizeof(ret));
-		} else if (fd >= 0 && FD_ISSET(fd, &readfds)) {
-			LOCK(&wrapper_mutex);
-			LOCK(&s->fd_mutex);
-			if (s->fd == fd)
-			    s->select_callback(s->arg);
-			UNLOCK(&s->fd_mutex);
-			UNLOCK(&wrapper_mutex);
-		}
+	/* fd may have been replaced after the event was collected */
+	if (s->registered && s->token == token) {
+		sensors_metrics_add(s->handle, METRIC_WAKEUPS, 1);
+		TRACEPOINT(TP_WAKEUP, -1, 0, 0);
+		s->select_callback(s->arg);
+		sensors_metrics_flush(s->handle);
+		sensors_epoll_rearm(s->epoll_id, s->fd, s->token);
 	}
-	return NULL;
+	UNLOCK(&s->fd_mutex);
 }
 
-static void scheduler_select_notify(struct sensors_select_t* s)
+/* the fd is watched only while it is valid and the sensor is resumed */
+static void sensors_select_update(struct sensors_select_t* s)
 {
-	int rc = write(s->ctl_fds[1], &rc, sizeof (rc));
-	if (rc < 0)
-		ALOGE("%s: write failed: %s", __func__, strerror(errno));
+	int watch = (s->fd >= 0) && !s->suspended;
+
+	if (watch == s->registered)
+		return;
+
+	if (watch) {
+		s->token++;
+		if (!sensors_epoll_add(s->epoll_id, s->fd, s->token))
+			s->registered = 1;
+	} else {
+		sensors_epoll_remove(s->fd);
+		s->registered = 0;
+	}
 }
 
 static void sensors_select_set_delay(struct sensors_select_t* s, int64_t ns)
@@ -88,39 +77,46 @@ static void sensors_select_set_delay(struct sensors_select_t* s, int64_t ns)
 
 static void sensors_select_suspend(struct sensors_select_t* s)
 {
-	s->worker.suspend(&s->worker);
-	scheduler_select_notify(s);
+	LOCK(&s->fd_mutex);
+	s->suspended = 1;
+	sensors_select_update(s);
+	UNLOCK(&s->fd_mutex);
 }
 
 static void sensors_select_resume(struct sensors_select_t* s)
 {
-	s->worker.resume(&s->worker);
-	scheduler_select_notify(s);
+	LOCK(&s->fd_mutex);
+	s->suspended = 0;
+	sensors_select_update(s);
+	UNLOCK(&s->fd_mutex);
 }
 
 static void sensors_select_destroy(struct sensors_select_t* s)
 {
-	s->worker.destroy(&s->worker);
 	LOCK(&s->fd_mutex);
+	s->suspended = 1;
+	sensors_select_update(s);
 	if (s->fd > 0) {
 		close(s->fd);
 		s->fd = -1;
 	}
-	if (s->ctl_fds[0] > 0)
-		close(s->ctl_fds[0]);
-	if (s->ctl_fds[1] > 0)
-		close(s->ctl_fds[1]);
+	sensors_epoll_detach(s->epoll_id);
+	s->epoll_id = -1;
 	UNLOCK(&s->fd_mutex);
 }
 
 void sensors_select_set_fd(struct sensors_select_t* s, int fd)
 {
 	LOCK(&s->fd_mutex);
+	if (s->registered) {
+		sensors_epoll_remove(s->fd);
+		s->registered = 0;
+	}
 	if (s->fd > 0)
 		close(s->fd);
 	s->fd = fd;
+	sensors_select_update(s);
 	UNLOCK(&s->fd_mutex);
-	scheduler_select_notify(s);
 }
 
 int sensors_select_get_fd(struct sensors_select_t* s)
@@ -128,7 +124,8 @@ int sensors_select_get_fd(struct sensors_select_t* s)
 	return s->fd;
 }
 
-void sensors_select_init(struct sensors_select_t* s,
+/* fails when the sensor can't be attached to the reactor */
+int sensors_select_init(struct sensors_select_t* s,
 			void* (*select_func)(void *arg), void* arg, int fd)
 {
 	s->suspend = sensors_select_suspend;
@@ -141,12 +138,18 @@ void sensors_select_init(struct sensors_select_t* s,
 	s->arg = arg;
 	s->fd = fd;
 	s->delay = 0;
+	s->token = 0;
+	s->suspended = 1;
+	s->registered = 0;
+	s->handle = -1;
 
-        if (pipe(s->ctl_fds) < 0)
-		ALOGE("%s: pipe failed: %s", __func__, strerror(errno));
-
-	sensors_worker_init(&s->worker, sensors_select_callback, s);
-	s->worker.set_delay(&s->worker, 0);
 	pthread_mutex_init(&s->fd_mutex, NULL);
-}
+	s->epoll_id = sensors_epoll_attach(sensors_select_callback, s);
+	if (s->epoll_id < 0) {
+		ALOGE("%s: unable to attach to reactor", __func__);
+		pthread_mutex_destroy(&s->fd_mutex);
+		return -1;
+	}
 
+	return 0;
+}
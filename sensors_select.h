@@ -16,7 +16,8 @@
 
 #ifndef SENSORS_SELECT_H_
 #define SENSORS_SELECT_H_
-#include "sensors_worker.h"
+#include <stdint.h>
+#include <pthread.h>
 
 struct sensors_select_t {
 	void (*suspend)(struct sensors_select_t* s);
@@ -27,14 +28,18 @@ struct sensors_select_t {
 	int (*get_fd)(struct sensors_select_t* s);
 	void* (*select_callback)(void* arg);
 
-	struct sensors_worker_t worker;
-	int ctl_fds[2];
+	int epoll_id;
+	uint32_t token;
+	int suspended;
+	int registered;
 	int fd;
 	pthread_mutex_t fd_mutex;
 	void *arg;
 	int64_t delay;
+	/* sensor charged with the wakeups and reads, -1 until set */
+	int handle;
 };
 
-void sensors_select_init(struct sensors_select_t* s,
+int sensors_select_init(struct sensors_select_t* s,
 			void* (*select_func)(void *arg), void* arg, int fd);
 #endif
@@ -17,21 +17,32 @@
 #define LOG_TAG "DASH"
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include "sensors_log.h"
 #include "sensors_input_cache.h"
+#include "sensors_metrics.h"
 #include "sensors_sysfs.h"
 
 static const char *input_class_path = "/sys/class/input/input";
 
-static int sensors_sysfs_write(struct sensors_sysfs_t* s, const char* attribute,
-			       const char *value, const int length)
+/*
+ * Attributes are opened on first use and kept open, values are written
+ * with pwrite at offset 0. The last value written to each attribute is
+ * remembered so that setting the same rate or enable state again doesn't
+ * reach the kernel at all.
+ */
+static int sensors_sysfs_open(struct sensors_sysfs_t* s, const char* attribute)
 {
-	char sysfs_path[SYSFS_PATH_MAX];
+	char sysfs_path[SYSFS_PATH_MAX + SYSFS_ATTR_NAME_MAX];
 	int sysfs_fd;
 	int count;
-	int ret;
+
+	if (!s->data.path[0])
+		return -ENODEV;
 
 	count = snprintf(sysfs_path, sizeof(sysfs_path), "%s/%s",
 			 s->data.path, attribute);
@@ -40,18 +51,138 @@ static int sensors_sysfs_write(struct sensors_sysfs_t* s, const char* attribute,
 		return -1;
 	}
 
-	sysfs_fd = open(sysfs_path, O_RDWR);
+	sysfs_fd = open(sysfs_path, O_WRONLY);
 	if (sysfs_fd < 0)
 		return -errno;
 
-	ret = write(sysfs_fd, value, length);
-	if (ret < 0)
+	return sysfs_fd;
+}
+
+static struct sysfs_attr_t *sensors_sysfs_attr(struct sensors_sysfs_t* s,
+					       const char* attribute)
+{
+	struct sysfs_data_t *data = &s->data;
+	struct sysfs_attr_t *a;
+	int i;
+
+	for (i = 0; i < data->nr_attr; i++) {
+		if (!strcmp(data->attr[i].name, attribute))
+			return &data->attr[i];
+	}
+
+	if ((data->nr_attr == SYSFS_ATTR_MAX) ||
+	    (strlen(attribute) >= sizeof(a->name)))
+		return NULL;
+
+	a = &data->attr[data->nr_attr++];
+	strlcpy(a->name, attribute, sizeof(a->name));
+	a->fd = -1;
+	a->len = -1;
+
+	return a;
+}
+
+static int sensors_sysfs_pwrite(struct sensors_sysfs_t* s,
+				struct sysfs_attr_t *a,
+				const char *value, const int length)
+{
+	/* a kept fd goes stale if the device is unbound and probed again */
+	int retry = a->fd >= 0;
+	int ret;
+
+	while (1) {
+		if (a->fd < 0) {
+			a->fd = sensors_sysfs_open(s, a->name);
+			if (a->fd < 0) {
+				ret = a->fd;
+				a->fd = -1;
+				return ret;
+			}
+		}
+
+		ret = pwrite(a->fd, value, length, 0);
+		if (ret >= 0) {
+			sensors_metrics_pending(METRIC_SYSFS_WRITES, 1);
+			return ret;
+		}
+
 		ret = -errno;
-	close(sysfs_fd);
+		if (!retry || ret != -ENODEV)
+			return ret;
+
+		close(a->fd);
+		a->fd = -1;
+		retry = 0;
+	}
+}
+
+static int sensors_sysfs_store(struct sensors_sysfs_t* s, const char* attribute,
+			       const char *value, const int length, int force)
+{
+	struct sysfs_attr_t *a;
+	int sysfs_fd;
+	int ret;
+
+	pthread_mutex_lock(&s->data.lock);
+	a = sensors_sysfs_attr(s, attribute);
+	if (!a) {
+		/* nothing to cache it in, write it the old way */
+		sysfs_fd = sensors_sysfs_open(s, attribute);
+		if (sysfs_fd < 0) {
+			ret = sysfs_fd;
+			goto exit;
+		}
+		ret = write(sysfs_fd, value, length);
+		if (ret < 0)
+			ret = -errno;
+		close(sysfs_fd);
+		goto exit;
+	}
+
+	if (!force && (a->len == length) && !memcmp(a->value, value, length)) {
+		ret = length;
+		goto exit;
+	}
+
+	ret = sensors_sysfs_pwrite(s, a, value, length);
+	if ((ret >= 0) && (length <= (int)sizeof(a->value))) {
+		memcpy(a->value, value, length);
+		a->len = length;
+	} else {
+		a->len = -1;
+	}
+exit:
+	pthread_mutex_unlock(&s->data.lock);
 
 	return ret;
 }
 
+static int sensors_sysfs_write(struct sensors_sysfs_t* s, const char* attribute,
+			       const char *value, const int length)
+{
+	return sensors_sysfs_store(s, attribute, value, length, 0);
+}
+
+static int sensors_sysfs_trigger(struct sensors_sysfs_t* s,
+				 const char* attribute,
+				 const char *value, const int length)
+{
+	return sensors_sysfs_store(s, attribute, value, length, 1);
+}
+
+static void sensors_sysfs_close(struct sensors_sysfs_t* s)
+{
+	int i;
+
+	pthread_mutex_lock(&s->data.lock);
+	for (i = 0; i < s->data.nr_attr; i++) {
+		if (s->data.attr[i].fd >= 0)
+			close(s->data.attr[i].fd);
+	}
+	s->data.nr_attr = 0;
+	pthread_mutex_unlock(&s->data.lock);
+}
+
 static int sensors_sysfs_write_int(struct sensors_sysfs_t* s, const char* attribute,
 			       const long long value) {
 	char buf[32];
@@ -69,18 +200,28 @@ static int sensors_sysfs_write_int(struct sensors_sysfs_t* s, const char* attrib
 int sensors_sysfs_init(struct sensors_sysfs_t* s, const char *str,
 		       enum sensors_sysfs_type type)
 {
-	const struct sensors_input_cache_entry_t *input;
+	struct sensors_input_cache_entry_t input;
 	int count;
 
+	/* until a path is set, e.g. for a replayed device, writes fail */
+	pthread_mutex_init(&s->data.lock, NULL);
+	s->data.nr_attr = 0;
+	s->data.path[0] = '\0';
+
+	s->write = sensors_sysfs_write;
+	s->write_int = sensors_sysfs_write_int;
+	s->trigger = sensors_sysfs_trigger;
+	s->close = sensors_sysfs_close;
+
 	switch (type) {
 	case SYSFS_TYPE_INPUT_DEV:
-		input = sensors_input_cache_get(str);
-		if (!input) {
+		if (sensors_input_cache_get(str, &input) < 0) {
 			ALOGE("sensors_input_cache_get failed!\n");
 			return -1;
 		}
-		count = snprintf(s->data.path, sizeof(s->data.path), "%s%d",
-				 input_class_path, input->nr);
+		count = snprintf(s->data.path, sizeof(s->data.path), "%s%s%d",
+				 sensors_config_get_root(), input_class_path,
+				 input.nr);
 		if ((count < 0) || (count >= (int)sizeof(s->data.path))) {
 			ALOGE("%s: snprintf failed!\n", __func__);
 			return -1;
@@ -96,8 +237,5 @@ int sensors_sysfs_init(struct sensors_sysfs_t* s, const char *str,
 		return -1;
 	}
 
-	s->write = sensors_sysfs_write;
-	s->write_int = sensors_sysfs_write_int;
-
 	return 0;
 }
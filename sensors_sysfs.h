@@ -1,21 +1,47 @@
 #ifndef SENSORS_SYSFS_H_
 #define SENSORS_SYSFS_H_
+#include <pthread.h>
+#include "sensors_config.h"
 
 enum sensors_sysfs_type {
 	SYSFS_TYPE_ABS_PATH,
 	SYSFS_TYPE_INPUT_DEV
 };
 
-#define SYSFS_PATH_MAX 64
+#define SYSFS_PATH_MAX (CONFIG_ROOT_MAX + 64)
+#define SYSFS_ATTR_MAX 8
+#define SYSFS_ATTR_NAME_MAX 32
+#define SYSFS_VALUE_MAX 32
+
+/* an attribute opened once and the last value written to it */
+struct sysfs_attr_t {
+	char name[SYSFS_ATTR_NAME_MAX];
+	int fd;
+	int len;
+	char value[SYSFS_VALUE_MAX];
+};
+
 struct sysfs_data_t {
 	char path[SYSFS_PATH_MAX];
+	pthread_mutex_t lock;
+	int nr_attr;
+	struct sysfs_attr_t attr[SYSFS_ATTR_MAX];
 };
 
+/*
+ * write and write_int skip a value equal to the last one written to the
+ * attribute. trigger always writes, for attributes where every write is a
+ * command. close drops the open attributes and the remembered values,
+ * e.g. when the device has gone away.
+ */
 struct sensors_sysfs_t {
 	int (*write)(struct sensors_sysfs_t* s, const char* attribute,
 		     const char *value, const int length);
 	int (*write_int)(struct sensors_sysfs_t* s, const char* attribute,
 			 const long long value);
+	int (*trigger)(struct sensors_sysfs_t* s, const char* attribute,
+		       const char *value, const int length);
+	void (*close)(struct sensors_sysfs_t* s);
 
 	struct sysfs_data_t data;
 };
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "DASH - timer"
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "sensors_log.h"
+#include "sensors_config.h"
+#include "sensors_timer.h"
+
+/*
+ * All periodic work of the polled sensors runs on one thread. Armed timers
+ * are hashed on their deadline into a wheel of TIMER_SLOTS slots, each
+ * covering one tick, so arming and cancelling are O(1) and finding the next
+ * deadline normally only looks at the slots right ahead.
+ *
+ * The thread sleeps on a timerfd set to the earliest deadline. Once awake
+ * it runs every timer due within its slack as well, so sensors polled at
+ * related rates share a wakeup instead of each getting its own. The
+ * largest slack a timer may use is read from the config file (timer_slack,
+ * in microseconds).
+ *
+ * Like the epoll reactor the thread is started on first use and then lives
+ * as long as the HAL.
+ */
+#define TIMER_TICK_SHIFT	21		/* ~2 ms */
+#define TIMER_SLOTS		512		/* ~1 s per turn */
+#define TIMER_SLACK_DEFAULT	2000
+#define TIMER_SLACK_MAX		100000
+#define NSEC_PER_SEC		1000000000LL
+
+static struct sensors_timer_wheel {
+	pthread_mutex_t mutex;
+	pthread_cond_t done_cond;
+	pthread_t thread;
+	int started;
+	int fd;
+	int64_t max_slack;
+	int64_t cur_tick;
+	int64_t wakeup;
+	struct sensors_timer_t *running;
+	struct sensors_timer_t *slots[TIMER_SLOTS];
+} wheel = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+};
+
+static inline int64_t timer_tick(int64_t ns)
+{
+	return ns >> TIMER_TICK_SHIFT;
+}
+
+int64_t sensors_timer_now()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * NSEC_PER_SEC + t.tv_nsec;
+}
+
+static void timer_link(struct sensors_timer_t *t)
+{
+	struct sensors_timer_t **slot;
+
+	/* a deadline already passed goes where the thread looks next */
+	t->tick = timer_tick(t->deadline);
+	if (t->tick < wheel.cur_tick)
+		t->tick = wheel.cur_tick;
+
+	slot = &wheel.slots[t->tick & (TIMER_SLOTS - 1)];
+	t->next = *slot;
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = slot;
+	*slot = t;
+	t->armed = 1;
+}
+
+static void timer_unlink(struct sensors_timer_t *t)
+{
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->next = NULL;
+	t->pprev = NULL;
+	t->armed = 0;
+}
+
+/* unlinks and returns one timer which is due at now, if any */
+static struct sensors_timer_t *timer_expired(int64_t now)
+{
+	struct sensors_timer_t *t;
+	int64_t last = timer_tick(now + wheel.max_slack);
+	int64_t tick;
+
+	for (tick = wheel.cur_tick; tick <= last &&
+	     tick < wheel.cur_tick + TIMER_SLOTS; tick++) {
+		for (t = wheel.slots[tick & (TIMER_SLOTS - 1)]; t; t = t->next) {
+			if (t->deadline - t->slack <= now) {
+				timer_unlink(t);
+				return t;
+			}
+		}
+	}
+
+	/* everything left is due after now */
+	wheel.cur_tick = timer_tick(now);
+	return NULL;
+}
+
+/* earliest deadline of all armed timers, 0 if there are none */
+static int64_t timer_next()
+{
+	struct sensors_timer_t *t;
+	int64_t next = 0;
+	int64_t tick;
+	int i;
+
+	for (tick = wheel.cur_tick; tick < wheel.cur_tick + TIMER_SLOTS;
+	     tick++) {
+		for (t = wheel.slots[tick & (TIMER_SLOTS - 1)]; t; t = t->next)
+			if (t->tick == tick && (!next || t->deadline < next))
+				next = t->deadline;
+		if (next)
+			return next;
+	}
+
+	/* nothing due within one turn of the wheel, look at all of them */
+	for (i = 0; i < TIMER_SLOTS; i++)
+		for (t = wheel.slots[i]; t; t = t->next)
+			if (!next || t->deadline < next)
+				next = t->deadline;
+
+	return next;
+}
+
+/* called with the mutex held so wakeups are never set out of order */
+static void timer_program(int64_t deadline)
+{
+	struct itimerspec its;
+
+	if (deadline == wheel.wakeup)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / NSEC_PER_SEC;
+	its.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	if (timerfd_settime(wheel.fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		ALOGE("%s: timerfd_settime failed: %s", __func__,
+		      strerror(errno));
+		return;
+	}
+	wheel.wakeup = deadline;
+}
+
+static void *sensors_timer_loop(void *arg)
+{
+	struct sensors_timer_t *t;
+	uint64_t expirations;
+
+	pthread_mutex_lock(&wheel.mutex);
+	while (1) {
+		t = timer_expired(sensors_timer_now());
+		if (t) {
+			wheel.running = t;
+			pthread_mutex_unlock(&wheel.mutex);
+			t->func(t);
+			pthread_mutex_lock(&wheel.mutex);
+			wheel.running = NULL;
+			pthread_cond_broadcast(&wheel.done_cond);
+			continue;
+		}
+
+		timer_program(timer_next());
+		pthread_mutex_unlock(&wheel.mutex);
+
+		if (read(wheel.fd, &expirations, sizeof(expirations)) < 0 &&
+		    errno != EINTR)
+			ALOGE("%s: read failed: %s", __func__, strerror(errno));
+
+		pthread_mutex_lock(&wheel.mutex);
+		wheel.wakeup = 0;
+	}
+
+	return NULL;
+}
+
+static int sensors_timer_start()
+{
+	int slack;
+
+	if (sensors_config_get_key("timer", "slack", TYPE_INT, &slack,
+				   sizeof(slack)) < 0)
+		slack = TIMER_SLACK_DEFAULT;
+	if (slack < 0 || slack > TIMER_SLACK_MAX) {
+		ALOGE("%s: timer_slack out of bounds: %d", __func__, slack);
+		slack = TIMER_SLACK_DEFAULT;
+	}
+	wheel.max_slack = slack * 1000LL;
+
+	wheel.fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (wheel.fd < 0) {
+		ALOGE("%s: timerfd_create failed: %s", __func__,
+		      strerror(errno));
+		return -1;
+	}
+
+	wheel.cur_tick = timer_tick(sensors_timer_now());
+	if (pthread_create(&wheel.thread, NULL, sensors_timer_loop, NULL)) {
+		ALOGE("%s: unable to start timer thread", __func__);
+		close(wheel.fd);
+		wheel.fd = -1;
+		return -1;
+	}
+	wheel.started = 1;
+
+	ALOGI("%s: timer thread started, slack %d us", __func__, slack);
+	return 0;
+}
+
+void sensors_timer_init(struct sensors_timer_t *t,
+			void (*func)(struct sensors_timer_t *t))
+{
+	memset(t, 0, sizeof(*t));
+	t->func = func;
+}
+
+void sensors_timer_arm(struct sensors_timer_t *t, int64_t deadline,
+		       int64_t slack)
+{
+	pthread_mutex_lock(&wheel.mutex);
+	if (!wheel.started && sensors_timer_start() < 0)
+		goto exit;
+
+	if (t->armed)
+		timer_unlink(t);
+	t->deadline = deadline;
+	t->slack = slack < wheel.max_slack ? slack : wheel.max_slack;
+	timer_link(t);
+
+	/* an idle thread has to wake up earlier for this one */
+	if (wheel.running == NULL && (!wheel.wakeup ||
+				      deadline < wheel.wakeup))
+		timer_program(deadline);
+exit:
+	pthread_mutex_unlock(&wheel.mutex);
+}
+
+/* once this returns the timer is neither armed nor running */
+void sensors_timer_cancel(struct sensors_timer_t *t)
+{
+	pthread_mutex_lock(&wheel.mutex);
+	if (t->armed)
+		timer_unlink(t);
+	while (wheel.running == t &&
+	       !pthread_equal(pthread_self(), wheel.thread))
+		pthread_cond_wait(&wheel.done_cond, &wheel.mutex);
+	pthread_mutex_unlock(&wheel.mutex);
+}
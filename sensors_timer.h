@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SENSORS_TIMER_H_
+#define SENSORS_TIMER_H_
+#include <stdint.h>
+
+/*
+ * Timers run on the shared timer thread. func is called once the deadline
+ * (CLOCK_MONOTONIC, ns) has passed, or up to slack ns earlier when the
+ * thread is awake for another timer anyway. A timer is one-shot, func may
+ * arm it again.
+ */
+struct sensors_timer_t {
+	void (*func)(struct sensors_timer_t *t);
+	int64_t deadline;
+	int64_t slack;
+	int64_t tick;
+	int armed;
+	struct sensors_timer_t *next;
+	struct sensors_timer_t **pprev;
+};
+
+void sensors_timer_init(struct sensors_timer_t *t,
+			void (*func)(struct sensors_timer_t *t));
+void sensors_timer_arm(struct sensors_timer_t *t, int64_t deadline,
+		       int64_t slack);
+void sensors_timer_cancel(struct sensors_timer_t *t);
+int64_t sensors_timer_now();
+
+#endif
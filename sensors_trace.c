@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "DASH - trace"
+
+#include "sensors_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "sensor_util.h"
+#include "sensors_config.h"
+#include "sensors_trace.h"
+
+/*
+ * Recording is off unless the config file names a trace file. Records
+ * from the reactor threads and the control calls are serialized by one
+ * mutex and written through a large stdio buffer, so a recording HAL only
+ * pays for a memcpy on most reads.
+ *
+ * Replay doesn't go through here, a replayer points the input device
+ * names at nodes of its own (see test/sensors_replay.c) and the drivers
+ * read those with their usual read functions.
+ */
+#define TRACE_BUF_SIZE		(64 * 1024)
+#define TRACE_NAME_MAX		64
+#define TRACE_INPUTS_MAX	16
+
+struct trace_input {
+	char name[TRACE_NAME_MAX];
+	char path[PATH_MAX];
+};
+
+static struct sensors_trace_t {
+	pthread_mutex_t mutex;
+	FILE *file;
+	char *buf;
+	int nr_devices;
+	int nr_inputs;
+	struct trace_input inputs[TRACE_INPUTS_MAX];
+} trace = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void trace_write(int type, int id, int64_t value, const void *payload,
+			int len)
+{
+	struct trace_record rec;
+
+	rec.type = type;
+	rec.len = len;
+	rec.id = id;
+	rec.time = get_current_nano_time();
+	rec.value = value;
+
+	pthread_mutex_lock(&trace.mutex);
+	if (trace.file && (fwrite(&rec, sizeof(rec), 1, trace.file) != 1 ||
+	    (len && fwrite(payload, len, 1, trace.file) != 1))) {
+		ALOGE("%s: write failed, recording stopped: %s", __func__,
+		      strerror(errno));
+		fclose(trace.file);
+		__atomic_store_n(&trace.file, NULL, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&trace.mutex);
+}
+
+static inline int trace_recording()
+{
+	return __atomic_load_n(&trace.file, __ATOMIC_RELAXED) != NULL;
+}
+
+void sensors_trace_init()
+{
+	char path[PATH_MAX];
+	struct trace_header hdr;
+	FILE *file;
+
+	if (sensors_config_get_key("trace", "record", TYPE_STRING, path,
+				   sizeof(path)) < 0)
+		return;
+
+	file = fopen(path, "w");
+	if (!file) {
+		ALOGE("%s: unable to open %s: %s", __func__, path,
+		      strerror(errno));
+		return;
+	}
+	trace.buf = malloc(TRACE_BUF_SIZE);
+	if (trace.buf)
+		setvbuf(file, trace.buf, _IOFBF, TRACE_BUF_SIZE);
+
+	hdr.magic = TRACE_MAGIC;
+	hdr.version = TRACE_VERSION;
+	hdr.start = get_current_nano_time();
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+		ALOGE("%s: unable to write %s", __func__, path);
+		fclose(file);
+		free(trace.buf);
+		trace.buf = NULL;
+		return;
+	}
+
+	pthread_mutex_lock(&trace.mutex);
+	trace.nr_devices = 0;
+	__atomic_store_n(&trace.file, file, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&trace.mutex);
+	ALOGI("%s: recording to %s", __func__, path);
+}
+
+void sensors_trace_close()
+{
+	pthread_mutex_lock(&trace.mutex);
+	if (trace.file) {
+		fclose(trace.file);
+		__atomic_store_n(&trace.file, NULL, __ATOMIC_RELAXED);
+	}
+	free(trace.buf);
+	trace.buf = NULL;
+	pthread_mutex_unlock(&trace.mutex);
+}
+
+/* returns the id to record reads of fd with, or -1 when not recording */
+int sensors_trace_device(int fd)
+{
+	char name[TRACE_NAME_MAX];
+	int id;
+
+	if (!trace_recording())
+		return -1;
+
+	memset(name, 0, sizeof(name));
+	if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) < 0) {
+		ALOGE("%s: fd %d is not an input device", __func__, fd);
+		return -1;
+	}
+
+	id = __atomic_fetch_add(&trace.nr_devices, 1, __ATOMIC_RELAXED);
+	trace_write(TRACE_DEVICE, id, 0, name, strlen(name));
+
+	return id;
+}
+
+/* without a boottime stamp the read time is the sample time, as in
+   input_reader_time */
+void sensors_trace_input(int id, int boottime, const struct input_event *ev,
+			 int n)
+{
+	struct trace_event events[INPUT_READER_LEN];
+	int64_t now = get_current_nano_time();
+	int i;
+
+	if (n > INPUT_READER_LEN)
+		n = INPUT_READER_LEN;
+
+	for (i = 0; i < n; i++) {
+		events[i].time = boottime ?
+			(int64_t)ev[i].time.tv_sec * 1000000000LL +
+			(int64_t)ev[i].time.tv_usec * 1000 : now;
+		events[i].type = ev[i].type;
+		events[i].code = ev[i].code;
+		events[i].value = ev[i].value;
+	}
+
+	trace_write(TRACE_INPUT, id, n, events, n * sizeof(events[0]));
+}
+
+void sensors_trace_control(int type, int handle, int64_t value)
+{
+	if (trace_recording())
+		trace_write(type, handle, value, NULL, 0);
+}
+
+void sensors_trace_batch(int handle, int flags, int64_t ns, int64_t timeout)
+{
+	struct trace_batch batch;
+
+	if (!trace_recording())
+		return;
+
+	batch.flags = flags;
+	batch.reserved = 0;
+	batch.timeout = timeout;
+	trace_write(TRACE_BATCH, handle, ns, &batch, sizeof(batch));
+}
+
+int sensors_trace_set_input(const char *name, const char *path)
+{
+	struct trace_input *in;
+
+	if (trace.nr_inputs == TRACE_INPUTS_MAX) {
+		ALOGE("%s: too many inputs", __func__);
+		return -1;
+	}
+
+	in = &trace.inputs[trace.nr_inputs++];
+	strlcpy(in->name, name, sizeof(in->name));
+	strlcpy(in->path, path, sizeof(in->path));
+
+	return 0;
+}
+
+const char *sensors_trace_get_input(const char *name)
+{
+	int i;
+
+	for (i = 0; i < trace.nr_inputs; i++) {
+		if (!strcmp(trace.inputs[i].name, name))
+			return trace.inputs[i].path;
+	}
+
+	return NULL;
+}
+
+int sensors_trace_is_input(const char *path)
+{
+	int i;
+
+	for (i = 0; i < trace.nr_inputs; i++) {
+		if (!strcmp(trace.inputs[i].path, path))
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_TRACE_H_
+#define SENSORS_TRACE_H_
+#include <stdint.h>
+#include <linux/input.h>
+
+/*
+ * Binary trace of the raw input read by the drivers and of the control
+ * calls made on the HAL, in host byte order. The file starts with a
+ * trace_header, followed by records each made of a trace_record and len
+ * bytes of payload:
+ *
+ *   TRACE_DEVICE    id: device, value: 0, payload: input device name
+ *   TRACE_INPUT     id: device, value: events, payload: trace_event[]
+ *   TRACE_ACTIVATE  id: handle, value: enable
+ *   TRACE_SET_DELAY id: handle, value: ns
+ *   TRACE_BATCH     id: handle, value: ns, payload: trace_batch
+ *   TRACE_FLUSH     id: handle
+ *
+ * Times are CLOCK_BOOTTIME in ns. A device id is handed out each time a
+ * driver starts reading a device node, so one name may get several.
+ */
+#define TRACE_MAGIC	0x43525444	/* "DTRC" */
+#define TRACE_VERSION	1
+
+enum trace_type {
+	TRACE_DEVICE = 1,
+	TRACE_INPUT,
+	TRACE_ACTIVATE,
+	TRACE_SET_DELAY,
+	TRACE_BATCH,
+	TRACE_FLUSH,
+};
+
+struct trace_header {
+	uint32_t magic;
+	uint32_t version;
+	int64_t start;
+};
+
+struct trace_record {
+	uint16_t type;
+	uint16_t len;
+	int32_t id;
+	int64_t time;
+	int64_t value;
+};
+
+struct trace_event {
+	int64_t time;
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+};
+
+struct trace_batch {
+	int32_t flags;
+	int32_t reserved;
+	int64_t timeout;
+};
+
+/* recording, enabled by trace_record = <file> in the config file */
+void sensors_trace_init();
+void sensors_trace_close();
+int sensors_trace_device(int fd);
+void sensors_trace_input(int id, int boottime, const struct input_event *ev,
+			 int n);
+void sensors_trace_control(int type, int handle, int64_t value);
+void sensors_trace_batch(int handle, int flags, int64_t ns, int64_t timeout);
+
+/*
+ * replay, makes the drivers open path instead of the named input device,
+ * whose events the replayer stamps with boottime
+ */
+int sensors_trace_set_input(const char *name, const char *path);
+const char *sensors_trace_get_input(const char *name);
+int sensors_trace_is_input(const char *path);
+
+#endif
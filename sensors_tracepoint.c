@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DASH - tracepoint"
+
+#include "sensors_tracepoint.h"
+
+#ifdef DASH_TRACEPOINTS
+
+#include "sensors_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "sensor_util.h"
+#include "sensors_config.h"
+
+/*
+ * A thread gets a ring the first time it hits a tracepoint. It is the only
+ * writer of its ring, so a tracepoint is a clock read and a store of one
+ * record. The oldest records are overwritten. A dump copies the rings
+ * while they are being written and drops what was overwritten during the
+ * copy.
+ *
+ * The ring length can be set with tracepoint_ring, it is rounded up to a
+ * power of two.
+ */
+#define TRACEPOINT_RING_DEFAULT	4096
+#define TRACEPOINT_RING_MAX	65536
+#define TRACEPOINT_RINGS_MAX	32
+#define TRACEPOINT_MARKER	"/sys/kernel/debug/tracing/trace_marker"
+#define TRACEPOINT_MARKER_LEN	96
+
+struct tracepoint_ring {
+	int32_t tid;
+	uint32_t mask;
+	uint32_t head;
+	struct tracepoint_record *records;
+};
+
+static struct sensors_tracepoint_t {
+	pthread_once_t once;
+	pthread_key_t ring_key;
+	uint32_t len;
+	unsigned int nr_rings;
+	struct tracepoint_ring rings[TRACEPOINT_RINGS_MAX];
+	int marker_fd;
+	char file[PATH_MAX];
+} tp = {
+	.once = PTHREAD_ONCE_INIT,
+	.len = TRACEPOINT_RING_DEFAULT,
+	.marker_fd = -1,
+};
+
+static const char *stage_name[TP_STAGES] = {
+	[TP_WAKEUP] = "wakeup",
+	[TP_READ] = "read",
+	[TP_WRAPPER] = "wrapper",
+	[TP_CLIENT] = "client",
+	[TP_FUSION] = "fusion",
+	[TP_PUT] = "put",
+	[TP_POLL] = "poll",
+};
+
+/* threads beyond the last ring are remembered with this, and not traced */
+static struct tracepoint_ring no_ring;
+
+static void tracepoint_key_create()
+{
+	pthread_key_create(&tp.ring_key, NULL);
+}
+
+static struct tracepoint_ring *tracepoint_ring()
+{
+	struct tracepoint_ring *r;
+	struct tracepoint_record *records;
+	uint32_t len = __atomic_load_n(&tp.len, __ATOMIC_RELAXED);
+	unsigned int i;
+
+	pthread_once(&tp.once, tracepoint_key_create);
+	r = pthread_getspecific(tp.ring_key);
+	if (r)
+		return r == &no_ring ? NULL : r;
+
+	i = __atomic_fetch_add(&tp.nr_rings, 1, __ATOMIC_RELAXED);
+	records = i < TRACEPOINT_RINGS_MAX ?
+		calloc(len, sizeof(*records)) : NULL;
+	if (!records) {
+		pthread_setspecific(tp.ring_key, &no_ring);
+		return NULL;
+	}
+
+	r = &tp.rings[i];
+	r->tid = syscall(__NR_gettid);
+	r->mask = len - 1;
+	r->head = 0;
+	__atomic_store_n(&r->records, records, __ATOMIC_RELEASE);
+	pthread_setspecific(tp.ring_key, r);
+
+	return r;
+}
+
+static void tracepoint_marker(const struct tracepoint_record *rec)
+{
+	char buf[TRACEPOINT_MARKER_LEN];
+	int n;
+
+	n = snprintf(buf, sizeof(buf), "dash: %s sensor=%d sample=%lld arg=%d",
+		     stage_name[rec->stage], rec->sensor,
+		     (long long)rec->sample, rec->arg);
+	if (n > 0 && n < (int)sizeof(buf))
+		write(tp.marker_fd, buf, n);
+}
+
+void sensors_tracepoint(enum tracepoint_stage stage, int sensor,
+			int64_t sample, int arg)
+{
+	struct tracepoint_ring *r = tracepoint_ring();
+	struct tracepoint_record *rec;
+
+	if (!r)
+		return;
+
+	rec = &r->records[r->head & r->mask];
+	rec->time = get_current_nano_time();
+	rec->sample = sample;
+	rec->sensor = sensor;
+	rec->stage = stage;
+	rec->arg = arg;
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+
+	if (__atomic_load_n(&tp.marker_fd, __ATOMIC_RELAXED) >= 0)
+		tracepoint_marker(rec);
+}
+
+/* copies the records still valid after the copy, oldest first */
+static uint32_t tracepoint_copy(struct tracepoint_ring *r,
+				struct tracepoint_record *out)
+{
+	uint32_t len = r->mask + 1;
+	uint32_t head, start, end, i;
+
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	start = head > len ? head - len : 0;
+	for (i = start; i != head; i++)
+		out[i - start] = r->records[i & r->mask];
+
+	/*
+	 * Records the writer got to during the copy are torn. Writing record
+	 * end may already be overwriting the slot of end - len, so that one
+	 * goes as well.
+	 */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	end = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	if (end + 1 - start > len) {
+		i = end + 1 - len - start;
+		if (i > head - start)
+			i = head - start;
+		memmove(out, out + i, (head - start - i) * sizeof(*out));
+		return head - start - i;
+	}
+
+	return head - start;
+}
+
+int sensors_tracepoint_dump(const char *path)
+{
+	struct tracepoint_header hdr;
+	struct tracepoint_ring_header rh;
+	struct tracepoint_record *buf;
+	struct tracepoint_ring *r;
+	unsigned int nr, i;
+	FILE *file;
+	int ret = 0;
+
+	nr = __atomic_load_n(&tp.nr_rings, __ATOMIC_RELAXED);
+	if (nr > TRACEPOINT_RINGS_MAX)
+		nr = TRACEPOINT_RINGS_MAX;
+
+	buf = malloc(TRACEPOINT_RING_MAX * sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	file = fopen(path, "w");
+	if (!file) {
+		ret = -errno;
+		ALOGE("%s: unable to open %s: %s", __func__, path,
+		      strerror(errno));
+		free(buf);
+		return ret;
+	}
+
+	hdr.magic = TRACEPOINT_MAGIC;
+	hdr.version = TRACEPOINT_VERSION;
+	hdr.nr_rings = 0;
+	for (i = 0; i < nr; i++)
+		if (__atomic_load_n(&tp.rings[i].records, __ATOMIC_ACQUIRE))
+			hdr.nr_rings++;
+	hdr.reserved = 0;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1)
+		ret = -EIO;
+
+	for (i = 0; i < nr && !ret; i++) {
+		r = &tp.rings[i];
+		if (!__atomic_load_n(&r->records, __ATOMIC_ACQUIRE))
+			continue;
+
+		rh.tid = r->tid;
+		rh.count = tracepoint_copy(r, buf);
+		if (fwrite(&rh, sizeof(rh), 1, file) != 1 ||
+		    (rh.count &&
+		     fwrite(buf, sizeof(*buf), rh.count, file) != rh.count))
+			ret = -EIO;
+	}
+
+	if (fclose(file) && !ret)
+		ret = -EIO;
+	if (ret)
+		ALOGE("%s: unable to write %s", __func__, path);
+	else
+		ALOGI("%s: %u rings written to %s", __func__, hdr.nr_rings,
+		      path);
+	free(buf);
+
+	return ret;
+}
+
+void sensors_tracepoint_init()
+{
+	char path[PATH_MAX];
+	int value;
+	uint32_t len = 1;
+
+	if (!sensors_config_get_key("tracepoint", "ring", TYPE_INT, &value,
+				    sizeof(value))) {
+		if (value < 1 || value > TRACEPOINT_RING_MAX) {
+			ALOGE("%s: tracepoint_ring out of bounds: %d",
+			      __func__, value);
+			value = TRACEPOINT_RING_DEFAULT;
+		}
+		while (len < (uint32_t)value)
+			len <<= 1;
+		__atomic_store_n(&tp.len, len, __ATOMIC_RELAXED);
+	}
+
+	if (sensors_config_get_key("tracepoint", "file", TYPE_STRING, tp.file,
+				   sizeof(tp.file)) < 0)
+		tp.file[0] = '\0';
+
+	if (!sensors_config_get_key("tracepoint", "marker", TYPE_INT, &value,
+				    sizeof(value)) && value &&
+	    !dev_root_path(TRACEPOINT_MARKER, path, sizeof(path))) {
+		value = open(path, O_WRONLY | O_CLOEXEC);
+		if (value < 0)
+			ALOGE("%s: unable to open %s: %s", __func__, path,
+			      strerror(errno));
+		__atomic_store_n(&tp.marker_fd, value, __ATOMIC_RELAXED);
+	}
+}
+
+void sensors_tracepoint_close()
+{
+	int fd = __atomic_exchange_n(&tp.marker_fd, -1, __ATOMIC_RELAXED);
+
+	if (fd >= 0)
+		close(fd);
+
+	if (tp.file[0])
+		sensors_tracepoint_dump(tp.file);
+}
+
+#endif
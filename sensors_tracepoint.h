@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORS_TRACEPOINT_H_
+#define SENSORS_TRACEPOINT_H_
+#include <stdint.h>
+
+/*
+ * Tracepoints on the stages a sample passes on its way to poll. Each
+ * thread records into a ring of its own, the rings are written to the
+ * file named by tracepoint_file when the HAL is closed. With
+ * tracepoint_marker = 1 every tracepoint is also written to the ftrace
+ * trace_marker. test/sensors_timeline.c turns a dump into per-sample
+ * timelines.
+ *
+ * Only built with DASH_TRACEPOINTS defined, otherwise every TRACEPOINT()
+ * compiles to nothing.
+ *
+ * A sample is identified by its timestamp. TP_WAKEUP has no sample yet,
+ * it belongs to the next TP_READ on the same thread.
+ *
+ *   TP_WAKEUP   reactor or worker thread woke up for a sensor
+ *   TP_READ     input_reader_frame() handed out a frame
+ *   TP_WRAPPER  sensors_wrapper_data() got the sample, sensor: wrapped
+ *   TP_CLIENT   a wrapper client data callback, arg: client index
+ *   TP_FUSION   a fusion engine started on the sample
+ *   TP_PUT      sensors_fifo_put()
+ *   TP_POLL     returned from poll
+ */
+#define TRACEPOINT_MAGIC	0x54505444	/* "DTPT" */
+#define TRACEPOINT_VERSION	1
+
+enum tracepoint_stage {
+	TP_WAKEUP,
+	TP_READ,
+	TP_WRAPPER,
+	TP_CLIENT,
+	TP_FUSION,
+	TP_PUT,
+	TP_POLL,
+	TP_STAGES
+};
+
+/* dump: header, then for every ring a ring header and its records */
+struct tracepoint_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_rings;
+	uint32_t reserved;
+};
+
+struct tracepoint_ring_header {
+	int32_t tid;
+	uint32_t count;
+};
+
+struct tracepoint_record {
+	int64_t time;
+	int64_t sample;
+	int32_t sensor;
+	uint16_t stage;
+	uint16_t arg;
+};
+
+#ifdef DASH_TRACEPOINTS
+void sensors_tracepoint_init();
+void sensors_tracepoint_close();
+int sensors_tracepoint_dump(const char *path);
+void sensors_tracepoint(enum tracepoint_stage stage, int sensor,
+			int64_t sample, int arg);
+
+#define TRACEPOINT(stage, sensor, sample, arg) \
+	sensors_tracepoint(stage, sensor, sample, arg)
+#define TRACEPOINT_INIT()	sensors_tracepoint_init()
+#define TRACEPOINT_CLOSE()	sensors_tracepoint_close()
+#else
+#define TRACEPOINT(stage, sensor, sample, arg)	do { } while (0)
+#define TRACEPOINT_INIT()	do { } while (0)
+#define TRACEPOINT_CLOSE()	do { } while (0)
+#endif
+
+#endif
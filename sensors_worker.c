@@ -20,95 +20,157 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include "sensor_util.h"
+#include "sensors_metrics.h"
+#include "sensors_tracepoint.h"
+#include "sensors_timer.h"
 #include "sensors_worker.h"
 
-static void sensor_nano_sleep(int64_t utime)
+/*
+ * Workers don't own a thread. Each one is a timer on the shared timer
+ * thread (see sensors_timer.c), which runs the callbacks of all polled
+ * sensors and lets close deadlines share a wakeup.
+ *
+ * Callbacks run on absolute deadlines, one period apart. Sleeping a
+ * relative delay after each callback would make every period drift by the
+ * time the callback takes. A callback that runs past the next deadline
+ * skips the periods it missed, so the phase is kept and the sensor isn't
+ * polled back to back to catch up.
+ */
+
+/* how early a callback may run to share a wakeup with another worker */
+static inline int64_t sensors_worker_slack(struct sensors_worker_t* worker)
 {
-	struct timespec t;
+	return worker->delay_ns / 4;
+}
 
-	if (utime <= 0)
+/* called with mode_mutex held */
+static void sensors_worker_reset_stats(struct sensors_worker_t* worker)
+{
+	memset(&worker->stats, 0, sizeof(worker->stats));
+	worker->first_ns = 0;
+	worker->last_ns = 0;
+	worker->late_total_ns = 0;
+}
+
+/* called with mode_mutex held after each callback */
+static void sensors_worker_next(struct sensors_worker_t* worker, int64_t start)
+{
+	struct sensors_worker_stats *stats = &worker->stats;
+	int64_t late = start > worker->deadline ? start - worker->deadline : 0;
+	int64_t now, missed;
+
+	if (!stats->runs)
+		worker->first_ns = start;
+	worker->last_ns = start;
+	worker->late_total_ns += late;
+	if (late > stats->late_max_ns)
+		stats->late_max_ns = late;
+	stats->runs++;
+
+	now = sensors_timer_now();
+	if (worker->delay_ns <= 0) {
+		worker->deadline = now;
 		return;
+	}
 
-	t.tv_sec = (time_t)(utime / 1e9);
-	t.tv_nsec = (long)(utime % 1000000000L);
-	nanosleep(&t, NULL);
+	worker->deadline += worker->delay_ns;
+	if (worker->deadline <= now) {
+		missed = (now - worker->deadline) / worker->delay_ns + 1;
+		stats->overruns += missed;
+		worker->deadline += missed * worker->delay_ns;
+		DASH_LOGV("%s: callback overran, %lld period(s) skipped",
+		      __func__, missed);
+	}
 }
 
-static void *sensors_worker_internal_worker(void *arg)
+static void sensors_worker_expire(struct sensors_timer_t *t)
 {
-	struct sensors_worker_t* worker = (struct sensors_worker_t*) arg;
-	enum sensors_worker_mode mode;
+	struct sensors_worker_t* worker = container_of(t,
+					struct sensors_worker_t, timer);
+	int64_t start = sensors_timer_now();
 
-	while (1) {
-		pthread_mutex_lock(&worker->mode_mutex);
-		mode = worker->mode;
+	pthread_mutex_lock(&worker->mode_mutex);
+	if (worker->mode != SENSOR_RUNNING) {
 		pthread_mutex_unlock(&worker->mode_mutex);
-
-		switch (mode) {
-		case SENSOR_DESTROY:
-			goto exit;
-
-		case SENSOR_SLEEP:
-			pthread_mutex_lock(&worker->mode_mutex);
-			pthread_cond_wait(&worker->suspend_cond, &worker->mode_mutex);
-			pthread_mutex_unlock(&worker->mode_mutex);
-			break;
-
-		default:
-			worker->poll_callback(worker->arg);
-			break;
-		}
-		if (worker->delay_ns)
-			sensor_nano_sleep(worker->delay_ns);
+		return;
 	}
-exit:
-	return NULL;
+	pthread_mutex_unlock(&worker->mode_mutex);
+
+	sensors_metrics_add(worker->handle, METRIC_WAKEUPS, 1);
+	TRACEPOINT(TP_WAKEUP, -1, 0, 0);
+	worker->poll_callback(worker->arg);
+	sensors_metrics_flush(worker->handle);
+
+	pthread_mutex_lock(&worker->mode_mutex);
+	sensors_worker_next(worker, start);
+	if (worker->mode == SENSOR_RUNNING)
+		sensors_timer_arm(&worker->timer, worker->deadline,
+				  sensors_worker_slack(worker));
+	pthread_mutex_unlock(&worker->mode_mutex);
 }
 
 static void sensors_worker_set_delay(struct sensors_worker_t* worker, int64_t ns)
 {
 	pthread_mutex_lock(&worker->mode_mutex);
 	worker->delay_ns = ns;
+	/* move the pending deadline too, a long old period isn't waited out */
+	if (worker->mode == SENSOR_RUNNING && worker->stats.runs) {
+		worker->deadline = worker->last_ns + ns;
+		sensors_timer_arm(&worker->timer, worker->deadline,
+				  sensors_worker_slack(worker));
+	}
+	sensors_worker_reset_stats(worker);
 	pthread_mutex_unlock(&worker->mode_mutex);
 }
 
 static void sensors_worker_suspend(struct sensors_worker_t* worker)
 {
-	enum sensors_worker_mode prev_mode;
-
 	pthread_mutex_lock(&worker->mode_mutex);
-	prev_mode = worker->mode;
-	worker->mode = SENSOR_SLEEP;
+	if (worker->mode == SENSOR_RUNNING)
+		worker->mode = SENSOR_SLEEP;
 	pthread_mutex_unlock(&worker->mode_mutex);
+
+	sensors_timer_cancel(&worker->timer);
 }
 
 static void sensors_worker_resume(struct sensors_worker_t* worker)
 {
-	enum sensors_worker_mode prev_mode;
-
 	pthread_mutex_lock(&worker->mode_mutex);
-	prev_mode = worker->mode;
-	worker->mode = SENSOR_RUNNING;
-
-	if (prev_mode == SENSOR_SLEEP)
-		pthread_cond_broadcast(&worker->suspend_cond);
+	if (worker->mode == SENSOR_SLEEP) {
+		worker->mode = SENSOR_RUNNING;
+
+		/* first sample right away, then one per period */
+		worker->deadline = sensors_timer_now();
+		sensors_worker_reset_stats(worker);
+		sensors_timer_arm(&worker->timer, worker->deadline,
+				  sensors_worker_slack(worker));
+	}
+	pthread_mutex_unlock(&worker->mode_mutex);
+}
 
+static void sensors_worker_get_stats(struct sensors_worker_t* worker,
+				     struct sensors_worker_stats *stats)
+{
+	pthread_mutex_lock(&worker->mode_mutex);
+	*stats = worker->stats;
+	if (stats->runs > 1)
+		stats->period_ns = (worker->last_ns - worker->first_ns) /
+				   (int64_t)(stats->runs - 1);
+	if (stats->runs)
+		stats->late_avg_ns = worker->late_total_ns /
+				     (int64_t)stats->runs;
 	pthread_mutex_unlock(&worker->mode_mutex);
 }
 
 static void sensors_worker_destroy(struct sensors_worker_t* worker)
 {
-	enum sensors_worker_mode prev_mode;
-
 	pthread_mutex_lock(&worker->mode_mutex);
-	prev_mode = worker->mode;
 	worker->mode = SENSOR_DESTROY;
-
-	if (prev_mode == SENSOR_SLEEP)
-		pthread_cond_broadcast(&worker->suspend_cond);
-
 	pthread_mutex_unlock(&worker->mode_mutex);
-	pthread_join(worker->worker_thread_id, NULL);
+
+	/* waits for a callback in flight */
+	sensors_timer_cancel(&worker->timer);
 }
 
 void sensors_worker_init(struct sensors_worker_t* worker,
@@ -121,12 +183,13 @@ void sensors_worker_init(struct sensors_worker_t* worker,
 	worker->resume = sensors_worker_resume;
 	worker->destroy = sensors_worker_destroy;
 	worker->set_delay = sensors_worker_set_delay;
+	worker->get_stats = sensors_worker_get_stats;
 	worker->delay_ns = 200000000L;
 	worker->arg = arg;
+	worker->handle = -1;
+	worker->deadline = 0;
+	sensors_worker_reset_stats(worker);
 
 	pthread_mutex_init (&worker->mode_mutex, NULL);
-	pthread_cond_init (&worker->suspend_cond, NULL);
-	pthread_create(&worker->worker_thread_id, NULL,
-		       sensors_worker_internal_worker, (void*) worker);
+	sensors_timer_init(&worker->timer, sensors_worker_expire);
 }
-
@@ -18,6 +18,7 @@
 #define SENSOR_WORKER_H_
 #include <stdint.h>
 #include <pthread.h>
+#include "sensors_timer.h"
 
 enum sensors_worker_mode {
 	SENSOR_NO_INIT,
@@ -26,20 +27,41 @@ enum sensors_worker_mode {
 	SENSOR_DESTROY
 };
 
+/*
+ * Statistics of the current run, i.e. since the last resume or delay
+ * change. Lateness is how far past its deadline a callback started.
+ */
+struct sensors_worker_stats {
+	uint64_t runs;
+	uint64_t overruns;
+	int64_t period_ns;
+	int64_t late_avg_ns;
+	int64_t late_max_ns;
+};
+
 struct sensors_worker_t {
 	enum sensors_worker_mode mode;
 	pthread_mutex_t	mode_mutex;
 
-	pthread_cond_t suspend_cond;
-	pthread_t worker_thread_id;
+	struct sensors_timer_t timer;
 
 	void *arg;
 	int64_t delay_ns;
+	/* sensor charged with the wakeups, -1 until set */
+	int handle;
+
+	int64_t deadline;
+	int64_t first_ns;
+	int64_t last_ns;
+	int64_t late_total_ns;
+	struct sensors_worker_stats stats;
 
 	void (*suspend)(struct sensors_worker_t* worker);
 	void (*resume)(struct sensors_worker_t* worker);
 	void (*set_delay)(struct sensors_worker_t* worker, int64_t ns);
 	void (*destroy)(struct sensors_worker_t* worker);
+	void (*get_stats)(struct sensors_worker_t* worker,
+			  struct sensors_worker_stats *stats);
 	void* (*poll_callback)(void* arg);
 };
 
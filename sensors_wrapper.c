@@ -17,38 +17,121 @@
 #define LOG_TAG "DASH"
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "sensors_log.h"
 #include <pthread.h>
 #include "sensor_util.h"
 #include "sensors_wrapper.h"
+#include "sensors_metrics.h"
+#include "sensors_registry.h"
+#include "sensors_tracepoint.h"
 
 #define UNUSED		0
 #define CLOSE		0x1
 #define INIT		0x2
 #define ACTIVE		0x4
-
-#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define AVERAGE		0x8
 
 #define LOCK(p) do { \
-	ALOGD("%s(%d): %s: lock\n", __FILE__, __LINE__, __func__); \
+	DASH_LOGV("%s(%d): %s: lock\n", __FILE__, __LINE__, __func__); \
 	pthread_mutex_lock(p); \
 } while (0)
 
 #define UNLOCK(p) do { \
-	ALOGD("%s(%d): %s: unlock\n", __FILE__, __LINE__, __func__); \
+	DASH_LOGV("%s(%d): %s: unlock\n", __FILE__, __LINE__, __func__); \
 	pthread_mutex_unlock(p); \
 } while (0)
 
 pthread_mutex_t wrapper_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Samples are fanned out without taking wrapper_mutex. Every wrapped
+ * sensor publishes an immutable snapshot of its active clients, which the
+ * control calls rebuild under wrapper_mutex and swap in atomically.
+ *
+ * Each snapshot counts its readers. A reader only keeps a snapshot it
+ * still finds published after counting itself in, so once a writer has
+ * replaced a snapshot and seen its count drop to zero, nobody can be
+ * walking it any more. A writer waiting for that sleeps on grace_cond,
+ * the last reader out only takes grace_mutex when grace_waiters is set.
+ */
+struct wrapper_client {
+	struct sensor_api_t *api;
+	pthread_mutex_t *lock;
+	int64_t rate;
+	unsigned char status;
+	int index;
+};
+
+struct wrapper_snapshot {
+	unsigned int readers;
+	int64_t rate;
+	int nr;
+	struct wrapper_client client[MAX_SENSOR_CONNECTIONS];
+};
+
+static pthread_mutex_t grace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t grace_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int grace_waiters;
+
+/* wrapped sensors may share a handle, those are chained on next */
 struct wrapper_list {
 	struct sensor_t *sensor;
 	struct sensor_api_t *api;
 	struct wrapper_entry *entry;
+	struct wrapper_list *next;
+	struct wrapper_snapshot *snapshot;
+	struct wrapper_snapshot snapshots[2];
 };
-static struct wrapper_list list[16];
+static struct wrapper_list **list;
 static int idx = 0;
+static int list_max = 0;
+static struct sensors_registry_t handles;
+
+static void wrapper_read_unlock(struct wrapper_snapshot *snap)
+{
+	if (__atomic_sub_fetch(&snap->readers, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	/* pairs with the store of grace_waiters in wrapper_synchronize */
+	if (!__atomic_load_n(&grace_waiters, __ATOMIC_SEQ_CST))
+		return;
+
+	pthread_mutex_lock(&grace_mutex);
+	pthread_cond_broadcast(&grace_cond);
+	pthread_mutex_unlock(&grace_mutex);
+}
+
+static struct wrapper_snapshot *wrapper_read_lock(struct wrapper_list *item)
+{
+	struct wrapper_snapshot *snap;
+
+	while ((snap = __atomic_load_n(&item->snapshot, __ATOMIC_SEQ_CST))) {
+		__atomic_fetch_add(&snap->readers, 1, __ATOMIC_SEQ_CST);
+		/* replaced meanwhile, it may be rebuilt under us */
+		if (__atomic_load_n(&item->snapshot, __ATOMIC_SEQ_CST) == snap)
+			break;
+		wrapper_read_unlock(snap);
+	}
+
+	return snap;
+}
+
+/* wait until no reader is left on a snapshot which is no longer
+   published, the caller holds wrapper_mutex so there is one waiter */
+static void wrapper_synchronize(struct wrapper_snapshot *snap)
+{
+	if (!__atomic_load_n(&snap->readers, __ATOMIC_SEQ_CST))
+		return;
+
+	pthread_mutex_lock(&grace_mutex);
+	__atomic_store_n(&grace_waiters, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&snap->readers, __ATOMIC_SEQ_CST))
+		pthread_cond_wait(&grace_cond, &grace_mutex);
+	__atomic_store_n(&grace_waiters, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&grace_mutex);
+}
 
 /* list manipulation routines */
 static int list_get_status(int sensor, unsigned char pattern)
@@ -56,8 +139,8 @@ static int list_get_status(int sensor, unsigned char pattern)
 	int j;
 	int found = 0;
 
-	for (j = 0; j < list[sensor].entry->nr; j++) {
-		if (list[sensor].entry->status[j] & pattern)
+	for (j = 0; j < list[sensor]->entry->nr; j++) {
+		if (list[sensor]->entry->status[j] & pattern)
 			found++;
 	}
 
@@ -67,37 +150,122 @@ static int list_get_status(int sensor, unsigned char pattern)
 static void list_set_status(int sensor, int client,
 						unsigned char pattern)
 {
-	list[sensor].entry->status[client] |= pattern;
+	list[sensor]->entry->status[client] |= pattern;
 }
 
 static void list_clear_status(int sensor, int client,
 						unsigned char pattern)
 {
-	list[sensor].entry->status[client] &= ~pattern;
+	list[sensor]->entry->status[client] &= ~pattern;
 }
 
-static int64_t list_get_rate(int sensor)
+static int64_t entry_get_rate(struct wrapper_entry *entry)
 {
 	int j;
 	int64_t rate = NO_RATE;
 
-	for (j = 0; j < list[sensor].entry->nr; j++) {
-		if ((list[sensor].entry->rate[j] >= 0) &&
-			(list[sensor].entry->rate[j] < (uint64_t)rate))
-			rate = list[sensor].entry->rate[j];
+	for (j = 0; j < entry->nr; j++) {
+		if ((entry->rate[j] >= 0) &&
+			(entry->rate[j] < (uint64_t)rate))
+			rate = entry->rate[j];
 	}
 
 	return rate;
 }
 
+static int64_t list_get_rate(int sensor)
+{
+	return entry_get_rate(list[sensor]->entry);
+}
+
 static void list_set_rate(int sensor, int client, int64_t rate)
 {
-	list[sensor].entry->rate[client] = rate;
+	list[sensor]->entry->rate[client] = rate;
+}
+
+/* shortest report latency among the clients which have requested a rate */
+static int64_t list_get_timeout(int sensor)
+{
+	int j;
+	int64_t timeout = NO_RATE;
+
+	for (j = 0; j < list[sensor]->entry->nr; j++) {
+		if ((list[sensor]->entry->rate[j] >= 0) &&
+			(list[sensor]->entry->timeout[j] < (uint64_t)timeout))
+			timeout = list[sensor]->entry->timeout[j];
+	}
+
+	return timeout;
+}
+
+static void list_set_timeout(int sensor, int client, int64_t timeout)
+{
+	list[sensor]->entry->timeout[client] = timeout;
+}
+
+/* apply the fastest rate and shortest latency of all clients, sensors
+   without batch support only ever get the rate */
+static int list_apply_rate(int sensor, int flags, int64_t old_rate,
+			   int64_t old_timeout)
+{
+	struct sensor_api_t *api = list[sensor]->api;
+	int64_t rate = list_get_rate(sensor);
+	int64_t timeout = list_get_timeout(sensor);
+
+	if (rate == NO_RATE)
+		return 0;
+
+	if (api->batch) {
+		if (rate == old_rate && timeout == old_timeout)
+			return 0;
+		return api->batch(api, flags, rate, timeout);
+	}
+
+	if (rate == old_rate)
+		return 0;
+	return api->set_delay(api, rate);
 }
 
 static void list_set_api(int sensor, int client, struct sensor_api_t *s)
 {
-	list[sensor].entry->api[client] = s;
+	list[sensor]->entry->api[client] = s;
+}
+
+/* build a snapshot of the active clients in the unused buffer, swap it in
+   and wait for the readers of the old one, so no removed client is called
+   after this returns */
+static void list_publish(int sensor)
+{
+	struct wrapper_list *item = list[sensor];
+	struct wrapper_entry *entry = item->entry;
+	struct wrapper_snapshot *snap, *old = item->snapshot;
+	struct wrapper_client *c;
+	struct wrapper_desc *d;
+	int j;
+
+	snap = old == &item->snapshots[0] ?
+		&item->snapshots[1] : &item->snapshots[0];
+	/* readers which found it replaced may still be backing out */
+	wrapper_synchronize(snap);
+	snap->rate = entry_get_rate(entry);
+	snap->nr = 0;
+
+	for (j = 0; j < entry->nr; j++) {
+		if (!(entry->status[j] & ACTIVE) || !entry->api[j]->data)
+			continue;
+
+		d = container_of(entry->api[j], struct wrapper_desc, api);
+		c = &snap->client[snap->nr++];
+		c->api = entry->api[j];
+		c->lock = &d->data_lock;
+		c->rate = entry->rate[j];
+		c->status = entry->status[j];
+		c->index = j;
+	}
+
+	__atomic_store_n(&item->snapshot, snap, __ATOMIC_SEQ_CST);
+	if (old)
+		wrapper_synchronize(old);
 }
 
 /* perform init of entry and store pointers in the internal wrapper list */
@@ -105,6 +273,7 @@ void sensors_wrapper_register(struct sensor_t *sensor,
 				struct sensor_api_t *api,
 				struct wrapper_entry *entry)
 {
+	struct wrapper_list *item;
 	int i;
 
 	if (sensor == NULL || api == NULL || entry == NULL) {
@@ -120,42 +289,140 @@ void sensors_wrapper_register(struct sensor_t *sensor,
 		entry->api[i] = NULL;
 		entry->status[i] = UNUSED;
 		entry->rate[i] = NO_RATE;
+		entry->timeout[i] = 0;
+		entry->period[i] = NO_RATE;
+		entry->next[i] = 0;
+		entry->count[i] = 0;
+		memset(entry->sum[i], 0, sizeof(entry->sum[i]));
 	}
 	entry->nr = 0;
 
+	item = calloc(1, sizeof(*item));
+	if (!item) {
+		ALOGE("%s: unable to allocate %s", __func__, sensor->name);
+		return;
+	}
+	item->sensor = sensor;
+	item->api = api;
+	item->entry = entry;
+	sensors_metrics_register(sensor->handle, sensor->name);
+
 	LOCK(&wrapper_mutex);
-	if( idx < (int) ARRAY_SIZE(list)) {
-		list[idx].sensor = sensor;
-		list[idx].api = api;
-		list[idx].entry = entry;
-		idx++;
+	if (idx == list_max) {
+		int max = list_max ? list_max * 2 : 16;
+		struct wrapper_list **l = realloc(list, max * sizeof(*l));
+
+		if (!l) {
+			ALOGE("%s: unable to grow list for %s", __func__,
+				sensor->name);
+			free(item);
+			goto exit;
+		}
+		list = l;
+		list_max = max;
+	}
+
+	item->next = sensors_registry_get(&handles, sensor->handle);
+	if (sensors_registry_set(&handles, sensor->handle, item) < 0) {
+		free(item);
+		goto exit;
 	}
+	list[idx++] = item;
+exit:
 	UNLOCK(&wrapper_mutex);
 }
 
-/* find sensor match in list and call all the data api entry functions on it
-   lock and unlock is handled by sensor select to keep the lock order */
+/* decimate the samples for a client slower than the sensor, returns the
+   sample to deliver or NULL. rate is the period the sensor is run at */
+static struct sensor_data_t *entry_filter(struct wrapper_entry *entry,
+					  struct wrapper_client *c,
+					  int64_t rate,
+					  struct sensor_data_t *sd,
+					  struct sensor_data_t *out,
+					  int *avg)
+{
+	int client = c->index;
+	int64_t *sum = entry->sum[client];
+	int i;
+
+	if (c->rate <= rate)
+		return sd;
+
+	/* a new rate restarts decimation with this sample */
+	if (entry->period[client] != c->rate) {
+		entry->period[client] = c->rate;
+		entry->next[client] = 0;
+		entry->count[client] = 0;
+		memset(sum, 0, sizeof(entry->sum[client]));
+	}
+
+	if ((c->status & AVERAGE) && (sd->size > 0) &&
+	    (sd->size <= MAX_AVERAGE_AXIS)) {
+		for (i = 0; i < sd->size; i++)
+			sum[i] += sd->data[i];
+		entry->count[client]++;
+	}
+
+	/* half a sensor period of slack absorbs timestamp jitter */
+	if (sd->timestamp + rate / 2 < entry->next[client])
+		return NULL;
+
+	entry->next[client] += c->rate;
+	if (entry->next[client] <= sd->timestamp)
+		entry->next[client] = sd->timestamp + c->rate;
+
+	if (!entry->count[client])
+		return sd;
+
+	*out = *sd;
+	out->data = avg;
+	for (i = 0; i < sd->size; i++) {
+		avg[i] = sum[i] / entry->count[client];
+		sum[i] = 0;
+	}
+	entry->count[client] = 0;
+
+	return out;
+}
+
+/* find sensor match in list and call all the data api entry functions on
+   it. Only the client snapshot is read, data from one sensor is delivered
+   from one thread at a time by its select worker */
 void sensors_wrapper_data(struct sensor_data_t *sd)
 {
-	int i = 0;
+	struct wrapper_list *item;
+	struct wrapper_snapshot *snap;
+	struct wrapper_client *c;
+	struct sensor_data_t out, *data;
+	int avg[MAX_AVERAGE_AXIS];
 	int j = 0;
 
-	while (sd->sensor != list[i].sensor) {
-		i++;
-		if (i >= idx) {
-			ALOGE("%s: Error %s not found",
-				__func__, sd->sensor->name);
-			return;
-		}
+	item = sensors_registry_get(&handles, sd->sensor->handle);
+	while (item && item->sensor != sd->sensor)
+		item = item->next;
+
+	if (!item) {
+		ALOGE("%s: Error %s not found", __func__, sd->sensor->name);
+		return;
 	}
+	TRACEPOINT(TP_WRAPPER, sd->sensor->handle, sd->timestamp, 0);
 
-	for (j = 0; j < list[i].entry->nr; j++) {
-		if (list[i].entry->status[j] & ACTIVE) {
-			if (list[i].entry->api[j]->data != NULL)
-				list[i].entry->api[j]->data(
-					list[i].entry->api[j], sd);
-		}
+	snap = wrapper_read_lock(item);
+	if (!snap)
+		return;
+
+	for (j = 0; j < snap->nr; j++) {
+		c = &snap->client[j];
+		data = entry_filter(item->entry, c, snap->rate, sd, &out, avg);
+		if (!data)
+			continue;
+
+		TRACEPOINT(TP_CLIENT, sd->sensor->handle, sd->timestamp, j);
+		pthread_mutex_lock(c->lock);
+		c->api->data(c->api, data);
+		pthread_mutex_unlock(c->lock);
 	}
+	wrapper_read_unlock(snap);
 }
 
 /* match supplied sensor with the entries in the internal wrapper list and
@@ -167,23 +434,25 @@ int sensors_wrapper_init(struct sensor_api_t *s)
 	int err = -1;
 
 	LOCK(&wrapper_mutex);
+	if (!d->access.nr)
+		pthread_mutex_init(&d->data_lock, NULL);
 scan:
 	for (i = 0; i < idx; i++) {
-		if (list[i].sensor->type == d->access.match[d->access.nr]) {
+		if (list[i]->sensor->type == d->access.match[d->access.nr]) {
 			int init, rv = 0;
 			ALOGV("%s: matched '%s' and '%s'", __func__,
-				d->sensor.name, list[i].sensor->name);
+				d->sensor.name, list[i]->sensor->name);
 
 			d->access.sensor[d->access.nr] = i;
-			d->access.client[d->access.nr] = list[i].entry->nr;
+			d->access.client[d->access.nr] = list[i]->entry->nr;
 
 			init = list_get_status(i, INIT);
 			if (!init)
-				rv = list[i].api->init(list[i].api);
+				rv = list[i]->api->init(list[i]->api);
 
 			if (rv < 0) {
 				ALOGE("%s: '%s' init failed, continue search",
-				__func__, list[i].sensor->name);
+				__func__, list[i]->sensor->name);
 				err = rv;
 			} else {
 				list_set_status(
@@ -195,7 +464,13 @@ scan:
 						d->access.client[d->access.nr],
 						&d->api);
 
-				list[i].entry->nr++;
+				if (d->access.flags & WRAPPER_AVERAGE)
+					list_set_status(
+						d->access.sensor[d->access.nr],
+						d->access.client[d->access.nr],
+						AVERAGE);
+
+				list[i]->entry->nr++;
 				d->access.nr++;
 
 				if (d->access.nr != d->access.m_nr) {
@@ -222,7 +497,7 @@ int sensors_wrapper_activate(struct sensor_api_t *s, int enable)
 	int client;
 	int active;
 	int rv = 0;
-	int64_t old_rate, new_rate;
+	int64_t old_rate, old_timeout;
 
 	LOCK(&wrapper_mutex);
 	for (i = 0; i < d->access.nr; i++) {
@@ -233,12 +508,10 @@ int sensors_wrapper_activate(struct sensor_api_t *s, int enable)
 			list_clear_status(sensor, client, ACTIVE);
 
 			old_rate = list_get_rate(sensor);
+			old_timeout = list_get_timeout(sensor);
 			list_set_rate(sensor, client, NO_RATE);
-			new_rate = list_get_rate(sensor);
-			if ((new_rate != NO_RATE) &&
-				(old_rate != new_rate))
-				rv = list[sensor].api->set_delay(
-					list[sensor].api, new_rate);
+			list_set_timeout(sensor, client, 0);
+			rv = list_apply_rate(sensor, 0, old_rate, old_timeout);
 		}
 
 		active = list_get_status(sensor, ACTIVE);
@@ -247,8 +520,9 @@ int sensors_wrapper_activate(struct sensor_api_t *s, int enable)
 			list_set_status(sensor, client, ACTIVE);
 
 		if (!active)
-			rv = list[sensor].api->activate(list[sensor].api,
+			rv = list[sensor]->api->activate(list[sensor]->api,
 								enable);
+		list_publish(sensor);
 	}
 	UNLOCK(&wrapper_mutex);
 
@@ -264,19 +538,68 @@ int sensors_wrapper_set_delay(struct sensor_api_t *s, int64_t ns)
 	int sensor;
 	int client;
 	int rv = 0;
-	int64_t old_rate, new_rate;
+	int64_t old_rate, old_timeout;
+
+	LOCK(&wrapper_mutex);
+	for (i = 0; i < d->access.nr; i++) {
+		sensor = d->access.sensor[i];
+		client = d->access.client[i];
+		old_rate = list_get_rate(sensor);
+		old_timeout = list_get_timeout(sensor);
+		list_set_rate(sensor, client, ns);
+		list_set_timeout(sensor, client, 0);
+		rv = list_apply_rate(sensor, 0, old_rate, old_timeout);
+		list_publish(sensor);
+	}
+	UNLOCK(&wrapper_mutex);
+	return rv;
+}
+
+/* perform batch for all sensors included in the access field, the sensor
+   is run at the fastest rate and the shortest latency of its clients */
+int sensors_wrapper_batch(struct sensor_api_t *s, int flags, int64_t ns,
+			  int64_t timeout)
+{
+	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
+	int i;
+	int sensor;
+	int client;
+	int rv = 0;
+	int64_t old_rate, old_timeout;
+
+	/* falling back to continuous reporting is always possible */
+	if (flags & SENSORS_BATCH_DRY_RUN)
+		return 0;
 
 	LOCK(&wrapper_mutex);
 	for (i = 0; i < d->access.nr; i++) {
 		sensor = d->access.sensor[i];
 		client = d->access.client[i];
 		old_rate = list_get_rate(sensor);
+		old_timeout = list_get_timeout(sensor);
 		list_set_rate(sensor, client, ns);
-		new_rate = list_get_rate(sensor);
+		list_set_timeout(sensor, client, timeout);
+		rv = list_apply_rate(sensor, flags, old_rate, old_timeout);
+		list_publish(sensor);
+	}
+	UNLOCK(&wrapper_mutex);
+	return rv;
+}
 
-		if (old_rate != new_rate)
-			rv = list[sensor].api->set_delay(
-				list[sensor].api, new_rate);
+/* perform flush for all sensors included in the access field which are
+   able to buffer samples */
+int sensors_wrapper_flush(struct sensor_api_t *s)
+{
+	struct wrapper_desc *d = container_of(s, struct wrapper_desc, api);
+	int i;
+	int sensor;
+	int rv = 0;
+
+	LOCK(&wrapper_mutex);
+	for (i = 0; i < d->access.nr; i++) {
+		sensor = d->access.sensor[i];
+		if (list[sensor]->api->flush)
+			rv = list[sensor]->api->flush(list[sensor]->api);
 	}
 	UNLOCK(&wrapper_mutex);
 	return rv;
@@ -299,9 +622,11 @@ void sensors_wrapper_close(struct sensor_api_t *s)
 		client = d->access.client[i];
 		list_set_status(sensor, client, CLOSE);
 		list_set_rate(sensor, client, NO_RATE);
+		list_set_timeout(sensor, client, 0);
+		list_publish(sensor);
 		close = list_get_status(sensor, CLOSE);
-		if (close == list[sensor].entry->nr)
-			list[sensor].api->close(list[sensor].api);
+		if (close == list[sensor]->entry->nr)
+			list[sensor]->api->close(list[sensor]->api);
 	}
 	UNLOCK(&wrapper_mutex);
 }
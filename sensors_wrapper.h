@@ -17,12 +17,17 @@
 #ifndef SENSORS_WRAPPER_H
 #define SENSORS_WRAPPER_H
 
+#include <pthread.h>
 #include <hardware/sensors.h>
 #include "sensor_api.h"
 
 #define MAX_SENSOR_CONNECTIONS 4
+#define MAX_AVERAGE_AXIS	4
 #define NO_RATE		(-1)
 
+/* wrapper_access flags */
+#define WRAPPER_AVERAGE	0x1	/* average the samples dropped by decimation */
+
 /* Android sensor HAL types and functions */
 struct wrapper_access {
 	int sensor[MAX_SENSOR_CONNECTIONS];
@@ -30,24 +35,45 @@ struct wrapper_access {
 	int nr;
 	int match[MAX_SENSOR_CONNECTIONS];
 	int m_nr;
+	unsigned int flags;
 };
 
+/* data_lock serializes the data callbacks of a client fed by several
+   sensors, data of unrelated clients is delivered in parallel */
 struct wrapper_desc {
 	struct sensor_t sensor;
 	struct sensor_api_t api;
 	struct wrapper_access access;
+	pthread_mutex_t data_lock;
 };
 
 int sensors_wrapper_init(struct sensor_api_t *s);
 int sensors_wrapper_activate(struct sensor_api_t *s, int enable);
 int sensors_wrapper_set_delay(struct sensor_api_t *s, int64_t ns);
+int sensors_wrapper_batch(struct sensor_api_t *s, int flags, int64_t ns,
+			  int64_t timeout);
+int sensors_wrapper_flush(struct sensor_api_t *s);
 void sensors_wrapper_close(struct sensor_api_t *s);
 
-/* Linux sensor HAL types and functions */
+/*
+ * Linux sensor HAL types and functions
+ *
+ * The sensor runs at the fastest rate of its clients. A client which asked
+ * for a slower rate only gets the samples due at its own rate, picked by
+ * timestamp, and with WRAPPER_AVERAGE the mean of the samples in between.
+ *
+ * api, status, rate and timeout belong to the control calls, the
+ * decimation state from period on is only used by sensors_wrapper_data.
+ */
 struct wrapper_entry {
 	struct sensor_api_t *api[MAX_SENSOR_CONNECTIONS];
 	unsigned char status[MAX_SENSOR_CONNECTIONS];
 	int64_t rate[MAX_SENSOR_CONNECTIONS];
+	int64_t timeout[MAX_SENSOR_CONNECTIONS];
+	int64_t period[MAX_SENSOR_CONNECTIONS];
+	int64_t next[MAX_SENSOR_CONNECTIONS];
+	int64_t sum[MAX_SENSOR_CONNECTIONS][MAX_AVERAGE_AXIS];
+	int count[MAX_SENSOR_CONNECTIONS];
 	int nr;
 };
 
@@ -0,0 +1,646 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark of the event pipeline. Fake sensors are registered in the
+ * real sensor list and driven through the HAL entry points, so every event
+ * takes the same path as on target:
+ *
+ *   select:  producer thread -> pipe -> epoll reactor -> fifo -> poll
+ *   worker:  poll worker -> fifo -> poll
+ *   wrapper: producer thread -> pipe -> epoll reactor -> wrapper -> fifo
+ *            -> poll
+ *
+ * The pipes carry input_event frames and are read with input_reader_frame
+ * just like an evdev node. Each event is stamped at driver read and the
+ * latency is taken when sensors_module_poll hands it out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/input.h>
+#include <hardware/sensors.h>
+#include "sensors_list.h"
+#include "sensors_fifo.h"
+#include "sensors_metrics.h"
+#include "sensors_select.h"
+#include "sensors_worker.h"
+#include "sensors_wrapper.h"
+#include "sensor_util.h"
+
+#define BENCH_SENSORS_MAX	16
+#define BENCH_RATES_MAX		8
+#define BENCH_HANDLE_BASE	200
+#define BENCH_TYPE_RAW		0x10000
+#define BENCH_POLL_EVENTS	64
+#define BENCH_DUMP_LEN		65536
+
+enum bench_mode {
+	BENCH_SELECT,
+	BENCH_WORKER,
+	BENCH_WRAPPER,
+	BENCH_MODES
+};
+
+static const char *mode_name[BENCH_MODES] = {
+	"select",
+	"worker",
+	"wrapper",
+};
+
+struct bench_sensor {
+	struct sensor_t sensor;
+	struct sensor_api_t api;
+	struct wrapper_entry entry;
+	struct sensors_select_t select_worker;
+	struct sensors_worker_t worker;
+	struct input_reader_t reader;
+	enum bench_mode mode;
+	int fds[2];
+	int64_t delay;
+	int running;
+	pthread_t producer;
+	unsigned int read;
+};
+
+struct bench_client {
+	struct wrapper_desc desc;
+	struct bench_sensor *raw;
+};
+
+struct bench_result {
+	struct sensors_poll_device_1 *dev;
+	int64_t *latency;
+	unsigned int nr;
+	unsigned int max;
+	unsigned int received;
+	int stop_handle;
+};
+
+extern struct sensors_module_t HAL_MODULE_INFO_SYM;
+
+static struct bench_sensor sensors[BENCH_MODES][BENCH_SENSORS_MAX];
+static struct bench_client clients[BENCH_SENSORS_MAX];
+static int nr_sensors = 4;
+
+static void bench_timespec_add(struct timespec *t, int64_t ns)
+{
+	ns += t->tv_nsec;
+	t->tv_sec += ns / 1000000000LL;
+	t->tv_nsec = ns % 1000000000LL;
+}
+
+/* writes one xyz frame per period, like a sensor behind an evdev node */
+static void *bench_producer(void *arg)
+{
+	struct bench_sensor *s = arg;
+	struct input_event frame[4];
+	struct timespec next;
+	int v = 0;
+
+	memset(frame, 0, sizeof(frame));
+	frame[0].type = EV_ABS;
+	frame[0].code = ABS_X;
+	frame[1].type = EV_ABS;
+	frame[1].code = ABS_Y;
+	frame[2].type = EV_ABS;
+	frame[2].code = ABS_Z;
+	frame[3].type = EV_SYN;
+	frame[3].code = SYN_REPORT;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (__atomic_load_n(&s->running, __ATOMIC_ACQUIRE)) {
+		frame[0].value = v++;
+		frame[1].value = v;
+		frame[2].value = -v;
+		if (write(s->fds[1], frame, sizeof(frame)) < 0 &&
+		    errno != EAGAIN)
+			break;
+
+		bench_timespec_add(&next, s->delay);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	return NULL;
+}
+
+static void bench_event(struct bench_sensor *s, int *xyz, int64_t ts)
+{
+	sensors_event_t data;
+
+	memset(&data, 0, sizeof(data));
+	data.version = sizeof(sensors_event_t);
+	data.sensor = s->sensor.handle;
+	data.type = s->sensor.type;
+	data.timestamp = ts;
+	data.acceleration.x = xyz[0];
+	data.acceleration.y = xyz[1];
+	data.acceleration.z = xyz[2];
+	sensors_fifo_put(&data);
+}
+
+static void *bench_read(void *arg)
+{
+	struct bench_sensor *s = arg;
+	struct input_event *events;
+	struct sensor_data_t sd;
+	int xyz[3] = { 0, 0, 0 };
+	int i, n;
+
+	while ((n = input_reader_frame(&s->reader, s->fds[0], &events)) > 0) {
+		for (i = 0; i < n; i++) {
+			if (events[i].type == EV_ABS && events[i].code <= ABS_Z)
+				xyz[events[i].code] = events[i].value;
+		}
+		s->read++;
+
+		if (s->mode != BENCH_WRAPPER) {
+			bench_event(s, xyz, get_current_nano_time());
+			continue;
+		}
+
+		sd.sensor = &s->sensor;
+		sd.data = xyz;
+		sd.size = 3;
+		sd.scale = 1;
+		sd.status = SENSOR_STATUS_ACCURACY_HIGH;
+		sd.timestamp = get_current_nano_time();
+		sensors_wrapper_data(&sd);
+	}
+	if (n < 0)
+		fprintf(stderr, "%s: read failed: %s\n", s->sensor.name,
+			strerror(-n));
+
+	return NULL;
+}
+
+static void *bench_poll(void *arg)
+{
+	struct bench_sensor *s = arg;
+	int xyz[3];
+
+	xyz[0] = xyz[1] = xyz[2] = s->read++;
+	bench_event(s, xyz, get_current_nano_time());
+
+	return NULL;
+}
+
+static int bench_init(struct sensor_api_t *api)
+{
+	struct bench_sensor *s = container_of(api, struct bench_sensor, api);
+
+	if (s->mode == BENCH_WORKER) {
+		sensors_worker_init(&s->worker, bench_poll, s);
+		s->worker.handle = s->sensor.handle;
+		return 0;
+	}
+
+	if (pipe(s->fds) < 0) {
+		fprintf(stderr, "%s: pipe failed: %s\n", s->sensor.name,
+			strerror(errno));
+		return -1;
+	}
+	fcntl(s->fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(s->fds[1], F_SETFL, O_NONBLOCK);
+
+	sensors_select_init(&s->select_worker, bench_read, s, -1);
+	s->select_worker.handle = s->sensor.handle;
+	input_reader_set_fd(&s->reader, s->fds[0]);
+	s->select_worker.set_fd(&s->select_worker, s->fds[0]);
+
+	return 0;
+}
+
+static int bench_activate(struct sensor_api_t *api, int enable)
+{
+	struct bench_sensor *s = container_of(api, struct bench_sensor, api);
+
+	if (s->mode == BENCH_WORKER) {
+		if (enable)
+			s->worker.resume(&s->worker);
+		else
+			s->worker.suspend(&s->worker);
+		return 0;
+	}
+
+	if (enable == s->running)
+		return 0;
+
+	if (enable) {
+		s->select_worker.resume(&s->select_worker);
+		s->running = 1;
+		if (pthread_create(&s->producer, NULL, bench_producer, s)) {
+			s->running = 0;
+			return -1;
+		}
+	} else {
+		__atomic_store_n(&s->running, 0, __ATOMIC_RELEASE);
+		pthread_join(s->producer, NULL);
+		s->select_worker.suspend(&s->select_worker);
+	}
+
+	return 0;
+}
+
+static int bench_set_delay(struct sensor_api_t *api, int64_t ns)
+{
+	struct bench_sensor *s = container_of(api, struct bench_sensor, api);
+
+	s->delay = ns;
+	if (s->mode == BENCH_WORKER)
+		s->worker.set_delay(&s->worker, ns);
+
+	return 0;
+}
+
+static void bench_close(struct sensor_api_t *api)
+{
+	struct bench_sensor *s = container_of(api, struct bench_sensor, api);
+
+	if (s->mode == BENCH_WORKER) {
+		s->worker.destroy(&s->worker);
+		return;
+	}
+
+	s->select_worker.destroy(&s->select_worker);
+	close(s->fds[1]);
+}
+
+static void bench_client_data(struct sensor_api_t *api,
+			      struct sensor_data_t *sd)
+{
+	struct bench_client *c = container_of(api, struct bench_client,
+					      desc.api);
+	sensors_event_t data;
+
+	memset(&data, 0, sizeof(data));
+	data.version = c->desc.sensor.version;
+	data.sensor = c->desc.sensor.handle;
+	data.type = c->desc.sensor.type;
+	data.timestamp = sd->timestamp;
+	data.acceleration.status = sd->status;
+	data.acceleration.x = sd->data[0] * sd->scale;
+	data.acceleration.y = sd->data[1] * sd->scale;
+	data.acceleration.z = sd->data[2] * sd->scale;
+	sensors_fifo_put(&data);
+}
+
+static void bench_sensor_setup(struct bench_sensor *s, enum bench_mode mode,
+			       int i)
+{
+	static char names[BENCH_MODES][BENCH_SENSORS_MAX][32];
+
+	snprintf(names[mode][i], sizeof(names[mode][i]), "bench %s %d",
+		 mode_name[mode], i);
+	s->mode = mode;
+	s->fds[0] = s->fds[1] = -1;
+	s->sensor.name = names[mode][i];
+	s->sensor.vendor = "DASH";
+	s->sensor.version = sizeof(sensors_event_t);
+	s->sensor.handle = BENCH_HANDLE_BASE + mode * BENCH_SENSORS_MAX + i;
+	s->sensor.type = SENSOR_TYPE_ACCELEROMETER;
+	s->sensor.minDelay = 1000;
+	s->api.init = bench_init;
+	s->api.activate = bench_activate;
+	s->api.set_delay = bench_set_delay;
+	s->api.close = bench_close;
+}
+
+/* the wrapped sensors are only reachable through their clients */
+static void bench_register(void)
+{
+	struct bench_sensor *s;
+	struct bench_client *c;
+	int i;
+
+	for (i = 0; i < nr_sensors; i++) {
+		s = &sensors[BENCH_SELECT][i];
+		bench_sensor_setup(s, BENCH_SELECT, i);
+		sensors_list_register(&s->sensor, &s->api);
+
+		s = &sensors[BENCH_WORKER][i];
+		bench_sensor_setup(s, BENCH_WORKER, i);
+		sensors_list_register(&s->sensor, &s->api);
+
+		s = &sensors[BENCH_WRAPPER][i];
+		bench_sensor_setup(s, BENCH_WRAPPER, i);
+		s->sensor.type = BENCH_TYPE_RAW + i;
+		sensors_wrapper_register(&s->sensor, &s->api, &s->entry);
+
+		c = &clients[i];
+		c->raw = s;
+		c->desc.sensor = s->sensor;
+		c->desc.sensor.type = SENSOR_TYPE_ACCELEROMETER;
+		c->desc.sensor.handle += BENCH_SENSORS_MAX;
+		c->desc.api.init = sensors_wrapper_init;
+		c->desc.api.activate = sensors_wrapper_activate;
+		c->desc.api.set_delay = sensors_wrapper_set_delay;
+		c->desc.api.close = sensors_wrapper_close;
+		c->desc.api.data = bench_client_data;
+		c->desc.access.match[0] = BENCH_TYPE_RAW + i;
+		c->desc.access.m_nr = 1;
+		sensors_list_register(&c->desc.sensor, &c->desc.api);
+	}
+}
+
+static int bench_handle(enum bench_mode mode, int i)
+{
+	if (mode == BENCH_WRAPPER)
+		return clients[i].desc.sensor.handle;
+
+	return sensors[mode][i].sensor.handle;
+}
+
+static void *bench_consumer(void *arg)
+{
+	struct bench_result *r = arg;
+	struct sensors_poll_device_1 *dev = r->dev;
+	sensors_event_t data[BENCH_POLL_EVENTS];
+	int64_t now;
+	int i, n;
+	int done = 0;
+
+	while (!done) {
+		n = dev->poll(&dev->v0, data, BENCH_POLL_EVENTS);
+		if (n < 0) {
+			fprintf(stderr, "poll failed: %s\n", strerror(-n));
+			break;
+		}
+
+		now = get_current_nano_time();
+		for (i = 0; i < n; i++) {
+			if (data[i].type == SENSOR_TYPE_META_DATA) {
+				if (data[i].meta_data.sensor == r->stop_handle)
+					done = 1;
+				continue;
+			}
+			if (data[i].sensor < BENCH_HANDLE_BASE)
+				continue;
+
+			r->received++;
+			if (r->nr < r->max)
+				r->latency[r->nr++] = now - data[i].timestamp;
+		}
+	}
+
+	return NULL;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double bench_percentile(struct bench_result *r, int p)
+{
+	unsigned int i;
+
+	if (!r->nr)
+		return 0;
+
+	i = ((uint64_t)r->nr * p) / 100;
+	if (i >= r->nr)
+		i = r->nr - 1;
+
+	return r->latency[i] / 1000.0;
+}
+
+/* achieved rate and lateness as seen by the poll workers themselves */
+static void bench_worker_stats(int rate)
+{
+	struct sensors_worker_stats stats;
+	uint64_t overruns = 0;
+	int64_t period = 0, late_avg = 0, late_max = 0;
+	int i;
+
+	for (i = 0; i < nr_sensors; i++) {
+		sensors[BENCH_WORKER][i].worker.get_stats(
+				&sensors[BENCH_WORKER][i].worker, &stats);
+		overruns += stats.overruns;
+		period += stats.period_ns;
+		late_avg += stats.late_avg_ns;
+		if (stats.late_max_ns > late_max)
+			late_max = stats.late_max_ns;
+	}
+	period /= nr_sensors;
+	late_avg /= nr_sensors;
+
+	printf("%-8s %5d %3d achieved %.1f Hz, %llu periods skipped, "
+	       "late avg %.1f us max %.1f us\n", "", rate, nr_sensors,
+	       period ? 1000000000.0 / period : 0.0,
+	       (unsigned long long)overruns, late_avg / 1000.0,
+	       late_max / 1000.0);
+}
+
+static int bench_run(struct sensors_poll_device_1 *dev, enum bench_mode mode,
+		     int rate, int seconds)
+{
+	struct bench_result r;
+	struct sensors_fifo_wakeup_stats w0, w1;
+	pthread_t consumer;
+	unsigned int overruns;
+	unsigned int expected = (unsigned int)rate * nr_sensors * seconds;
+	unsigned int read = 0;
+	unsigned int lost;
+	int64_t delay = 1000000000LL / rate;
+	sensors_event_t drain[BENCH_POLL_EVENTS];
+	int i, n;
+
+	memset(&r, 0, sizeof(r));
+	r.dev = dev;
+	r.max = expected * 2 + 1024;
+	r.latency = malloc(r.max * sizeof(*r.latency));
+	if (!r.latency)
+		return -1;
+	r.stop_handle = bench_handle(mode, 0);
+
+	for (i = 0; i < nr_sensors; i++)
+		sensors[mode][i].read = 0;
+	overruns = sensors_fifo_get_overruns();
+	sensors_fifo_get_wakeup_stats(&w0);
+
+	pthread_create(&consumer, NULL, bench_consumer, &r);
+
+	for (i = 0; i < nr_sensors; i++) {
+		dev->setDelay(&dev->v0, bench_handle(mode, i), delay);
+		dev->activate(&dev->v0, bench_handle(mode, i), 1);
+	}
+
+	sleep(seconds);
+
+	for (i = 0; i < nr_sensors; i++)
+		dev->activate(&dev->v0, bench_handle(mode, i), 0);
+
+	/* the flush complete event tells the consumer to stop */
+	dev->flush(dev, r.stop_handle);
+	pthread_join(consumer, NULL);
+
+	/* whatever was queued behind the flush event in another lane */
+	while ((n = sensors_fifo_wait_get(drain, BENCH_POLL_EVENTS, 0)) > 0) {
+		for (i = 0; i < n; i++)
+			if (drain[i].sensor >= BENCH_HANDLE_BASE &&
+			    drain[i].type != SENSOR_TYPE_META_DATA)
+				r.received++;
+	}
+
+	overruns = sensors_fifo_get_overruns() - overruns;
+	sensors_fifo_get_wakeup_stats(&w1);
+	for (i = 0; i < nr_sensors; i++)
+		read += sensors[mode][i].read;
+	lost = read > r.received ? read - r.received : 0;
+
+	qsort(r.latency, r.nr, sizeof(*r.latency), bench_cmp);
+
+	printf("%-8s %5d %3d %8u %8u %8u %7u %5.2f%% %9.1f "
+	       "%8.1f %8.1f %8.1f %9.1f %8.1f\n",
+	       mode_name[mode], rate, nr_sensors, expected, read, r.received,
+	       overruns, read ? 100.0 * lost / read : 0.0,
+	       (double)r.received / seconds,
+	       bench_percentile(&r, 50), bench_percentile(&r, 90),
+	       bench_percentile(&r, 99),
+	       r.nr ? r.latency[r.nr - 1] / 1000.0 : 0.0,
+	       w1.count > w0.count ? (double)(w1.total_ns - w0.total_ns) /
+	       (w1.count - w0.count) / 1000.0 : 0.0);
+
+	if (mode == BENCH_WORKER)
+		bench_worker_stats(rate);
+
+	free(r.latency);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n sensors] [-t seconds] [-r rate]... "
+		"[-m select|worker|wrapper]... [-d]\n"
+		"  -n  concurrent sensors per mode (1-%d, default 4)\n"
+		"  -t  seconds per run (default 2)\n"
+		"  -r  sample rate in Hz (default 50 100 200 1000)\n"
+		"  -m  pipeline to run (default all)\n"
+		"  -d  dump the per-sensor metrics after the runs\n",
+		name, BENCH_SENSORS_MAX);
+}
+
+int main(int argc, char *argv[])
+{
+	struct hw_device_t *device;
+	struct sensors_poll_device_1 *dev;
+	int rates[BENCH_RATES_MAX] = { 50, 100, 200, 1000 };
+	int nr_rates = 0;
+	int modes = 0;
+	int seconds = 2;
+	int dump = 0;
+	int i, m, opt;
+
+	while ((opt = getopt(argc, argv, "n:t:r:m:dh")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_sensors = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			if (nr_rates == BENCH_RATES_MAX) {
+				usage(argv[0]);
+				return 1;
+			}
+			rates[nr_rates++] = atoi(optarg);
+			break;
+		case 'm':
+			for (m = 0; m < BENCH_MODES; m++)
+				if (!strcmp(optarg, mode_name[m]))
+					break;
+			if (m == BENCH_MODES) {
+				usage(argv[0]);
+				return 1;
+			}
+			modes |= 1 << m;
+			break;
+		case 'd':
+			dump = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!nr_rates)
+		nr_rates = 4;
+	if (!modes)
+		modes = (1 << BENCH_MODES) - 1;
+	if (nr_sensors < 1 || nr_sensors > BENCH_SENSORS_MAX || seconds < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	for (i = 0; i < nr_rates; i++) {
+		if (rates[i] < 1 || rates[i] > 100000) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	bench_register();
+
+	if (HAL_MODULE_INFO_SYM.common.methods->open(
+			&HAL_MODULE_INFO_SYM.common, SENSORS_HARDWARE_POLL,
+			&device) || !device) {
+		fprintf(stderr, "unable to open sensors module\n");
+		return 1;
+	}
+	dev = (struct sensors_poll_device_1 *)device;
+
+	printf("%-8s %5s %3s %8s %8s %8s %7s %6s %9s "
+	       "%8s %8s %8s %9s %8s\n",
+	       "pipeline", "hz", "n", "expected", "read", "polled",
+	       "overrun", "drop", "events/s",
+	       "p50(us)", "p90(us)", "p99(us)", "max(us)", "wake(us)");
+
+	for (m = 0; m < BENCH_MODES; m++) {
+		if (!(modes & (1 << m)))
+			continue;
+		for (i = 0; i < nr_rates; i++)
+			bench_run(dev, m, rates[i], seconds);
+	}
+
+	if (dump) {
+		char buf[BENCH_DUMP_LEN];
+
+		sensors_metrics_dump(buf, sizeof(buf));
+		printf("\n%s", buf);
+	}
+
+	for (i = 0; i < nr_sensors; i++) {
+		sensors[BENCH_SELECT][i].api.close(
+					&sensors[BENCH_SELECT][i].api);
+		sensors[BENCH_WORKER][i].api.close(
+					&sensors[BENCH_WORKER][i].api);
+		clients[i].desc.api.close(&clients[i].desc.api);
+	}
+	device->close(device);
+
+	return 0;
+}
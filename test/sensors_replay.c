@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a trace recorded with trace_record (see sensors_trace.h) through
+ * the sensors built into libsensors, e.g.
+ *
+ *   make DASH_SENSORS="bma250_input.c" replay REPLAY_ARGS="dash.trace"
+ *
+ * Every recorded input device is replaced by a fifo which the drivers open
+ * and read with their usual read functions, so the events take the same
+ * path as on target: driver read -> epoll reactor -> fifo -> poll. The
+ * recorded control calls are made on the HAL in between.
+ *
+ * By default the trace is played at its recorded pace and the delay from
+ * sample time to poll is reported. With -f it is played as fast as the
+ * drivers read it, which gives the throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <hardware/sensors.h>
+#include "sensors_fifo.h"
+#include "sensors_trace.h"
+#include "sensor_util.h"
+
+#define REPLAY_DEVICES_MAX	64
+#define REPLAY_INPUTS_MAX	16
+#define REPLAY_POLL_EVENTS	64
+/* how long to wait for a driver to read its input before giving up */
+#define REPLAY_STALL_US		1000000
+
+struct replay_input {
+	char name[64];
+	char path[PATH_MAX];
+	int fd;
+};
+
+struct replay_result {
+	struct sensors_poll_device_1 *dev;
+	int64_t *latency;
+	unsigned int nr;
+	unsigned int max;
+	unsigned int received;
+	int stop_handle;
+	int stopping;
+};
+
+extern struct sensors_module_t HAL_MODULE_INFO_SYM;
+
+static struct replay_input inputs[REPLAY_INPUTS_MAX];
+static int nr_inputs;
+/* trace device id to inputs index */
+static int devices[REPLAY_DEVICES_MAX];
+
+static char *replay_load(const char *file, size_t *size)
+{
+	struct trace_header *hdr;
+	struct stat st;
+	char *buf;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f || fstat(fileno(f), &st) < 0) {
+		fprintf(stderr, "unable to open %s: %s\n", file,
+			strerror(errno));
+		return NULL;
+	}
+
+	buf = malloc(st.st_size);
+	if (!buf || fread(buf, st.st_size, 1, f) != 1 ||
+	    (size_t)st.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "unable to read %s\n", file);
+		fclose(f);
+		free(buf);
+		return NULL;
+	}
+	fclose(f);
+
+	hdr = (struct trace_header *)buf;
+	if (hdr->magic != TRACE_MAGIC || hdr->version != TRACE_VERSION) {
+		fprintf(stderr, "%s is not a version %d trace\n", file,
+			TRACE_VERSION);
+		free(buf);
+		return NULL;
+	}
+	*size = st.st_size;
+
+	return buf;
+}
+
+/* next record, or NULL at the end of the trace */
+static struct trace_record *replay_next(char *buf, size_t size, size_t *pos)
+{
+	struct trace_record *rec = (struct trace_record *)(buf + *pos);
+
+	if (*pos + sizeof(*rec) > size ||
+	    *pos + sizeof(*rec) + rec->len > size)
+		return NULL;
+	*pos += sizeof(*rec) + rec->len;
+
+	return rec;
+}
+
+/* one fifo per device name, opened for writing before any driver reads */
+static int replay_device(struct trace_record *rec, const char *dir)
+{
+	struct replay_input *in;
+	char name[64];
+	int i;
+
+	if (rec->id < 0 || rec->id >= REPLAY_DEVICES_MAX)
+		return -1;
+
+	snprintf(name, sizeof(name), "%.*s", rec->len, (char *)(rec + 1));
+	for (i = 0; i < nr_inputs; i++) {
+		if (!strcmp(inputs[i].name, name)) {
+			devices[rec->id] = i;
+			return 0;
+		}
+	}
+	if (nr_inputs == REPLAY_INPUTS_MAX)
+		return -1;
+
+	in = &inputs[nr_inputs];
+	strcpy(in->name, name);
+	snprintf(in->path, sizeof(in->path), "%s/dash-replay-%d-%d", dir,
+		 (int)getpid(), nr_inputs);
+	if (mkfifo(in->path, 0600) < 0) {
+		fprintf(stderr, "mkfifo %s failed: %s\n", in->path,
+			strerror(errno));
+		return -1;
+	}
+	/* read-write, so a driver never sees the writer go away */
+	in->fd = open(in->path, O_RDWR | O_NONBLOCK);
+	if (in->fd < 0)
+		return -1;
+
+	sensors_trace_set_input(in->name, in->path);
+	devices[rec->id] = nr_inputs++;
+	printf("input '%s' replayed from %s\n", in->name, in->path);
+
+	return 0;
+}
+
+static void replay_input(struct trace_record *rec, int64_t offset)
+{
+	struct trace_event *ev = (struct trace_event *)(rec + 1);
+	struct input_event events[INPUT_READER_LEN];
+	struct replay_input *in;
+	int64_t t;
+	int i, n = rec->value;
+	int stall = 0;
+
+	if (rec->id < 0 || rec->id >= REPLAY_DEVICES_MAX ||
+	    devices[rec->id] < 0 || n > INPUT_READER_LEN ||
+	    n * sizeof(*ev) > rec->len)
+		return;
+
+	for (i = 0; i < n; i++) {
+		t = ev[i].time + offset;
+		events[i].time.tv_sec = t / 1000000000LL;
+		events[i].time.tv_usec = (t % 1000000000LL) / 1000;
+		events[i].type = ev[i].type;
+		events[i].code = ev[i].code;
+		events[i].value = ev[i].value;
+	}
+
+	/* a full fifo means the driver is behind, it may not be reading */
+	in = &inputs[devices[rec->id]];
+	while (write(in->fd, events, n * sizeof(events[0])) < 0) {
+		if (errno != EAGAIN || stall >= REPLAY_STALL_US) {
+			fprintf(stderr, "input to %s dropped: %s\n", in->name,
+				strerror(errno));
+			break;
+		}
+		usleep(100);
+		stall += 100;
+	}
+}
+
+static void replay_control(struct sensors_poll_device_1 *dev,
+			   struct trace_record *rec)
+{
+	struct trace_batch *batch = (struct trace_batch *)(rec + 1);
+
+	switch (rec->type) {
+	case TRACE_ACTIVATE:
+		dev->activate(&dev->v0, rec->id, rec->value);
+		break;
+	case TRACE_SET_DELAY:
+		dev->setDelay(&dev->v0, rec->id, rec->value);
+		break;
+	case TRACE_BATCH:
+		if (rec->len >= sizeof(*batch))
+			dev->batch(dev, rec->id, batch->flags, rec->value,
+				   batch->timeout);
+		break;
+	case TRACE_FLUSH:
+		dev->flush(dev, rec->id);
+		break;
+	}
+}
+
+static void *replay_consumer(void *arg)
+{
+	struct replay_result *r = arg;
+	struct sensors_poll_device_1 *dev = r->dev;
+	sensors_event_t data[REPLAY_POLL_EVENTS];
+	int64_t now;
+	int i, n;
+	int done = 0;
+
+	while (!done) {
+		n = dev->poll(&dev->v0, data, REPLAY_POLL_EVENTS);
+		if (n < 0) {
+			fprintf(stderr, "poll failed: %s\n", strerror(-n));
+			break;
+		}
+
+		now = get_current_nano_time();
+		for (i = 0; i < n; i++) {
+			if (data[i].type == SENSOR_TYPE_META_DATA) {
+				if (__atomic_load_n(&r->stopping,
+						    __ATOMIC_ACQUIRE) &&
+				    data[i].meta_data.sensor == r->stop_handle)
+					done = 1;
+				continue;
+			}
+
+			r->received++;
+			if (r->nr < r->max)
+				r->latency[r->nr++] = now - data[i].timestamp;
+		}
+	}
+
+	return NULL;
+}
+
+/* wait for the drivers to read everything written to the fifos */
+static void replay_drain(void)
+{
+	int i, pending;
+	int stall = 0;
+
+	do {
+		pending = 0;
+		for (i = 0; i < nr_inputs; i++) {
+			int n = 0;
+
+			if (!ioctl(inputs[i].fd, FIONREAD, &n))
+				pending += n;
+		}
+		if (pending)
+			usleep(1000);
+	} while (pending && (stall += 1000) < REPLAY_STALL_US);
+	usleep(50000);
+}
+
+static int replay_cmp(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double replay_percentile(struct replay_result *r, int p)
+{
+	unsigned int i;
+
+	if (!r->nr)
+		return 0;
+
+	i = ((uint64_t)r->nr * p) / 100;
+	if (i >= r->nr)
+		i = r->nr - 1;
+
+	return r->latency[i] / 1000.0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f] [-d dir] trace\n"
+		"  -f  replay as fast as possible instead of in real time\n"
+		"  -d  directory for the input fifos (default /tmp)\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct hw_device_t *device;
+	struct sensors_poll_device_1 *dev;
+	struct sensor_t const *list;
+	struct trace_header *hdr;
+	struct trace_record *rec;
+	struct replay_result r;
+	struct timespec mono, next;
+	pthread_t consumer;
+	const char *dir = "/tmp";
+	unsigned int frames = 0, controls = 0;
+	int64_t base, offset, elapsed;
+	size_t size, pos;
+	char *buf;
+	int fast = 0;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "fd:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			fast = 1;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	buf = replay_load(argv[optind], &size);
+	if (!buf)
+		return 1;
+	hdr = (struct trace_header *)buf;
+
+	/* the fifos have to be in place before the drivers look for inputs */
+	for (i = 0; i < REPLAY_DEVICES_MAX; i++)
+		devices[i] = -1;
+	pos = sizeof(*hdr);
+	while ((rec = replay_next(buf, size, &pos))) {
+		if (rec->type == TRACE_DEVICE && replay_device(rec, dir) < 0)
+			fprintf(stderr, "unable to replay device %d\n",
+				rec->id);
+	}
+
+	if (HAL_MODULE_INFO_SYM.common.methods->open(
+			&HAL_MODULE_INFO_SYM.common, SENSORS_HARDWARE_POLL,
+			&device) || !device) {
+		fprintf(stderr, "unable to open sensors module\n");
+		return 1;
+	}
+	dev = (struct sensors_poll_device_1 *)device;
+	if (HAL_MODULE_INFO_SYM.get_sensors_list(&HAL_MODULE_INFO_SYM,
+						 &list) < 1) {
+		fprintf(stderr, "no sensors built in, see DASH_SENSORS\n");
+		return 1;
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.dev = dev;
+	r.max = size / sizeof(struct trace_event) + 1024;
+	r.latency = malloc(r.max * sizeof(*r.latency));
+	if (!r.latency)
+		return 1;
+	r.stop_handle = list[0].handle;
+	pthread_create(&consumer, NULL, replay_consumer, &r);
+
+	base = get_current_nano_time();
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	offset = base - hdr->start;
+
+	pos = sizeof(*hdr);
+	while ((rec = replay_next(buf, size, &pos))) {
+		if (!fast) {
+			int64_t ns = mono.tv_nsec + rec->time - hdr->start;
+
+			next.tv_sec = mono.tv_sec + ns / 1000000000LL;
+			next.tv_nsec = ns % 1000000000LL;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+					NULL);
+		}
+
+		if (rec->type == TRACE_INPUT) {
+			replay_input(rec, offset);
+			frames++;
+		} else if (rec->type != TRACE_DEVICE) {
+			/* keep inputs ahead of e.g. a deactivate in order */
+			if (fast)
+				replay_drain();
+			replay_control(dev, rec);
+			controls++;
+		}
+	}
+
+	replay_drain();
+	elapsed = get_current_nano_time() - base;
+
+	/* the flush complete event tells the consumer to stop */
+	__atomic_store_n(&r.stopping, 1, __ATOMIC_RELEASE);
+	dev->flush(dev, r.stop_handle);
+	pthread_join(consumer, NULL);
+
+	qsort(r.latency, r.nr, sizeof(*r.latency), replay_cmp);
+
+	printf("%u input reads, %u control calls, %u events polled in "
+	       "%.3f s, %.1f events/s, %u dropped on full fifo\n", frames,
+	       controls, r.received, elapsed / 1000000000.0,
+	       elapsed ? r.received * 1000000000.0 / elapsed : 0.0,
+	       sensors_fifo_get_overruns());
+	if (!fast)
+		printf("latency p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+		       "max %.1f us\n", replay_percentile(&r, 50),
+		       replay_percentile(&r, 90), replay_percentile(&r, 99),
+		       r.nr ? r.latency[r.nr - 1] / 1000.0 : 0.0);
+
+	device->close(device);
+	for (i = 0; i < nr_inputs; i++) {
+		close(inputs[i].fd);
+		unlink(inputs[i].path);
+	}
+	free(r.latency);
+	free(buf);
+
+	return 0;
+}
@@ -21,8 +21,10 @@ int main()
 {
 	int ret = 1;
 	int out_int = 0;
-	char out_str[64];
+	float out_float = 0;
+	char out_str[128];
 	int out_array[2];
+	int handle;
 
 	printf("Testing sensor config ... ");
 	if (sensors_have_config_file() != 0) {
@@ -46,11 +48,58 @@ int main()
 		ret = 0;
 		goto exit;
 	}
+	/* the second akm8973_version is ignored */
 	if (out_int != 1) {
 		printf("\n%u: out_int != 1!\n", __LINE__);
 		ret = 0;
 		goto exit;
 	}
+	if (sensors_config_get_key("akm8973", "gain", TYPE_FLOAT, (void*)&out_float, sizeof(out_float)) < 0) {
+		printf("\n%u: sensors_config_get_key should succeed!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (out_float != 0.25f) {
+		printf("\n%u: out_float != 0.25!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (sensors_config_get_key("bma150", "description", TYPE_STRING, (void*)&out_str, sizeof(out_str)) < 0) {
+		printf("\n%u: sensors_config_get_key should succeed!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (strcmp(out_str, "a value which does not fit in the 64 bytes a line used to be read into") != 0) {
+		printf("\n%u: long out_str mismatch\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	handle = sensors_config_get_handle("akm8973", "name");
+	if (handle < 0) {
+		printf("\n%u: sensors_config_get_handle should succeed!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (sensors_config_get_value(handle, TYPE_STRING, (void*)&out_str, sizeof(out_str)) < 0) {
+		printf("\n%u: sensors_config_get_value should succeed!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (strcmp(out_str, "Hej") != 0) {
+		printf("\n%u: out_str != Hej\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (sensors_config_get_handle("bma150", "version") >= 0) {
+		printf("\n%u: sensors_config_get_handle should fail!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	if (sensors_config_get_value(-1, TYPE_INT, (void*)&out_int, sizeof(out_int)) >= 0) {
+		printf("\n%u: sensors_config_get_value should fail!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
 	if (sensors_config_get_key("akm8973", "name", TYPE_STRING, (void*)&out_str, sizeof(out_str)) < 0) {
 		printf("\n%u: sensors_config_get_key should succeed!\n", __LINE__);
 		ret = 0;
@@ -86,6 +135,11 @@ int main()
 		ret = 0;
 		goto exit;
 	}
+	if (sensors_config_get_key("akm8973", "gain", TYPE_FLOAT, (void*)&out_float, sizeof(out_float)-1) >= 0) {
+		printf("\n%u: sensors_config_get_key should fail!\n", __LINE__);
+		ret = 0;
+		goto exit;
+	}
 
 exit:
 	printf("%s\n", ret ? "OK" : "FAILED!");
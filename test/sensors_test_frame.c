@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <hardware/sensors.h>
+#include "sensors_frame.h"
+
+#define PERIOD		10
+#define MAX_FRAMES	8
+
+static struct sensor_t accel = {
+	.name = "accel",
+	.type = SENSOR_TYPE_ACCELEROMETER,
+};
+
+static struct sensor_t magnetic = {
+	.name = "magnetic",
+	.type = SENSOR_TYPE_MAGNETIC_FIELD,
+};
+
+static struct frame_data frames[MAX_FRAMES];
+static int nr_frames;
+
+static void test_frame(struct sensors_frame_t *fr, struct frame_data *frame)
+{
+	if (nr_frames < MAX_FRAMES)
+		frames[nr_frames] = *frame;
+	nr_frames++;
+}
+
+static void put(struct sensors_frame_t *fr, struct sensor_t *sensor,
+		int64_t t, int value)
+{
+	int data[3] = { value, value, value };
+	struct sensor_data_t sd = {
+		.sensor = sensor,
+		.data = data,
+		.size = 3,
+		.scale = 1,
+		.status = SENSOR_STATUS_ACCURACY_HIGH,
+		.timestamp = t,
+	};
+
+	sensors_frame_put(fr, &sd);
+}
+
+/* frame n is at t with accel and magnetic at a and m on every axis */
+static int check(int line, int n, int64_t t, float a, float m)
+{
+	int i;
+
+	if (nr_frames <= n) {
+		printf("\n%u: frame %d missing\n", line, n);
+		return 0;
+	}
+	if (frames[n].timestamp != t) {
+		printf("\n%u: frame %d at %lld, not %lld\n", line, n,
+		       (long long)frames[n].timestamp, (long long)t);
+		return 0;
+	}
+	for (i = 0; i < FRAME_AXIS; i++) {
+		if (frames[n].data[0][i] != a || frames[n].data[1][i] != m) {
+			printf("\n%u: frame %d is %g %g, not %g %g\n", line, n,
+			       frames[n].data[0][i], frames[n].data[1][i], a, m);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int main()
+{
+	static const int types[] = {
+		SENSOR_TYPE_ACCELEROMETER,
+		SENSOR_TYPE_MAGNETIC_FIELD,
+	};
+	struct sensors_frame_t fr;
+	int ret = 1;
+
+	printf("Testing sensor frame ... ");
+	sensors_frame_init(&fr, types, 2, PERIOD, test_frame);
+
+	/* the first frame is at the newest first sample */
+	put(&fr, &accel, 100, 0);
+	put(&fr, &magnetic, 100, 0);
+	if (!check(__LINE__, 0, 100, 0, 0)) {
+		ret = 0;
+		goto exit;
+	}
+
+	/* both inputs are interpolated to the frame time */
+	put(&fr, &accel, 115, 15);
+	if (nr_frames != 1) {
+		printf("\n%u: frame emitted before all inputs were in\n",
+		       __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	put(&fr, &magnetic, 115, 30);
+	if (!check(__LINE__, 1, 110, 10, 20)) {
+		ret = 0;
+		goto exit;
+	}
+
+	/* magnetic stops, it holds once accel is a period past the frame */
+	put(&fr, &accel, 125, 25);
+	if (nr_frames != 2) {
+		printf("\n%u: frame emitted before the missing input was due\n",
+		       __LINE__);
+		ret = 0;
+		goto exit;
+	}
+	put(&fr, &accel, 135, 35);
+	if (!check(__LINE__, 2, 120, 20, 30)) {
+		ret = 0;
+		goto exit;
+	}
+
+	/* frames in a gap longer than FRAME_MAX_LAG periods are skipped */
+	put(&fr, &accel, 1000, 1000);
+	put(&fr, &magnetic, 1000, 50);
+	if (!check(__LINE__, 3, 1000, 1000, 50)) {
+		ret = 0;
+		goto exit;
+	}
+	if (nr_frames != 4) {
+		printf("\n%u: %d frames, not 4\n", __LINE__, nr_frames);
+		ret = 0;
+		goto exit;
+	}
+
+exit:
+	printf("%s\n", ret ? "OK" : "FAILED!");
+	return 0;
+}
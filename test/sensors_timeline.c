@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Turns a tracepoint dump (see sensors_tracepoint.h) into a timeline per
+ * polled sample, e.g.
+ *
+ *   make timeline TIMELINE_ARGS="dash.tp"
+ *
+ * Every TP_POLL is matched with the latest record of each stage carrying
+ * the same sample timestamp at or before it, and the TP_WAKEUP which led
+ * to its TP_READ on the reading thread. The stage times are printed
+ * relative to the first stage found, followed by the delay from each
+ * stage to the next over all samples. With -q only the summary is
+ * printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sensors_tracepoint.h"
+
+/* how far back on the reading thread a wakeup is looked for */
+#define TIMELINE_WAKEUP_SCAN	64
+
+struct timeline_ring {
+	int tid;
+	unsigned int count;
+	struct tracepoint_record *rec;
+};
+
+struct timeline_ref {
+	struct tracepoint_record *rec;
+	unsigned int ring;
+	unsigned int pos;
+};
+
+struct timeline_delays {
+	int64_t *ns;
+	unsigned int nr;
+	unsigned int max;
+};
+
+static const char *stage_name[TP_STAGES] = {
+	[TP_WAKEUP] = "wakeup",
+	[TP_READ] = "read",
+	[TP_WRAPPER] = "wrapper",
+	[TP_CLIENT] = "client",
+	[TP_FUSION] = "fusion",
+	[TP_PUT] = "put",
+	[TP_POLL] = "poll",
+};
+
+static struct timeline_ring *rings;
+static unsigned int nr_rings;
+static struct timeline_delays delays[TP_STAGES];
+static struct timeline_delays total;
+
+static int timeline_load(const char *path)
+{
+	struct tracepoint_header hdr;
+	struct tracepoint_ring_header rh;
+	FILE *file;
+	unsigned int i;
+
+	file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    hdr.magic != TRACEPOINT_MAGIC ||
+	    hdr.version != TRACEPOINT_VERSION) {
+		fprintf(stderr, "%s: not a tracepoint dump\n", path);
+		goto err;
+	}
+
+	rings = calloc(hdr.nr_rings, sizeof(*rings));
+	if (!rings && hdr.nr_rings)
+		goto err;
+
+	for (i = 0; i < hdr.nr_rings; i++) {
+		if (fread(&rh, sizeof(rh), 1, file) != 1)
+			goto truncated;
+		rings[i].tid = rh.tid;
+		rings[i].rec = malloc(rh.count * sizeof(*rings[i].rec) + 1);
+		if (!rings[i].rec)
+			goto err;
+		if (fread(rings[i].rec, sizeof(*rings[i].rec), rh.count, file) !=
+		    rh.count)
+			goto truncated;
+		rings[i].count = rh.count;
+		nr_rings++;
+	}
+
+	fclose(file);
+	return 0;
+
+truncated:
+	fprintf(stderr, "%s: truncated dump\n", path);
+err:
+	fclose(file);
+	return -1;
+}
+
+static int timeline_cmp(const void *a, const void *b)
+{
+	const struct tracepoint_record *ra = ((const struct timeline_ref *)a)->rec;
+	const struct tracepoint_record *rb = ((const struct timeline_ref *)b)->rec;
+
+	if (ra->sample != rb->sample)
+		return ra->sample < rb->sample ? -1 : 1;
+	if (ra->time != rb->time)
+		return ra->time < rb->time ? -1 : 1;
+	return 0;
+}
+
+static int delay_cmp(const void *a, const void *b)
+{
+	int64_t da = *(const int64_t *)a, db = *(const int64_t *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+static void delay_add(struct timeline_delays *d, int64_t ns)
+{
+	int64_t *p;
+
+	if (d->nr == d->max) {
+		d->max = d->max ? d->max * 2 : 1024;
+		p = realloc(d->ns, d->max * sizeof(*p));
+		if (!p) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		d->ns = p;
+	}
+	d->ns[d->nr++] = ns;
+}
+
+/* the wakeup the read was done for, if the ring still has it */
+static struct tracepoint_record *timeline_wakeup(const struct timeline_ref *read)
+{
+	struct timeline_ring *r = &rings[read->ring];
+	unsigned int i, n;
+
+	for (i = read->pos, n = 0; i-- > 0 && n < TIMELINE_WAKEUP_SCAN; n++) {
+		if (r->rec[i].stage == TP_WAKEUP)
+			return &r->rec[i];
+		if (r->rec[i].stage == TP_READ)
+			break;
+	}
+
+	return NULL;
+}
+
+/* refs[0..nr) all carry the sample of poll */
+static void timeline_sample(const struct timeline_ref *refs, unsigned int nr,
+			    const struct timeline_ref *poll, int quiet)
+{
+	const struct timeline_ref *stage[TP_STAGES];
+	struct tracepoint_record *wakeup = NULL;
+	int64_t first = 0, last = 0, t;
+	unsigned int i;
+	int s;
+
+	memset(stage, 0, sizeof(stage));
+	for (i = 0; i < nr; i++) {
+		struct tracepoint_record *rec = refs[i].rec;
+
+		if (rec->time > poll->rec->time)
+			break;
+		if (rec->stage >= TP_STAGES || rec->stage == TP_WAKEUP)
+			continue;
+		/* fused samples may share the timestamp, the put may not */
+		if ((rec->stage == TP_PUT || rec->stage == TP_POLL) &&
+		    rec->sensor != poll->rec->sensor)
+			continue;
+		stage[rec->stage] = &refs[i];
+	}
+	stage[TP_POLL] = poll;
+	if (stage[TP_READ])
+		wakeup = timeline_wakeup(stage[TP_READ]);
+
+	if (!quiet)
+		printf("sensor %d sample %lld:", poll->rec->sensor,
+		       (long long)poll->rec->sample);
+
+	for (s = 0; s < TP_STAGES; s++) {
+		if (s == TP_WAKEUP)
+			t = wakeup ? wakeup->time : 0;
+		else
+			t = stage[s] ? stage[s]->rec->time : 0;
+		if (!t)
+			continue;
+
+		if (!first)
+			first = last = t;
+		else
+			delay_add(&delays[s], t - last);
+		if (!quiet)
+			printf(" %s +%lld", stage_name[s],
+			       (long long)(t - first) / 1000);
+		last = t;
+	}
+	delay_add(&total, poll->rec->time - poll->rec->sample);
+
+	if (!quiet)
+		printf(" us, %lld us after sample\n",
+		       (long long)(poll->rec->time - poll->rec->sample) / 1000);
+}
+
+static void delays_print(const char *name, struct timeline_delays *d)
+{
+	if (!d->nr)
+		return;
+
+	qsort(d->ns, d->nr, sizeof(*d->ns), delay_cmp);
+	printf("  %-16s %6u samples, p50 %lld us, p90 %lld us, max %lld us\n",
+	       name, d->nr, (long long)d->ns[d->nr / 2] / 1000,
+	       (long long)d->ns[d->nr * 9 / 10] / 1000,
+	       (long long)d->ns[d->nr - 1] / 1000);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-q] dump\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct timeline_ref *refs;
+	unsigned int nr = 0, i, j, k;
+	int quiet = 0;
+	int opt, s;
+	char name[32];
+
+	while ((opt = getopt(argc, argv, "q")) != -1) {
+		switch (opt) {
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (timeline_load(argv[optind]) < 0)
+		return 1;
+
+	for (i = 0; i < nr_rings; i++)
+		nr += rings[i].count;
+	refs = malloc(nr * sizeof(*refs) + 1);
+	if (!refs)
+		return 1;
+
+	for (i = 0, k = 0; i < nr_rings; i++) {
+		for (j = 0; j < rings[i].count; j++, k++) {
+			refs[k].rec = &rings[i].rec[j];
+			refs[k].ring = i;
+			refs[k].pos = j;
+		}
+	}
+	qsort(refs, nr, sizeof(*refs), timeline_cmp);
+
+	/* every group of records carrying one sample */
+	for (i = 0; i < nr; i = j) {
+		for (j = i + 1; j < nr; j++)
+			if (refs[j].rec->sample != refs[i].rec->sample)
+				break;
+		if (!refs[i].rec->sample)
+			continue;
+
+		for (k = i; k < j; k++)
+			if (refs[k].rec->stage == TP_POLL)
+				timeline_sample(refs + i, j - i, &refs[k],
+						quiet);
+	}
+
+	printf("%u records on %u threads, stage to stage:\n", nr, nr_rings);
+	for (s = 1; s < TP_STAGES; s++) {
+		snprintf(name, sizeof(name), "-> %s", stage_name[s]);
+		delays_print(name, &delays[s]);
+	}
+	delays_print("sample -> poll", &total);
+
+	return 0;
+}
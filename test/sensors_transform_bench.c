@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012 Sony Mobile Communications AB.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark of the axis transform stage. A batch of raw xyz samples
+ * is mapped with the per-axis map/sign/scale code the drivers used to
+ * have and with sensor_transform_apply(), and the results are compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "sensor_util.h"
+
+#define BENCH_BATCH	64
+#define BENCH_AXIS	3
+
+/* set up at run time like a sensor read from the config file */
+struct bench_desc {
+	int map[BENCH_AXIS];
+	int sign[BENCH_AXIS];
+	float scale;
+};
+
+/* out[i] = in[map[i]] * sign[i] * scale, as in the old scale_and_map */
+static void bench_branch(const struct bench_desc *d, const int *in,
+			 float *out, int n)
+{
+	int i;
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		for (i = 0; i < BENCH_AXIS; i++)
+			out[i] = in[d->map[i]] * d->sign[i] * d->scale;
+	}
+}
+
+/* out[map[i]] = in[i] * sign[i], as in the old sensor_xyz_read */
+static void bench_branch_int(const struct bench_desc *d, const int *in,
+			     int *out, int n)
+{
+	int i;
+
+	for (; n > 0; n--, in += 3, out += 3) {
+		for (i = 0; i < BENCH_AXIS; i++)
+			out[d->map[i]] = in[i] * d->sign[i];
+	}
+}
+
+static double bench_ns(int64_t start, unsigned int loops)
+{
+	return (double)(get_current_nano_time() - start) /
+		((double)loops * BENCH_BATCH);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-l loops]\n"
+		"  -l  batches of %d samples per run (default 200000)\n",
+		name, BENCH_BATCH);
+}
+
+int main(int argc, char *argv[])
+{
+	static int in[BENCH_BATCH * BENCH_AXIS];
+	static float ref[BENCH_BATCH * BENCH_AXIS];
+	static float out[BENCH_BATCH * BENCH_AXIS];
+	static int ref_int[BENCH_BATCH * BENCH_AXIS];
+	static int out_int[BENCH_BATCH * BENCH_AXIS];
+	struct sensor_transform_t t, t_int;
+	struct bench_desc d = {
+		.map = { 1, 0, 2 },
+		.sign = { -1, 1, -1 },
+		.scale = 9.81f / 256,
+	};
+	unsigned int loops = 200000;
+	unsigned int l;
+	volatile float sink = 0;
+	volatile int sink_int = 0;
+	float err = 0;
+	int mismatch = 0;
+	int64_t start;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "l:h")) != -1) {
+		switch (opt) {
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!loops) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < BENCH_BATCH * BENCH_AXIS; i++)
+		in[i] = (rand() % 8192) - 4096;
+
+	sensor_transform_init(&t);
+	sensor_transform_init(&t_int);
+	for (i = 0; i < BENCH_AXIS; i++) {
+		sensor_transform_set(&t, i, d.map[i], d.sign[i] * d.scale);
+		sensor_transform_set(&t_int, d.map[i], i, d.sign[i]);
+	}
+
+	bench_branch(&d, in, ref, BENCH_BATCH);
+	sensor_transform_apply(&t, in, out, BENCH_BATCH);
+	bench_branch_int(&d, in, ref_int, BENCH_BATCH);
+	sensor_transform_apply_int(&t_int, in, out_int, BENCH_BATCH);
+	for (i = 0; i < BENCH_BATCH * BENCH_AXIS; i++) {
+		if (fabsf(out[i] - ref[i]) > err)
+			err = fabsf(out[i] - ref[i]);
+		if (out_int[i] != ref_int[i])
+			mismatch++;
+	}
+
+	printf("%-10s %10s\n", "stage", "ns/sample");
+
+	start = get_current_nano_time();
+	for (l = 0; l < loops; l++) {
+		bench_branch(&d, in, out, BENCH_BATCH);
+		sink += out[l % (BENCH_BATCH * BENCH_AXIS)];
+	}
+	printf("%-10s %10.2f\n", "branch", bench_ns(start, loops));
+
+	start = get_current_nano_time();
+	for (l = 0; l < loops; l++) {
+		sensor_transform_apply(&t, in, out, BENCH_BATCH);
+		sink += out[l % (BENCH_BATCH * BENCH_AXIS)];
+	}
+	printf("%-10s %10.2f\n", "transform", bench_ns(start, loops));
+
+	start = get_current_nano_time();
+	for (l = 0; l < loops; l++) {
+		bench_branch_int(&d, in, out_int, BENCH_BATCH);
+		sink_int += out_int[l % (BENCH_BATCH * BENCH_AXIS)];
+	}
+	printf("%-10s %10.2f\n", "branch/i", bench_ns(start, loops));
+
+	start = get_current_nano_time();
+	for (l = 0; l < loops; l++) {
+		sensor_transform_apply_int(&t_int, in, out_int, BENCH_BATCH);
+		sink_int += out_int[l % (BENCH_BATCH * BENCH_AXIS)];
+	}
+	printf("%-10s %10.2f\n", "transform/i", bench_ns(start, loops));
+
+	printf("max error %g, %d integer mismatches\n", err, mismatch);
+
+	return mismatch || err > 1e-4f;
+}